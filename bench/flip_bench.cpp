@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "jpeg_writer.hpp"
+#include "stb/stb_image.h"
+
+// Cost of flipping 8K textures vertically, for the texture loader's
+// bottom-up rows: decoding with the flip fused into the row writes,
+// against decoding top-down and then swapping the rows in place, the way
+// stb_image used to. The swap reads and writes every byte of the image
+// once more, that traffic is what the fused flip saves.
+//
+//     flip_bench [SIZE]
+
+// Not declared by the bundled version of the header
+unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len);
+
+constexpr int RUNS = 7;
+
+struct Sample
+{
+	std::string name;
+	std::vector<unsigned char> bytes;
+};
+
+// Same swap as stb_image's own pass
+void flip_rows(unsigned char *pixels, int width, int height, int channels)
+{
+	size_t row_bytes = (size_t)width * channels;
+	unsigned char temp[2048];
+	for (int row = 0; row < height / 2; ++row)
+	{
+		unsigned char *top = pixels + row * row_bytes;
+		unsigned char *bottom = pixels + (height - row - 1) * row_bytes;
+		for (size_t done = 0; done < row_bytes; done += sizeof(temp))
+		{
+			size_t count = std::min(sizeof(temp), row_bytes - done);
+			memcpy(temp, top + done, count);
+			memcpy(top + done, bottom + done, count);
+			memcpy(bottom + done, temp, count);
+		}
+	}
+}
+
+struct Timing
+{
+	double decode;
+	double fused;
+	double swap;
+	bool identical;
+};
+
+double decode_time(const Sample &sample, bool flip, std::vector<unsigned char> &pixels)
+{
+	stbi_load_options options = {};
+	options.flip_vertically = flip;
+
+	int width, height, channels;
+	auto start = std::chrono::steady_clock::now();
+	unsigned char *decoded = stbi_load_from_memory_ex(sample.bytes.data(), (int)sample.bytes.size(), &width,
+							  &height, &channels, 4, &options);
+	auto end = std::chrono::steady_clock::now();
+
+	pixels.assign(decoded, decoded + (size_t)width * height * 4);
+	stbi_image_free(decoded);
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Best of each, alternating so both decodes see the same machine state.
+// Fresh allocations are faulted in by the decoder either way, the swap
+// runs on pages already in.
+Timing measure(const Sample &sample, int size)
+{
+	Timing best = {1e30, 1e30, 1e30, true};
+	std::vector<unsigned char> top_down, bottom_up;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		best.decode = std::min(best.decode, decode_time(sample, false, top_down));
+		best.fused = std::min(best.fused, decode_time(sample, true, bottom_up));
+
+		auto start = std::chrono::steady_clock::now();
+		flip_rows(top_down.data(), size, size, 4);
+		auto end = std::chrono::steady_clock::now();
+		best.swap = std::min(best.swap, std::chrono::duration<double, std::milli>(end - start).count());
+
+		best.identical = best.identical && top_down == bottom_up;
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	int size = argc > 1 ? std::atoi(argv[1]) : 8192;
+	if (size <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [SIZE]\n";
+		return 1;
+	}
+
+	std::vector<unsigned char> rgb = synthetic_image(size);
+	std::vector<Sample> samples;
+	samples.push_back(Sample{"jpeg 4:2:0", encode_jpeg(rgb.data(), size, size, 90, true)});
+
+	int length;
+	unsigned char *png = stbi_write_png_to_mem(rgb.data(), size * 3, size, size, 3, &length);
+	samples.push_back(Sample{"png", std::vector<unsigned char>(png, png + length)});
+	STBIW_FREE(png);
+
+	// RGBA, as the loader decodes it
+	double image_mib = (double)size * size * 4 / (1024. * 1024.);
+	std::cout << size << "x" << size << " RGBA, " << image_mib << " MiB\n";
+	std::cout << "image\tdecode (ms)\tfused flip (ms)\tswap (ms)\tswap traffic (MiB)\tswap (GB/s)\n";
+	std::cout << std::fixed << std::setprecision(1);
+
+	bool identical = true;
+	for (auto &sample : samples)
+	{
+		Timing timing = measure(sample, size);
+		identical = identical && timing.identical;
+
+		double traffic = 2. * image_mib;
+		std::cout << sample.name << "\t" << timing.decode << "\t" << timing.fused << "\t" << timing.swap << "\t"
+			  << traffic << "\t" << traffic * 1024. * 1024. / (timing.swap * 1e6) << "\n";
+	}
+
+	if (!identical)
+		std::cerr << "The fused flip doesn't match the swapped rows\n";
+
+	return identical ? 0 : 1;
+}
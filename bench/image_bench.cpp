@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "image_source.hpp"
+#include "jpeg_writer.hpp"
+#include "stb/stb_image.h"
+
+// Decode time of the same images read through stbi_load (stdio),
+// stbi_load_from_memory on the file read beforehand, mapped one by one
+// (ImageSource), mapped once as entries of a tar archive, decoded flipped
+// into memory allocated beforehand as TextureLoader does with its staging
+// buffer, and for JPEGs at half size in the DCT domain. Files are read
+// once before timing, so this measures the warm cache.
+//
+// Each decode also reports its peak memory: how far the resident set grew
+// above where it was, the high water mark reset through
+// /proc/self/clear_refs (Linux only, null elsewhere). The flipped decode
+// reuses the thread's ImageArena, its peak is only what that had to grow.
+// Then the whole corpus is decoded on 1 to N threads.
+//
+//     image_bench [-o RESULTS.json] [FILE...]
+//
+// Without files, res/textures is used. Synthetic 1K, 4K and 8K JPEG / PNG
+// / TGA images, and 4K grey and RGBA PNGs, are written to
+// image_bench_corpus/ on the first run. Results go to image_bench.json by
+// default, to compare between commits.
+
+constexpr int RUNS = 3;
+constexpr const char *CORPUS = "image_bench_corpus";
+
+const char *const METHODS[] = {"stdio", "memory", "mmap", "archive", "into", "half"};
+constexpr int METHOD_COUNT = sizeof(METHODS) / sizeof(METHODS[0]);
+
+// Best of the runs, ms < 0 when the method failed or doesn't apply.
+// Megapixels are the full size image's, half size decodes included.
+struct Result
+{
+	double ms;
+	double mpix_per_s;
+	long peak_kib;
+};
+
+struct Sample
+{
+	std::string path;
+	std::string name;
+	size_t bytes;
+	int width;
+	int height;
+	int channels;
+	bool jpeg;
+	Result results[METHOD_COUNT];
+};
+
+struct Scaling
+{
+	unsigned int threads;
+	double ms;
+	double mpix_per_s;
+	long peak_kib;
+};
+
+size_t file_size(const std::string &path)
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+std::string base_name(const std::string &path)
+{
+	size_t slash = path.find_last_of('/');
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::vector<std::string> list_images(const std::string &directory)
+{
+	std::vector<std::string> paths;
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+		return paths;
+
+	while (dirent *entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		size_t dot = name.rfind('.');
+		std::string extension = dot == std::string::npos ? "" : name.substr(dot);
+		if (extension == ".jpg" || extension == ".png" || extension == ".tga")
+			paths.push_back(directory + "/" + name);
+	}
+	closedir(dir);
+
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+// JPEGs are always RGB
+void write_synthetic(const std::string &path, int size, int channels, const std::string &extension)
+{
+	if (file_size(path))
+		return;
+
+	std::cout << "Writing " << path << "\n";
+	std::vector<unsigned char> pixels = synthetic_image(size, channels);
+	if (extension == ".jpg")
+		write_jpeg(path, pixels.data(), size, size, 90, true);
+	else if (extension == ".png")
+		stbi_write_png(path.c_str(), size, size, channels, pixels.data(), size * channels);
+	else
+		stbi_write_tga(path.c_str(), size, size, channels, pixels.data());
+}
+
+// Zero padded and NUL terminated
+void write_octal(char *field, size_t size, size_t value)
+{
+	field[size - 1] = 0;
+	for (size_t i = size - 1; i-- > 0; value /= 8)
+		field[i] = (char)('0' + value % 8);
+}
+
+// Plain ustar archive of the samples, named after their base names
+bool write_tar(const std::string &path, const std::vector<Sample> &samples)
+{
+	FILE *out = fopen(path.c_str(), "wb");
+	if (!out)
+		return false;
+
+	std::vector<char> block(512);
+	for (auto &sample : samples)
+	{
+		FILE *in = fopen(sample.path.c_str(), "rb");
+		if (!in)
+			continue;
+
+		std::fill(block.begin(), block.end(), 0);
+		strncpy(&block[0], sample.name.c_str(), 99);
+		write_octal(&block[100], 8, 0644);
+		write_octal(&block[108], 8, 0);
+		write_octal(&block[116], 8, 0);
+		write_octal(&block[124], 12, sample.bytes);
+		write_octal(&block[136], 12, 0);
+		block[156] = '0';
+		memcpy(&block[257], "ustar", 6);
+		memcpy(&block[263], "00", 2);
+
+		// The checksum is computed with its own field as spaces
+		memset(&block[148], ' ', 8);
+		unsigned int checksum = 0;
+		for (char c : block)
+			checksum += (unsigned char)c;
+		write_octal(&block[148], 7, checksum);
+		fwrite(block.data(), 1, block.size(), out);
+
+		std::vector<char> data(sample.bytes);
+		size_t read = fread(data.data(), 1, data.size(), in);
+		fclose(in);
+		data.resize((read + 511) / 512 * 512, 0);
+		fwrite(data.data(), 1, data.size(), out);
+	}
+
+	std::fill(block.begin(), block.end(), 0);
+	fwrite(block.data(), 1, block.size(), out);
+	fwrite(block.data(), 1, block.size(), out);
+
+	return fclose(out) == 0;
+}
+
+size_t status_kib(const char *field)
+{
+	FILE *status = fopen("/proc/self/status", "r");
+	if (!status)
+		return 0;
+
+	size_t kib = 0;
+	size_t length = strlen(field);
+	char line[256];
+	while (fgets(line, sizeof(line), status))
+		if (strncmp(line, field, length) == 0)
+			kib = strtoul(line + length, nullptr, 10);
+	fclose(status);
+
+	return kib;
+}
+
+// Gives freed heap pages back first, or reusing them wouldn't show.
+// Returns the resident KiB the peak is measured from, 0 if unsupported.
+size_t reset_peak()
+{
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+	FILE *clear = fopen("/proc/self/clear_refs", "w");
+	if (!clear)
+		return 0;
+
+	bool reset = fputs("5", clear) >= 0;
+	if (fclose(clear) != 0 || !reset)
+		return 0;
+
+	return status_kib("VmRSS:");
+}
+
+long peak_kib(size_t baseline)
+{
+	if (!baseline)
+		return -1;
+
+	size_t peak = status_kib("VmHWM:");
+	return peak > baseline ? (long)(peak - baseline) : 0;
+}
+
+// Decode returns false on failure and frees what it decoded, the peak is
+// the first run's
+template <typename Decode>
+Result measure(Decode decode, double megapixels)
+{
+	Result result = {-1., 0., -1};
+	double best = 0.;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		size_t baseline = run == 0 ? reset_peak() : 0;
+		auto start = std::chrono::steady_clock::now();
+		bool decoded = decode();
+		auto end = std::chrono::steady_clock::now();
+
+		if (!decoded)
+			return result;
+		if (run == 0)
+			result.peak_kib = peak_kib(baseline);
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		best = run == 0 ? ms : std::min(best, ms);
+	}
+
+	result.ms = best;
+	result.mpix_per_s = best > 0. ? megapixels / (best / 1000.) : 0.;
+	return result;
+}
+
+// Every sample once, the workers taking the next one as they finish, as
+// TextureLoader does from mapped files
+Scaling decode_all(const std::vector<Sample> &samples, unsigned int threads, double megapixels)
+{
+	Scaling scaling = {threads, 0., 0., -1};
+	for (int run = 0; run < RUNS; ++run)
+	{
+		size_t baseline = run == 0 ? reset_peak() : 0;
+		std::atomic<size_t> next(0);
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < threads; ++i)
+		{
+			workers.emplace_back([&]() {
+				for (size_t index; (index = next++) < samples.size();)
+				{
+					ImageSource source(samples[index].path);
+					int width, height, channels;
+					stbi_image_free(source.load(&width, &height, &channels, 0, true));
+				}
+			});
+		}
+		for (auto &worker : workers)
+			worker.join();
+
+		auto end = std::chrono::steady_clock::now();
+		if (run == 0)
+			scaling.peak_kib = peak_kib(baseline);
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		scaling.ms = run == 0 ? ms : std::min(scaling.ms, ms);
+	}
+
+	scaling.mpix_per_s = scaling.ms > 0. ? megapixels / (scaling.ms / 1000.) : 0.;
+	return scaling;
+}
+
+std::string json_string(const std::string &text)
+{
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		if ((unsigned char)c >= 0x20)
+			quoted += c;
+	}
+
+	return quoted + "\"";
+}
+
+void write_peak(std::ostream &out, long peak_kib)
+{
+	if (peak_kib < 0)
+		out << "null";
+	else
+		out << peak_kib;
+}
+
+bool write_json(const std::string &path, const std::vector<Sample> &samples, const std::vector<Scaling> &scaling)
+{
+	std::ofstream out(path);
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"runs\": " << RUNS << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+	    << ",\n  \"images\": [";
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		const Sample &sample = samples[i];
+		out << (i ? ",\n" : "\n") << "    {\"name\": " << json_string(sample.name) << ", \"bytes\": " << sample.bytes
+		    << ", \"width\": " << sample.width << ", \"height\": " << sample.height
+		    << ", \"channels\": " << sample.channels << ", \"methods\": {";
+		for (int m = 0; m < METHOD_COUNT; ++m)
+		{
+			const Result &result = sample.results[m];
+			out << (m ? ", " : "") << "\"" << METHODS[m] << "\": ";
+			if (result.ms < 0.)
+			{
+				out << "null";
+				continue;
+			}
+
+			out << "{\"ms\": " << result.ms << ", \"mpix_per_s\": " << result.mpix_per_s << ", \"peak_kib\": ";
+			write_peak(out, result.peak_kib);
+			out << "}";
+		}
+		out << "}}";
+	}
+
+	out << "\n  ],\n  \"scaling\": [";
+	for (size_t i = 0; i < scaling.size(); ++i)
+	{
+		out << (i ? ",\n" : "\n") << "    {\"threads\": " << scaling[i].threads << ", \"ms\": " << scaling[i].ms
+		    << ", \"mpix_per_s\": " << scaling[i].mpix_per_s
+		    << ", \"speedup\": " << scaling[0].ms / scaling[i].ms << ", \"peak_kib\": ";
+		write_peak(out, scaling[i].peak_kib);
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+
+	return (bool)out;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string json = "image_bench.json";
+	if (argc >= 3 && strcmp(argv[1], "-o") == 0)
+	{
+		json = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
+
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty())
+	{
+		paths = list_images("res/textures");
+
+		mkdir(CORPUS, 0755);
+		for (int size : {1024, 4096, 8192})
+		{
+			for (const char *extension : {".jpg", ".png", ".tga"})
+			{
+				std::string path = std::string(CORPUS) + "/" + std::to_string(size / 1024) + "k" + extension;
+				write_synthetic(path, size, 3, extension);
+				paths.push_back(path);
+			}
+		}
+
+		for (int channels : {1, 4})
+		{
+			std::string path = std::string(CORPUS) + (channels == 1 ? "/4k_grey.png" : "/4k_alpha.png");
+			write_synthetic(path, 4096, channels, ".png");
+			paths.push_back(path);
+		}
+	}
+
+	std::vector<Sample> samples;
+	for (auto &path : paths)
+	{
+		size_t bytes = file_size(path);
+		ImageSource source(path);
+		Sample sample = {path, base_name(path), bytes, 0, 0, 0, source.is_jpeg(), {}};
+		if (bytes && source.info(&sample.width, &sample.height, &sample.channels))
+			samples.push_back(sample);
+		else
+			std::cerr << "Skipping " << path << "\n";
+	}
+
+	std::string archive = std::string(CORPUS) + "/corpus.tar";
+	mkdir(CORPUS, 0755);
+	if (!write_tar(archive, samples))
+	{
+		std::cerr << "Can't write " << archive << "\n";
+		return 1;
+	}
+
+	// Kept open, so every entry shares the one mapping
+	std::shared_ptr<const ImageArchive> shared = ImageArchive::get(archive);
+
+	std::cout << "image\tKiB\tsize\tmethod\tms\tMPix/s\tpeak KiB\n";
+	std::cout << std::fixed << std::setprecision(2);
+
+	double megapixels = 0.;
+	for (auto &sample : samples)
+	{
+		double sample_megapixels = (double)sample.width * sample.height / 1e6;
+		megapixels += sample_megapixels;
+
+		std::vector<unsigned char> file(sample.bytes);
+		FILE *in = fopen(sample.path.c_str(), "rb");
+		size_t read = in ? fread(file.data(), 1, file.size(), in) : 0;
+		if (in)
+			fclose(in);
+
+		// The destination is touched before, like the mapped staging
+		// buffer it stands for, so it isn't part of the peak
+		int channels = sample.channels == 3 ? 4 : sample.channels;
+		std::vector<unsigned char> staging((size_t)sample.width * sample.height * channels, 0);
+
+		sample.results[0] = measure([&]() {
+			int width, height, channels;
+			unsigned char *pixels = stbi_load(sample.path.c_str(), &width, &height, &channels, 0);
+			stbi_image_free(pixels);
+			return pixels != nullptr;
+		}, sample_megapixels);
+
+		sample.results[1] = measure([&]() {
+			int width, height, channels;
+			unsigned char *pixels =
+				stbi_load_from_memory(file.data(), (int)read, &width, &height, &channels, 0);
+			stbi_image_free(pixels);
+			return pixels != nullptr;
+		}, sample_megapixels);
+
+		sample.results[2] = measure([&]() {
+			ImageSource source(sample.path);
+			int width, height, channels;
+			unsigned char *pixels = source.load(&width, &height, &channels, 0);
+			stbi_image_free(pixels);
+			return pixels != nullptr;
+		}, sample_megapixels);
+
+		sample.results[3] = measure([&]() {
+			ImageSource source(archive + "/" + sample.name);
+			int width, height, channels;
+			unsigned char *pixels = source.load(&width, &height, &channels, 0);
+			stbi_image_free(pixels);
+			return pixels != nullptr;
+		}, sample_megapixels);
+
+		sample.results[4] = measure([&]() {
+			ImageSource source(sample.path);
+			int width, height, file_channels;
+			return source.load_into(staging.data(), sample.width * channels, staging.size(), &width, &height,
+						&file_channels, channels, true);
+		}, sample_megapixels);
+
+		sample.results[5] = Result{-1., 0., -1};
+		if (sample.jpeg)
+		{
+			sample.results[5] = measure([&]() {
+				ImageSource source(sample.path);
+				int width, height, channels;
+				unsigned char *pixels = source.load(&width, &height, &channels, 0, false, 2);
+				stbi_image_free(pixels);
+				return pixels != nullptr;
+			}, sample_megapixels);
+		}
+
+		for (int m = 0; m < METHOD_COUNT; ++m)
+		{
+			const Result &result = sample.results[m];
+			if (result.ms < 0.)
+				continue;
+
+			std::cout << sample.name << "\t" << sample.bytes / 1024 << "\t" << sample.width << "x"
+				  << sample.height << "\t" << METHODS[m] << "\t" << result.ms << "\t" << result.mpix_per_s
+				  << "\t";
+			if (result.peak_kib < 0)
+				std::cout << "-\n";
+			else
+				std::cout << result.peak_kib << "\n";
+		}
+	}
+
+	// Powers of two up to the core count, and the core count itself
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<Scaling> scaling;
+	std::cout << "\nthreads\tms\tMPix/s\tspeedup\tpeak KiB\n";
+	for (unsigned int threads = 1;; threads = std::min(threads * 2, cores))
+	{
+		scaling.push_back(decode_all(samples, threads, megapixels));
+		const Scaling &last = scaling.back();
+		std::cout << threads << "\t" << last.ms << "\t" << last.mpix_per_s << "\t" << scaling[0].ms / last.ms
+			  << "\t";
+		if (last.peak_kib < 0)
+			std::cout << "-\n";
+		else
+			std::cout << last.peak_kib << "\n";
+
+		if (threads == cores)
+			break;
+	}
+
+	if (!write_json(json, samples, scaling))
+	{
+		std::cerr << "Can't write " << json << "\n";
+		return 1;
+	}
+	std::cout << "\nResults written to " << json << "\n";
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "jpeg_writer.hpp"
+#include "stb/stb_image.h"
+
+// JPEG decode throughput of stb_image per SIMD kernel level, in MPix/s,
+// to RGB and to RGBA (the texture loader's case, the only one with a SIMD
+// color conversion). Also checks every kernel decodes the same bytes.
+//
+//     jpeg_bench [FILE.jpg...]
+//
+// Without files, res/textures/*.jpg and synthetic 4K / 8K images encoded
+// in memory, with 4:4:4 and 4:2:0 chroma (the latter runs the upsampler).
+
+constexpr int RUNS = 5;
+
+struct Sample
+{
+	std::string name;
+	std::vector<unsigned char> bytes;
+};
+
+bool read_file(const std::string &path, std::vector<unsigned char> &bytes)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	int c;
+	while ((c = fgetc(file)) != EOF)
+		bytes.push_back((unsigned char)c);
+	fclose(file);
+
+	return true;
+}
+
+double best_time(const Sample &sample, int channels, std::vector<unsigned char> &pixels)
+{
+	double best = 0.;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		int width, height, components;
+		auto start = std::chrono::steady_clock::now();
+		unsigned char *decoded = stbi_load_from_memory(sample.bytes.data(), (int)sample.bytes.size(),
+							       &width, &height, &components, channels);
+		auto end = std::chrono::steady_clock::now();
+		if (!decoded)
+			return -1.;
+
+		pixels.assign(decoded, decoded + (size_t)width * height * channels);
+		stbi_image_free(decoded);
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		best = run == 0 ? seconds : std::min(best, seconds);
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty())
+		paths = {"res/textures/container.jpg", "res/textures/wall.jpg"};
+
+	std::vector<Sample> samples;
+	for (auto &path : paths)
+	{
+		Sample sample{path, {}};
+		if (read_file(path, sample.bytes))
+			samples.push_back(sample);
+		else
+			std::cerr << "Can't read " << path << "\n";
+	}
+
+	if (argc == 1)
+	{
+		for (int size : {4096, 8192})
+		{
+			std::vector<unsigned char> rgb = synthetic_image(size);
+			for (bool subsample : {false, true})
+			{
+				std::string name = std::string(size == 4096 ? "4k" : "8k") + (subsample ? " 4:2:0" : " 4:4:4");
+				samples.push_back(Sample{name, encode_jpeg(rgb.data(), size, size, 90, subsample)});
+			}
+		}
+	}
+
+	const int kernels[] = {STBI_KERNEL_SCALAR, STBI_KERNEL_SSE2, STBI_KERNEL_AVX2};
+	const char *names[] = {"scalar", "sse2", "avx2"};
+
+	std::cout << "image\tchannels";
+	for (int k = 0; k < 3; ++k)
+		if (stbi_simd_kernel_supported(kernels[k]))
+			std::cout << "\t" << names[k] << " (MPix/s)";
+	std::cout << "\n" << std::fixed << std::setprecision(1);
+
+	bool identical = true;
+	for (auto &sample : samples)
+	{
+		int width, height, components;
+		if (!stbi_info_from_memory(sample.bytes.data(), (int)sample.bytes.size(), &width, &height, &components))
+			continue;
+
+		for (int channels : {3, 4})
+		{
+			std::cout << sample.name << "\t" << channels;
+
+			std::vector<unsigned char> reference, pixels;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (!stbi_simd_kernel_supported(kernels[k]))
+					continue;
+
+				stbi_set_simd_kernel(kernels[k]);
+				double seconds = best_time(sample, channels, pixels);
+				std::cout << "\t" << width * (double)height / seconds / 1e6;
+
+				if (reference.empty())
+					reference = pixels;
+				else if (pixels != reference)
+				{
+					std::cout << " (differs)";
+					identical = false;
+				}
+			}
+			std::cout << "\n";
+		}
+	}
+	stbi_set_simd_kernel(STBI_KERNEL_AUTO);
+
+	return identical ? 0 : 1;
+}
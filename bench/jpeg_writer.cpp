@@ -0,0 +1,348 @@
+#include "jpeg_writer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace
+{
+const int ZIGZAG[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+const unsigned char LUMA_QUANT[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+const unsigned char CHROMA_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Huffman tables of the standard's annex K
+const unsigned char DC_LUMA_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const unsigned char DC_CHROMA_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const unsigned char DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const unsigned char AC_LUMA_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const unsigned char AC_LUMA_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+const unsigned char AC_CHROMA_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const unsigned char AC_CHROMA_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+struct HuffmanTable
+{
+	uint16_t codes[256];
+	unsigned char lengths[256];
+
+	HuffmanTable(const unsigned char *bits, const unsigned char *values)
+	{
+		uint16_t code = 0;
+		int k = 0;
+		for (int length = 1; length <= 16; ++length)
+		{
+			for (int i = 0; i < bits[length - 1]; ++i, ++k)
+			{
+				codes[values[k]] = code++;
+				lengths[values[k]] = (unsigned char)length;
+			}
+			code <<= 1;
+		}
+	}
+};
+
+class BitWriter
+{
+private:
+	std::vector<unsigned char> &out;
+	uint32_t buffer;
+	int count;
+
+public:
+	explicit BitWriter(std::vector<unsigned char> &out) : out(out), buffer(0), count(0)
+	{
+	}
+
+	void put(uint32_t bits, int length)
+	{
+		buffer = buffer << length | (bits & ((1u << length) - 1));
+		count += length;
+		while (count >= 8)
+		{
+			unsigned char byte = (unsigned char)(buffer >> (count - 8));
+			out.push_back(byte);
+			if (byte == 0xff)
+				out.push_back(0); // Stuffing, 0xff starts markers
+			count -= 8;
+		}
+	}
+
+	// Pads the last byte with ones
+	void flush()
+	{
+		if (count > 0)
+			put(0x7f, 8 - count);
+	}
+};
+
+void put16(std::vector<unsigned char> &out, int value)
+{
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+// c[u][x] = C(u) / 2 * cos((2x + 1) u pi / 16)
+struct DctTable
+{
+	float c[8][8];
+
+	DctTable()
+	{
+		for (int u = 0; u < 8; ++u)
+			for (int x = 0; x < 8; ++x)
+				c[u][x] = (float)((u == 0 ? std::sqrt(0.5) : 1.) / 2. *
+						  std::cos((2 * x + 1) * u * 3.14159265358979323846 / 16.));
+	}
+};
+
+void encode_block(BitWriter &bits, const float *block, const unsigned char *quant, int &previous_dc,
+		  const HuffmanTable &dc, const HuffmanTable &ac)
+{
+	static const DctTable dct;
+
+	float rows[64], coefficients[64];
+	for (int y = 0; y < 8; ++y)
+		for (int u = 0; u < 8; ++u)
+		{
+			float sum = 0.f;
+			for (int x = 0; x < 8; ++x)
+				sum += dct.c[u][x] * block[y * 8 + x];
+			rows[y * 8 + u] = sum;
+		}
+	for (int v = 0; v < 8; ++v)
+		for (int u = 0; u < 8; ++u)
+		{
+			float sum = 0.f;
+			for (int y = 0; y < 8; ++y)
+				sum += dct.c[v][y] * rows[y * 8 + u];
+			coefficients[v * 8 + u] = sum;
+		}
+
+	int quantized[64];
+	for (int k = 0; k < 64; ++k)
+		quantized[k] = (int)std::lround(coefficients[ZIGZAG[k]] / quant[k]);
+
+	// Magnitude category, then the value's low bits, negatives minus one
+	auto put_value = [&bits](const HuffmanTable &table, int run, int value) {
+		int magnitude = value < 0 ? -value : value;
+		int category = 0;
+		while (magnitude >> category)
+			++category;
+		int symbol = run << 4 | category;
+		bits.put(table.codes[symbol], table.lengths[symbol]);
+		if (category)
+			bits.put((uint32_t)(value < 0 ? value - 1 : value), category);
+	};
+
+	put_value(dc, 0, quantized[0] - previous_dc);
+	previous_dc = quantized[0];
+
+	int run = 0;
+	for (int k = 1; k < 64; ++k)
+	{
+		if (quantized[k] == 0)
+		{
+			++run;
+			continue;
+		}
+		for (; run > 15; run -= 16)
+			bits.put(ac.codes[0xf0], ac.lengths[0xf0]);
+		put_value(ac, run, quantized[k]);
+		run = 0;
+	}
+	if (run)
+		bits.put(ac.codes[0x00], ac.lengths[0x00]);
+}
+
+void put_table(std::vector<unsigned char> &out, int id, const unsigned char *bits, const unsigned char *values)
+{
+	int count = 0;
+	for (int i = 0; i < 16; ++i)
+		count += bits[i];
+
+	out.push_back((unsigned char)id);
+	out.insert(out.end(), bits, bits + 16);
+	out.insert(out.end(), values, values + count);
+}
+}
+
+std::vector<unsigned char> encode_jpeg(const unsigned char *rgb, int width, int height, int quality,
+				       bool subsample)
+{
+	static const HuffmanTable dc_luma(DC_LUMA_BITS, DC_VALUES);
+	static const HuffmanTable dc_chroma(DC_CHROMA_BITS, DC_VALUES);
+	static const HuffmanTable ac_luma(AC_LUMA_BITS, AC_LUMA_VALUES);
+	static const HuffmanTable ac_chroma(AC_CHROMA_BITS, AC_CHROMA_VALUES);
+
+	// IJG scaling, stored in zigzag order
+	quality = std::min(100, std::max(1, quality));
+	int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	unsigned char quant[2][64];
+	for (int k = 0; k < 64; ++k)
+	{
+		quant[0][k] = (unsigned char)std::min(255, std::max(1, (LUMA_QUANT[ZIGZAG[k]] * scale + 50) / 100));
+		quant[1][k] = (unsigned char)std::min(255, std::max(1, (CHROMA_QUANT[ZIGZAG[k]] * scale + 50) / 100));
+	}
+
+	std::vector<unsigned char> out = {0xff, 0xd8};
+
+	out.push_back(0xff);
+	out.push_back(0xdb);
+	put16(out, 2 + 2 * 65);
+	for (int t = 0; t < 2; ++t)
+	{
+		out.push_back((unsigned char)t);
+		out.insert(out.end(), quant[t], quant[t] + 64);
+	}
+
+	out.push_back(0xff);
+	out.push_back(0xc0);
+	put16(out, 17);
+	out.push_back(8);
+	put16(out, height);
+	put16(out, width);
+	out.push_back(3);
+	const unsigned char components[3][3] = {{1, (unsigned char)(subsample ? 0x22 : 0x11), 0}, {2, 0x11, 1}, {3, 0x11, 1}};
+	for (auto &component : components)
+		out.insert(out.end(), component, component + 3);
+
+	out.push_back(0xff);
+	out.push_back(0xc4);
+	put16(out, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+	put_table(out, 0x00, DC_LUMA_BITS, DC_VALUES);
+	put_table(out, 0x10, AC_LUMA_BITS, AC_LUMA_VALUES);
+	put_table(out, 0x01, DC_CHROMA_BITS, DC_VALUES);
+	put_table(out, 0x11, AC_CHROMA_BITS, AC_CHROMA_VALUES);
+
+	out.push_back(0xff);
+	out.push_back(0xda);
+	put16(out, 12);
+	out.push_back(3);
+	const unsigned char scan[] = {1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+	out.insert(out.end(), scan, scan + sizeof(scan));
+
+	// Level shifted YCbCr of a pixel, edges repeated
+	auto sample = [&](int x, int y, float *ycbcr) {
+		const unsigned char *pixel = rgb + ((size_t)std::min(y, height - 1) * width + std::min(x, width - 1)) * 3;
+		float r = pixel[0], g = pixel[1], b = pixel[2];
+		ycbcr[0] = 0.299f * r + 0.587f * g + 0.114f * b - 128.f;
+		ycbcr[1] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+		ycbcr[2] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+	};
+
+	BitWriter bits(out);
+	int dc[3] = {0, 0, 0};
+	int mcu = subsample ? 16 : 8;
+	float luma[4][64], cb[64], cr[64], ycbcr[3];
+	for (int my = 0; my < height; my += mcu)
+	{
+		for (int mx = 0; mx < width; mx += mcu)
+		{
+			std::fill(cb, cb + 64, 0.f);
+			std::fill(cr, cr + 64, 0.f);
+			float weight = subsample ? 0.25f : 1.f;
+			for (int y = 0; y < mcu; ++y)
+			{
+				for (int x = 0; x < mcu; ++x)
+				{
+					sample(mx + x, my + y, ycbcr);
+					luma[(y / 8) * 2 + x / 8][(y % 8) * 8 + x % 8] = ycbcr[0];
+					int c = subsample ? (y / 2) * 8 + x / 2 : y * 8 + x;
+					cb[c] += ycbcr[1] * weight;
+					cr[c] += ycbcr[2] * weight;
+				}
+			}
+
+			for (int i = 0; i < (subsample ? 4 : 1); ++i)
+				encode_block(bits, luma[i], quant[0], dc[0], dc_luma, ac_luma);
+			encode_block(bits, cb, quant[1], dc[1], dc_chroma, ac_chroma);
+			encode_block(bits, cr, quant[1], dc[2], dc_chroma, ac_chroma);
+		}
+	}
+	bits.flush();
+
+	out.push_back(0xff);
+	out.push_back(0xd9);
+
+	return out;
+}
+
+bool write_jpeg(const std::string &path, const unsigned char *rgb, int width, int height, int quality,
+		bool subsample)
+{
+	std::vector<unsigned char> bytes = encode_jpeg(rgb, width, height, quality, subsample);
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return fclose(file) == 0 && written;
+}
+
+std::vector<unsigned char> synthetic_image(int size, int channels)
+{
+	std::vector<unsigned char> pixels((size_t)size * size * channels);
+	uint32_t state = 12345;
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			state = state * 1664525u + 1013904223u;
+			int noise = (int)(state >> 29);
+			int wave = ((x * 7 + y * 3) / 16 % 64) - 32;
+			unsigned char *pixel = &pixels[((size_t)y * size + x) * channels];
+			pixel[0] = (unsigned char)std::min(255, std::max(0, x * 200 / size + wave + noise + 20));
+			if (channels < 3)
+				continue;
+
+			pixel[1] = (unsigned char)std::min(255, std::max(0, y * 200 / size - wave + noise + 20));
+			pixel[2] = (unsigned char)std::min(255, std::max(0, (x + y) * 100 / size + noise + 40));
+			if (channels == 4)
+			{
+				int64_t dx = x - size / 2, dy = y - size / 2;
+				int64_t fade = (dx * dx + dy * dy) * 255 / ((int64_t)size * size / 4);
+				pixel[3] = (unsigned char)std::max<int64_t>(0, 255 - fade);
+			}
+		}
+	}
+
+	return pixels;
+}
@@ -0,0 +1,20 @@
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include <string>
+#include <vector>
+
+// Baseline JPEG encoder for the benchmark corpora, the stb_image_write
+// bundled with GLFW predates its JPEG support. Standard Huffman tables,
+// IJG quality scaling, 4:4:4 or 4:2:0 chroma. Pixels are RGB8.
+std::vector<unsigned char> encode_jpeg(const unsigned char *rgb, int width, int height,
+				       int quality, bool subsample);
+
+bool write_jpeg(const std::string &path, const unsigned char *rgb, int width, int height,
+		int quality, bool subsample);
+
+// Gradients, soft waves and a little noise, photo-ish to the encoders.
+// Grey keeps the first channel, alpha is a radial fade.
+std::vector<unsigned char> synthetic_image(int size, int channels = 3);
+
+#endif /* JPEG_WRITER_H */
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mip_generator.hpp"
+
+// Throughput of the CPU mip chain generation, per filter, kernel and
+// thread count, in millions of level 0 pixels per second.
+
+constexpr int SIZE = 4096;
+constexpr int RUNS = 3;
+
+std::vector<unsigned char> noise(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	uint32_t state = 12345;
+	for (auto &value : pixels)
+	{
+		state = state * 1664525u + 1013904223u;
+		value = (unsigned char)(state >> 24);
+	}
+
+	return pixels;
+}
+
+double best_time(const std::vector<unsigned char> &pixels, const MipOptions &options)
+{
+	double best = 0.;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<MipLevel> levels = generate_mips(pixels.data(), SIZE, SIZE, options);
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		best = run == 0 ? seconds : std::min(best, seconds);
+	}
+
+	return best;
+}
+
+int main()
+{
+	std::vector<unsigned char> pixels = noise(SIZE, SIZE);
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << SIZE << "x" << SIZE << " RGBA8, sRGB, best of " << RUNS << "\n";
+	std::cout << "filter\tkernel\tthreads\tMPix/s\n";
+
+	for (MipFilter filter : {MipFilter::BOX, MipFilter::KAISER})
+	{
+		for (MipKernel kernel : {MipKernel::SCALAR, MipKernel::SSE2, MipKernel::AVX2})
+		{
+			if (!mip_kernel_supported(kernel))
+				continue;
+
+			for (unsigned int threads : {1u, cores})
+			{
+				MipOptions options;
+				options.filter = filter;
+				options.kernel = kernel;
+				options.threads = threads;
+
+				double seconds = best_time(pixels, options);
+				std::cout << mip_filter_name(filter) << "\t" << mip_kernel_name(kernel) << "\t" << threads
+					  << "\t" << std::fixed << std::setprecision(1) << SIZE * (double)SIZE / seconds / 1e6
+					  << "\n";
+
+				if (cores == 1)
+					break;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "stb/stb_image.h"
+
+// PNG decode throughput of stb_image with the stock and the fast inflate,
+// in MPix/s, and a conformance check: every image, and truncated and
+// corrupted copies of it, must give the same pixels or the same error
+// with both decoders. Exits with 1 if any don't.
+//
+//     png_bench [FILE.png...]
+//
+// Without files, res/textures/*.png and synthetic 2K images compressed by
+// stb_image_write (fixed Huffman codes) and, if built with zlib, at
+// several levels and strategies (stored, dynamic, RLE, Huffman only).
+
+// Not declared by the bundled version of the header
+unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len);
+
+constexpr int RUNS = 5;
+constexpr int SIZE = 2048;
+
+struct Sample
+{
+	std::string name;
+	std::vector<unsigned char> bytes;
+};
+
+bool read_file(const std::string &path, std::vector<unsigned char> &bytes)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	int c;
+	while ((c = fgetc(file)) != EOF)
+		bytes.push_back((unsigned char)c);
+	fclose(file);
+
+	return true;
+}
+
+// Soft gradients with noise, and flat sprite-like shapes with long runs
+std::vector<unsigned char> synthetic(int size, bool flat)
+{
+	std::vector<unsigned char> rgba((size_t)size * size * 4);
+	uint32_t state = 12345;
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			state = state * 1664525u + 1013904223u;
+			unsigned char *pixel = &rgba[((size_t)y * size + x) * 4];
+			if (flat)
+			{
+				int dx = x % 256 - 128, dy = y % 256 - 128;
+				bool inside = dx * dx + dy * dy < 90 * 90;
+				pixel[0] = inside ? 255 : 0;
+				pixel[1] = inside ? (unsigned char)(x / 256 * 32) : 0;
+				pixel[2] = inside ? 64 : 0;
+				pixel[3] = inside ? 255 : 0;
+			}
+			else
+			{
+				int noise = (int)(state >> 29);
+				pixel[0] = (unsigned char)(x * 250 / size + noise);
+				pixel[1] = (unsigned char)(y * 250 / size + noise);
+				pixel[2] = (unsigned char)((x + y) * 120 / size + noise);
+				pixel[3] = 255;
+			}
+		}
+	}
+
+	return rgba;
+}
+
+#ifdef HAVE_ZLIB
+void put32(std::vector<unsigned char> &out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((unsigned char)(value >> shift));
+}
+
+void put_chunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data)
+{
+	put32(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	put32(out, (uint32_t)crc32(0, &out[start], (uInt)(out.size() - start)));
+}
+
+// RGBA PNG with rows cycling through the none, sub and up filters
+std::vector<unsigned char> encode_png(const std::vector<unsigned char> &rgba, int size, int level, int strategy)
+{
+	size_t stride = (size_t)size * 4;
+	std::vector<unsigned char> raw;
+	raw.reserve((stride + 1) * size);
+	for (int y = 0; y < size; ++y)
+	{
+		const unsigned char *row = &rgba[y * stride];
+		int filter = y % 3;
+		raw.push_back((unsigned char)filter);
+		for (size_t i = 0; i < stride; ++i)
+		{
+			int prediction = 0;
+			if (filter == 1 && i >= 4)
+				prediction = row[i - 4];
+			else if (filter == 2 && y > 0)
+				prediction = row[i - stride];
+			raw.push_back((unsigned char)(row[i] - prediction));
+		}
+	}
+
+	z_stream stream = {};
+	deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy);
+	std::vector<unsigned char> idat(deflateBound(&stream, (uLong)raw.size()));
+	stream.next_in = raw.data();
+	stream.avail_in = (uInt)raw.size();
+	stream.next_out = idat.data();
+	stream.avail_out = (uInt)idat.size();
+	deflate(&stream, Z_FINISH);
+	idat.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	std::vector<unsigned char> png = {137, 80, 78, 71, 13, 10, 26, 10};
+	std::vector<unsigned char> header;
+	put32(header, (uint32_t)size);
+	put32(header, (uint32_t)size);
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	put_chunk(png, "IHDR", header);
+	put_chunk(png, "IDAT", idat);
+	put_chunk(png, "IEND", {});
+
+	return png;
+}
+#endif
+
+struct Result
+{
+	std::vector<unsigned char> pixels;
+	int width = 0, height = 0;
+	std::string error;
+};
+
+Result decode(const std::vector<unsigned char> &bytes, bool fast)
+{
+	stbi_set_fast_inflate(fast);
+
+	Result result;
+	int channels;
+	unsigned char *pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &result.width,
+						      &result.height, &channels, 4);
+	if (pixels)
+	{
+		result.pixels.assign(pixels, pixels + (size_t)result.width * result.height * 4);
+		stbi_image_free(pixels);
+	}
+	else
+	{
+		result.error = stbi_failure_reason();
+	}
+
+	return result;
+}
+
+bool same(const Result &a, const Result &b)
+{
+	return a.width == b.width && a.height == b.height && a.pixels == b.pixels && a.error == b.error;
+}
+
+// The image itself, then copies cut short and with flipped bytes past the header
+int conformance(const Sample &sample)
+{
+	std::vector<std::vector<unsigned char>> variants = {sample.bytes};
+	for (int percent : {10, 50, 90, 99})
+		variants.emplace_back(sample.bytes.begin(), sample.bytes.begin() + sample.bytes.size() * percent / 100);
+
+	uint32_t state = 4242;
+	for (int i = 0; i < 24; ++i)
+	{
+		std::vector<unsigned char> corrupt = sample.bytes;
+		for (int flip = 0; flip <= i % 4; ++flip)
+		{
+			state = state * 1664525u + 1013904223u;
+			size_t offset = 64 + state % (corrupt.size() - 64);
+			corrupt[offset] ^= (unsigned char)(1 + (state >> 24) % 255);
+		}
+		variants.push_back(corrupt);
+	}
+
+	int failures = 0;
+	for (auto &variant : variants)
+		if (!same(decode(variant, false), decode(variant, true)))
+			++failures;
+
+	return failures;
+}
+
+double best_time(const Sample &sample, bool fast)
+{
+	stbi_set_fast_inflate(fast);
+
+	double best = 0.;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		int width, height, channels;
+		auto start = std::chrono::steady_clock::now();
+		unsigned char *pixels = stbi_load_from_memory(sample.bytes.data(), (int)sample.bytes.size(),
+							      &width, &height, &channels, 4);
+		auto end = std::chrono::steady_clock::now();
+		if (!pixels)
+			return -1.;
+		stbi_image_free(pixels);
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		best = run == 0 ? seconds : std::min(best, seconds);
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty())
+		paths = {"res/textures/awesomeface.png"};
+
+	std::vector<Sample> samples;
+	for (auto &path : paths)
+	{
+		Sample sample{path, {}};
+		if (read_file(path, sample.bytes) && sample.bytes.size() > 64)
+			samples.push_back(sample);
+		else
+			std::cerr << "Can't read " << path << "\n";
+	}
+
+	if (argc == 1)
+	{
+		for (bool flat : {false, true})
+		{
+			std::vector<unsigned char> rgba = synthetic(SIZE, flat);
+			std::string name = flat ? "flat" : "noisy";
+
+			int length;
+			unsigned char *png = stbi_write_png_to_mem(rgba.data(), SIZE * 4, SIZE, SIZE, 4, &length);
+			samples.push_back(Sample{name + " stbiw", std::vector<unsigned char>(png, png + length)});
+			STBIW_FREE(png);
+
+#ifdef HAVE_ZLIB
+			samples.push_back(Sample{name + " stored", encode_png(rgba, SIZE, 0, Z_DEFAULT_STRATEGY)});
+			samples.push_back(Sample{name + " z1", encode_png(rgba, SIZE, 1, Z_DEFAULT_STRATEGY)});
+			samples.push_back(Sample{name + " z6", encode_png(rgba, SIZE, 6, Z_DEFAULT_STRATEGY)});
+			samples.push_back(Sample{name + " z9", encode_png(rgba, SIZE, 9, Z_DEFAULT_STRATEGY)});
+			samples.push_back(Sample{name + " rle", encode_png(rgba, SIZE, 6, Z_RLE)});
+			samples.push_back(Sample{name + " huffman", encode_png(rgba, SIZE, 6, Z_HUFFMAN_ONLY)});
+			samples.push_back(Sample{name + " fixed", encode_png(rgba, SIZE, 6, Z_FIXED)});
+#endif
+		}
+	}
+
+	std::cout << "image\tKiB\tstock (MPix/s)\tfast (MPix/s)\tspeedup\tmismatches\n";
+	std::cout << std::fixed << std::setprecision(1);
+
+	int total = 0;
+	for (auto &sample : samples)
+	{
+		int width, height, channels;
+		if (!stbi_info_from_memory(sample.bytes.data(), (int)sample.bytes.size(), &width, &height, &channels))
+			continue;
+
+		double pixels = (double)width * height / 1e6;
+		double stock = best_time(sample, false);
+		double fast = best_time(sample, true);
+		int failures = conformance(sample);
+		total += failures;
+
+		std::cout << sample.name << "\t" << sample.bytes.size() / 1024 << "\t" << pixels / stock << "\t"
+			  << pixels / fast << "\t" << std::setprecision(2) << stock / fast << "x" << std::setprecision(1)
+			  << "\t" << failures << "\n";
+	}
+	stbi_set_fast_inflate(1);
+
+	if (total)
+		std::cerr << total << " decodes differ between the stock and the fast inflate\n";
+
+	return total ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "jpeg_writer.hpp"
+#include "stb/stb_image.h"
+
+// JPEGs decoded at 1/2, 1/4 and 1/8 size, in the DCT domain, against a
+// full decode box filtered down to the same size: best time of a few
+// runs, the peak resident memory each needs on top of the input and the
+// PSNR between the two results. Each variant runs in a process of its own
+// so the peaks don't hide one another.
+//
+//     scale_bench [FILE.jpg...]
+//
+// Without files, synthetic 8K images with 4:4:4 and 4:2:0 chroma.
+
+constexpr int RUNS = 3;
+
+struct Sample
+{
+	std::string name;
+	std::vector<unsigned char> bytes;
+};
+
+struct Measure
+{
+	double milliseconds;
+	double peak_mib;
+};
+
+bool read_file(const std::string &path, std::vector<unsigned char> &bytes)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	int c;
+	while ((c = fgetc(file)) != EOF)
+		bytes.push_back((unsigned char)c);
+	fclose(file);
+
+	return true;
+}
+
+// Mean of each scale x scale block, clipped at the edges, RGBA
+std::vector<unsigned char> downsample(const unsigned char *pixels, int width, int height, int scale)
+{
+	int out_width = (width + scale - 1) / scale;
+	int out_height = (height + scale - 1) / scale;
+	std::vector<unsigned char> out((size_t)out_width * out_height * 4);
+	for (int y = 0; y < out_height; ++y)
+	{
+		for (int x = 0; x < out_width; ++x)
+		{
+			int sum[4] = {0, 0, 0, 0}, count = 0;
+			for (int sy = y * scale; sy < std::min(height, y * scale + scale); ++sy)
+			{
+				for (int sx = x * scale; sx < std::min(width, x * scale + scale); ++sx)
+				{
+					const unsigned char *pixel = pixels + ((size_t)sy * width + sx) * 4;
+					for (int c = 0; c < 4; ++c)
+						sum[c] += pixel[c];
+					++count;
+				}
+			}
+
+			for (int c = 0; c < 4; ++c)
+				out[((size_t)y * out_width + x) * 4 + c] = (unsigned char)((sum[c] + count / 2) / count);
+		}
+	}
+
+	return out;
+}
+
+// The scaled one straight into its buffer, as the texture loader does
+std::vector<unsigned char> decode(const Sample &sample, int scale, bool scaled)
+{
+	const unsigned char *bytes = sample.bytes.data();
+	int length = (int)sample.bytes.size();
+	int width, height, channels;
+	if (!stbi_info_from_memory(bytes, length, &width, &height, &channels))
+		return {};
+
+	if (scaled)
+	{
+		stbi_load_options options = {};
+		options.jpeg_scale_denom = scale;
+
+		int row_bytes = (width + scale - 1) / scale * 4;
+		std::vector<unsigned char> result((size_t)row_bytes * ((height + scale - 1) / scale));
+		if (!stbi_load_from_memory_into(bytes, length, result.data(), row_bytes, result.size(), &width,
+						&height, &channels, 4, &options))
+			return {};
+
+		return result;
+	}
+
+	unsigned char *pixels = stbi_load_from_memory(bytes, length, &width, &height, &channels, 4);
+	if (!pixels)
+		return {};
+
+	std::vector<unsigned char> result = downsample(pixels, width, height, scale);
+	stbi_image_free(pixels);
+
+	return result;
+}
+
+long resident_kib()
+{
+	long pages = 0, resident = 0;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (file)
+	{
+		if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(file);
+	}
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// In a child process, whose peak starts at what it inherited. Free heap
+// the parent left resident is handed back first, or the decode would
+// reuse it without showing up in the peak.
+Measure measure(const Sample &sample, int scale, bool scaled)
+{
+	Measure result = {-1., -1.};
+	int channel[2];
+	if (pipe(channel) != 0)
+		return result;
+
+	pid_t child = fork();
+	if (child == 0)
+	{
+#ifdef __GLIBC__
+		malloc_trim(0);
+#endif
+		long before = resident_kib();
+		double best = 1e30;
+		for (int run = 0; run < RUNS; ++run)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::vector<unsigned char> pixels = decode(sample, scale, scaled);
+			auto end = std::chrono::steady_clock::now();
+			if (pixels.empty())
+				_exit(1);
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		Measure measured = {best, (usage.ru_maxrss - before) / 1024.};
+		ssize_t written = write(channel[1], &measured, sizeof(measured));
+		_exit(written == sizeof(measured) ? 0 : 1);
+	}
+
+	close(channel[1]);
+	if (child > 0)
+	{
+		if (read(channel[0], &result, sizeof(result)) != sizeof(result))
+			result = Measure{-1., -1.};
+		waitpid(child, nullptr, 0);
+	}
+	close(channel[0]);
+
+	return result;
+}
+
+double psnr(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b)
+{
+	if (a.size() != b.size() || a.empty())
+		return 0.;
+
+	double error = 0.;
+	for (size_t i = 0; i < a.size(); ++i)
+		error += ((double)a[i] - b[i]) * ((double)a[i] - b[i]);
+	if (error == 0.)
+		return 99.;
+
+	return 10. * std::log10(255. * 255. * a.size() / error);
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<Sample> samples;
+	for (int i = 1; i < argc; ++i)
+	{
+		Sample sample{argv[i], {}};
+		if (read_file(argv[i], sample.bytes))
+			samples.push_back(sample);
+		else
+			std::cerr << "Can't read " << argv[i] << "\n";
+	}
+
+	if (argc == 1)
+	{
+		std::vector<unsigned char> rgb = synthetic_image(8192);
+		samples.push_back(Sample{"8k 4:4:4", encode_jpeg(rgb.data(), 8192, 8192, 90, false)});
+		samples.push_back(Sample{"8k 4:2:0", encode_jpeg(rgb.data(), 8192, 8192, 90, true)});
+	}
+
+	std::cout << "image\tscale\tscaled (ms)\tscaled peak (MiB)\tfull + box (ms)\tfull peak (MiB)\tspeedup\tPSNR (dB)\n";
+	std::cout << std::fixed << std::setprecision(1);
+
+	bool failed = false;
+	for (auto &sample : samples)
+	{
+		for (int scale : {2, 4, 8})
+		{
+			Measure scaled = measure(sample, scale, true);
+			Measure full = measure(sample, scale, false);
+			if (scaled.milliseconds < 0. || full.milliseconds < 0.)
+			{
+				std::cerr << "Can't decode " << sample.name << "\n";
+				failed = true;
+				break;
+			}
+
+			double quality = psnr(decode(sample, scale, true), decode(sample, scale, false));
+			std::cout << sample.name << "\t1/" << scale << "\t" << scaled.milliseconds << "\t" << scaled.peak_mib
+				  << "\t" << full.milliseconds << "\t" << full.peak_mib << "\t" << std::setprecision(2)
+				  << full.milliseconds / scaled.milliseconds << "x" << std::setprecision(1) << "\t" << quality
+				  << "\n";
+		}
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "gl_state.hpp"
+#include "shader.hpp"
+
+// Per-frame cost of uploading u_model once per draw, through the old
+// glGetUniformLocation path, the name lookup in the uniform table and
+// a UniformHandle resolved once.
+
+constexpr int FRAMES = 20;
+
+static const char *vertex_source = R"(#version 330 core
+in vec3 position;
+uniform mat4 u_model;
+uniform mat4 u_view;
+uniform mat4 u_projection;
+void main() {
+	gl_Position = u_projection * u_view * u_model * vec4(position, 1.f);
+}
+)";
+
+static const char *fragment_source = R"(#version 330 core
+out vec4 FragColor;
+void main() {
+	FragColor = vec4(1.f);
+}
+)";
+
+template <typename Upload>
+double frame_time(unsigned int draws, Upload upload)
+{
+	glm::mat4 model(1.f);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < FRAMES; ++frame)
+	{
+		for (unsigned int i = 0; i < draws; ++i)
+		{
+			model[3][0] = (float)i;
+			upload(model);
+		}
+		glFinish();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count() / FRAMES;
+}
+
+int main()
+{
+	if (!glfwInit())
+	{
+		std::cerr << "Failed to init GLFW" << std::endl;
+		return -1;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	GLFWwindow *window = glfwCreateWindow(64, 64, "uniform_bench", NULL, NULL);
+	if (!window)
+	{
+		std::cerr << "Failed to create the window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cerr << "Failed to initialize GLAD" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	Shader shaders(vertex_source, fragment_source);
+	shaders.use();
+
+	unsigned int program = shaders.get_program_id();
+	UniformHandle u_model = shaders.uniform("u_model");
+
+	std::cout << "draws\tlocation (ms)\tname (ms)\thandle (ms)\n";
+
+	for (unsigned int draws : {10u, 10000u, 100000u})
+	{
+		double location = frame_time(draws, [&](const glm::mat4 &model) {
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_model"), 1, GL_FALSE, glm::value_ptr(model));
+		});
+
+		double name = frame_time(draws, [&](const glm::mat4 &model) {
+			shaders.set_mat4("u_model", model);
+		});
+
+		double handle = frame_time(draws, [&](const glm::mat4 &model) {
+			shaders.set_mat4(u_model, model);
+		});
+
+		std::cout << draws << "\t" << location << "\t" << name << "\t" << handle << "\n";
+	}
+
+	GLState::delete_program(program);
+
+	glfwTerminate();
+	return 0;
+}
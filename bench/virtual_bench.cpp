@@ -0,0 +1,288 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gl_state.hpp"
+#include "ktx_file.hpp"
+#include "shader_batch.hpp"
+#include "shader_variants.hpp"
+#include "uniform_buffer.hpp"
+#include "vertex_array_cache.hpp"
+#include "vertex_layout.hpp"
+#include "virtual_texture.hpp"
+
+// Residency of a virtual texture over a scripted camera path, in a hidden
+// window so it runs on software GL (LIBGL_ALWAYS_SOFTWARE=1 under Xvfb).
+// A low flight over a textured ground plane streams tiles through a small
+// cache, then the camera holds still until every page it sees is in.
+// Exits with 1 if that never happens or the cache overflows.
+//
+//     virtual_bench [FILE.ktx2]
+//
+// Without a file, a synthetic 4K RGBA8 KTX2 written next to the binary.
+// Run from the repository or build directory, for res/shaders/virtual.glsl.
+
+constexpr int WIDTH = 512;
+constexpr int HEIGHT = 512;
+constexpr int CACHE_SIZE = 12;
+constexpr int FLY_FRAMES = 240;
+constexpr int HOLD_FRAMES = 120;
+
+struct Phase
+{
+	const char *name;
+	int frames;
+	unsigned int loaded;
+	unsigned int evicted;
+	unsigned int max_resident;
+	double missing;
+	double milliseconds;
+};
+
+// Checkers, a grid and gradients, each level the box filtered previous one
+bool write_synthetic(const std::string &path, int size)
+{
+	KtxImage image;
+	image.vk_format = KTX_FORMAT_RGBA8;
+	image.width = image.height = size;
+
+	std::vector<unsigned char> level((size_t)size * size * 4);
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			unsigned char *texel = &level[((size_t)y * size + x) * 4];
+			bool checker = (x / 64 + y / 64) % 2 == 0;
+			bool grid = x % 512 < 4 || y % 512 < 4;
+			texel[0] = grid ? 255 : (unsigned char)(x * 255 / size);
+			texel[1] = grid ? 255 : (unsigned char)(y * 255 / size);
+			texel[2] = grid ? 255 : checker ? 200 : 60;
+			texel[3] = 255;
+		}
+	}
+
+	for (int width = size, height = size;;)
+	{
+		KtxImage::Level entry = {image.data.size(), level.size(), width, height};
+		image.levels.push_back(entry);
+		image.data.insert(image.data.end(), level.begin(), level.end());
+		if (width == 1 && height == 1)
+			break;
+
+		int next_width = std::max(1, width / 2), next_height = std::max(1, height / 2);
+		std::vector<unsigned char> next((size_t)next_width * next_height * 4);
+		for (int y = 0; y < next_height; ++y)
+		{
+			for (int x = 0; x < next_width; ++x)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					int sum = 0;
+					for (int sy = 0; sy < 2; ++sy)
+						for (int sx = 0; sx < 2; ++sx)
+							sum += level[((size_t)std::min(height - 1, y * 2 + sy) * width +
+								      std::min(width - 1, x * 2 + sx)) * 4 + c];
+					next[((size_t)y * next_width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+
+		level.swap(next);
+		width = next_width;
+		height = next_height;
+	}
+
+	return image.write(path);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string path = argc > 1 ? argv[1] : "virtual_bench.ktx2";
+	if (argc == 1 && !write_synthetic(path, 4096))
+	{
+		std::cerr << "Can't write " << path << "\n";
+		return 1;
+	}
+
+	if (!glfwInit())
+	{
+		std::cerr << "Failed to init GLFW" << std::endl;
+		return 1;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	GLFWwindow *window = glfwCreateWindow(WIDTH, HEIGHT, "virtual_bench", NULL, NULL);
+	if (!window)
+	{
+		std::cerr << "Failed to create the window" << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cerr << "Failed to initialize GLAD" << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+
+	bool passed = false;
+	{
+		UniformBuffer camera_buffer("Camera", CAMERA_BINDING, sizeof(CameraBlock));
+
+		ShaderBatch batch;
+		ShaderVariants variants("res/shaders/virtual.glsl");
+		uint32_t feedback_mask = variants.mask({"FEEDBACK"});
+		variants.prewarm({0, feedback_mask}, batch);
+		batch.wait();
+		Shader &shaders = variants.get(0);
+		Shader &feedback_shaders = variants.get(feedback_mask);
+
+		VirtualTexture virtual_texture(CACHE_SIZE);
+		if (!virtual_texture.open(path))
+		{
+			glfwTerminate();
+			return 1;
+		}
+
+		// Ground plane 64 units wide, the texture stretched over it once
+		float vertices[] = {
+			-32.f, 0.f, 32.f, 0.f, 0.f,
+			32.f, 0.f, 32.f, 1.f, 0.f,
+			32.f, 0.f, -32.f, 1.f, 1.f,
+			-32.f, 0.f, -32.f, 0.f, 1.f,
+		};
+		unsigned int indices[] = {0, 1, 2, 0, 2, 3};
+
+		unsigned int buffers[2];
+		glGenBuffers(2, buffers);
+		GLState::bind_buffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		GLState::bind_buffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		VertexLayout layout;
+		layout.add("position", 3).add("texture_coord", 2);
+		VertexArrayCache vertex_arrays;
+		unsigned int vertex_array = vertex_arrays.bind(layout, shaders, buffers[0], buffers[1]);
+		unsigned int feedback_vertex_array = vertex_arrays.bind(layout, feedback_shaders, buffers[0], buffers[1]);
+
+		for (Shader *program : {&shaders, &feedback_shaders})
+		{
+			program->use();
+			virtual_texture.set_uniforms(*program, 0, 1);
+		}
+		UniformHandle u_model = shaders.uniform("u_model");
+		UniformHandle u_feedback_model = feedback_shaders.uniform("u_model");
+
+		GLState::enable(GL_DEPTH_TEST);
+		glm::mat4 model(1.f);
+
+		Phase phases[] = {
+			{"fly", FLY_FRAMES, 0, 0, 0, 0., 0.},
+			{"hold", HOLD_FRAMES, 0, 0, 0, 0., 0.},
+		};
+		int converged = -1;
+		unsigned int overflows = 0;
+		for (Phase &phase : phases)
+		{
+			unsigned int loaded = virtual_texture.get_stats().loaded;
+			unsigned int evicted = virtual_texture.get_stats().evicted;
+			auto start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < phase.frames; ++frame)
+			{
+				// Low over the plane along its length, then still
+				float t = &phase == &phases[0] ? (float)frame / FLY_FRAMES : 1.f;
+				glm::vec3 eye(-8.f + 16.f * t, 1.5f, 28.f - 56.f * t);
+				CameraBlock camera;
+				camera.view = glm::lookAt(eye, eye + glm::vec3(0.f, -0.6f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+				camera.projection = glm::perspective(glm::radians(60.f), (float)WIDTH / HEIGHT, 0.1f, 100.f);
+				camera.view_projection = camera.projection * camera.view;
+				camera_buffer.update(&camera);
+
+				virtual_texture.update();
+				virtual_texture.begin_feedback(WIDTH, HEIGHT);
+				feedback_shaders.use();
+				feedback_shaders.set_mat4(u_feedback_model, model);
+				GLState::bind_vertex_array(feedback_vertex_array);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				virtual_texture.end_feedback();
+
+				glClearColor(0.f, 0.f, 0.f, 1.f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				shaders.use();
+				shaders.set_mat4(u_model, model);
+				GLState::bind_texture(0, GL_TEXTURE_2D, virtual_texture.get_page_table());
+				GLState::bind_texture(1, GL_TEXTURE_2D, virtual_texture.get_cache());
+				GLState::bind_vertex_array(vertex_array);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+				camera_buffer.end_frame();
+				GLState::end_frame();
+				glfwSwapBuffers(window);
+
+				const VirtualTexture::Stats &stats = virtual_texture.get_stats();
+				phase.max_resident = std::max(phase.max_resident, stats.resident);
+				phase.missing += stats.missing;
+				if (stats.resident > stats.capacity)
+					++overflows;
+				if (&phase == &phases[1] && converged < 0 && stats.requested > 0 && stats.missing == 0)
+					converged = frame;
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			phase.loaded = virtual_texture.get_stats().loaded - loaded;
+			phase.evicted = virtual_texture.get_stats().evicted - evicted;
+			phase.missing /= phase.frames;
+			phase.milliseconds = std::chrono::duration<double, std::milli>(end - start).count() / phase.frames;
+		}
+
+		const VirtualTexture::Stats &stats = virtual_texture.get_stats();
+		std::cout << virtual_texture.get_width() << "x" << virtual_texture.get_height() << ", " << stats.capacity
+			  << " tile cache, " << glGetString(GL_RENDERER) << "\n";
+		std::cout << "phase\tframes\tloaded\tevicted\tmax resident\tmean missing\tms/frame\n";
+		std::cout << std::fixed << std::setprecision(1);
+		for (const Phase &phase : phases)
+			std::cout << phase.name << "\t" << phase.frames << "\t" << phase.loaded << "\t" << phase.evicted << "\t"
+				  << phase.max_resident << "\t" << phase.missing << "\t" << phase.milliseconds << "\n";
+
+		if (converged >= 0)
+			std::cout << "Every page resident " << converged << " frames into the hold\n";
+		else
+			std::cerr << "Still " << stats.missing << " pages missing after the hold\n";
+		if (overflows)
+			std::cerr << "More tiles resident than the cache holds in " << overflows << " frames\n";
+
+		passed = converged >= 0 && overflows == 0;
+		vertex_arrays.clear();
+		GLState::delete_buffer(buffers[0]);
+		GLState::delete_buffer(buffers[1]);
+	}
+
+	if (argc == 1)
+		std::remove(path.c_str());
+
+	glfwTerminate();
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// GL_EXT_texture_compression_s3tc, not part of the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Their sRGB variants, from GL_EXT_texture_sRGB
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// CPU encoders and decoders of the 4x4 block formats. Pixels are always
+// RGBA8, formats with fewer channels ignore the others on encode and
+// decode them as 0 for color and 255 for alpha.
+//
+// The ETC2 encoder only emits the ETC1 individual and differential modes,
+// which ETC2 decodes the same way. The decoder handles every ETC2 RGB mode.
+enum class BlockFormat
+{
+        BC1,
+        BC3,
+        BC5,
+        ETC2_RGB,
+};
+
+// Bytes of a 4x4 block, 8 or 16
+size_t block_size(BlockFormat format);
+size_t compressed_size(BlockFormat format, int width, int height);
+
+// Channels that survive the round trip, for PSNR: 3, 4 or 2
+int block_channels(BlockFormat format);
+
+const char *block_format_name(BlockFormat format);
+bool parse_block_format(const char *name, BlockFormat &format);
+
+// srgb picks the format decoding color through the sRGB curve, BC5 has
+// none and ignores it
+GLenum block_gl_format(BlockFormat format, bool srgb = false);
+
+// VkFormat values, as stored in KTX2 files
+uint32_t block_vk_format(BlockFormat format, bool srgb = false);
+bool block_format_from_vk(uint32_t vk_format, BlockFormat &format, bool *srgb = nullptr);
+
+void compress_blocks(BlockFormat format, const unsigned char *rgba, int width,
+                     int height, unsigned char *out);
+void decompress_blocks(BlockFormat format, const unsigned char *blocks, int width,
+                       int height, unsigned char *rgba);
+
+// Over the first channels of two RGBA8 images, infinite when identical
+double psnr(const unsigned char *a, const unsigned char *b, int width, int height,
+            int channels);
+
+#endif /* BLOCK_COMPRESSION_H */
@@ -0,0 +1,117 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Shadow copy of the GL state the renderer touches. Binds and state changes
+// that would not change anything are dropped before reaching the driver and
+// counted. Everything starts unknown, so the first call always goes through.
+// Objects must be deleted through here so a recycled name is not mistaken
+// for a binding that is still current.
+class GLState
+{
+public:
+        struct Stats
+        {
+                unsigned int issued;
+                unsigned int eliminated;
+        };
+
+        static constexpr unsigned int TEXTURE_UNITS = 32;
+
+private:
+        enum BufferTarget
+        {
+                ARRAY_BUFFER,
+                ELEMENT_ARRAY_BUFFER,
+                UNIFORM_BUFFER,
+                PIXEL_PACK_BUFFER,
+                PIXEL_UNPACK_BUFFER,
+                BUFFER_TARGET_COUNT,
+        };
+
+        enum TextureTarget
+        {
+                TEXTURE_2D,
+                TEXTURE_2D_ARRAY,
+                TEXTURE_TARGET_COUNT,
+        };
+
+        enum FramebufferTarget
+        {
+                READ_FRAMEBUFFER,
+                DRAW_FRAMEBUFFER,
+                FRAMEBUFFER_TARGET_COUNT,
+        };
+
+        enum Capability
+        {
+                DEPTH_TEST,
+                BLEND,
+                CULL_FACE,
+                SCISSOR_TEST,
+                CAPABILITY_COUNT,
+        };
+
+        static unsigned int program;
+        static unsigned int vertex_array;
+        static unsigned int buffers[BUFFER_TARGET_COUNT];
+        static unsigned int active_unit;
+        static unsigned int textures[TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+        static unsigned int framebuffers[FRAMEBUFFER_TARGET_COUNT];
+        static int capabilities[CAPABILITY_COUNT];
+        static GLenum blend_factors[2];
+        static GLenum depth_function;
+        static int viewport_rect[4];
+
+        static Stats frame;
+        static Stats last_frame;
+
+public:
+        GLState() = delete;
+
+        static void use_program(unsigned int id);
+        static void bind_vertex_array(unsigned int id);
+        static void bind_buffer(GLenum target, unsigned int id);
+        static void bind_buffer_range(GLenum target, unsigned int index,
+                                      unsigned int id, GLintptr offset,
+                                      GLsizeiptr size);
+
+        // unit is an index, not GL_TEXTURE0 + index
+        static void active_texture(unsigned int unit);
+        static void bind_texture(GLenum target, unsigned int id);
+        static void bind_texture(unsigned int unit, GLenum target, unsigned int id);
+
+        // GL_FRAMEBUFFER binds both the read and the draw framebuffer
+        static void bind_framebuffer(GLenum target, unsigned int id);
+
+        static void enable(GLenum capability);
+        static void disable(GLenum capability);
+        static void blend_func(GLenum source, GLenum destination);
+        static void depth_func(GLenum function);
+        static void viewport(int x, int y, int width, int height);
+
+        // Largest GL_UNPACK_ALIGNMENT tightly packed rows of row_bytes
+        // satisfy, 4 being GL's default
+        static int unpack_alignment(size_t row_bytes);
+
+        static void delete_program(unsigned int id);
+        static void delete_vertex_array(unsigned int id);
+        static void delete_buffer(unsigned int id);
+        static void delete_texture(unsigned int id);
+        static void delete_framebuffer(unsigned int id);
+
+        // After GL calls made behind the tracker's back
+        static void invalidate();
+
+        static void end_frame();
+        static const Stats &frame_stats();
+
+private:
+        static bool changed(unsigned int &cached, unsigned int value);
+        static void set_capability(GLenum capability, bool enabled);
+};
+
+#endif /* GL_STATE_H */
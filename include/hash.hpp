@@ -0,0 +1,37 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a, used for every name / source / content key in the renderer.
+constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+inline uint64_t hash_bytes(const void *data, size_t size,
+                           uint64_t seed = FNV_OFFSET)
+{
+        const unsigned char *bytes = (const unsigned char *)data;
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; ++i)
+        {
+                hash ^= bytes[i];
+                hash *= FNV_PRIME;
+        }
+
+        return hash;
+}
+
+inline uint64_t hash_string(const char *str, uint64_t seed = FNV_OFFSET)
+{
+        uint64_t hash = seed;
+        while (*str)
+        {
+                hash ^= (unsigned char)*str++;
+                hash *= FNV_PRIME;
+        }
+
+        return hash;
+}
+
+#endif /* HASH_H */
@@ -0,0 +1,34 @@
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <cstddef>
+
+// Scratch memory of stb_image, src/stb_image.cpp routes STBI_MALLOC,
+// STBI_REALLOC and STBI_FREE here. While a Scope lives on a thread, the
+// decoder's allocations on that thread are bumped out of memory kept from
+// earlier scopes, frees do nothing and everything is taken back when the
+// Scope ends. Outside of one they are plain malloc and free, so only loads
+// whose result stays inside the scope (stbi_load_from_memory_into) should
+// run in one.
+class ImageArena
+{
+public:
+        class Scope
+        {
+        public:
+                Scope();
+                ~Scope();
+
+                Scope(const Scope &) = delete;
+                Scope &operator=(const Scope &) = delete;
+        };
+
+        static void *allocate(size_t size);
+        static void *reallocate(void *block, size_t size);
+        static void release(void *block);
+
+        // Bytes the calling thread keeps for its next scope
+        static size_t retained();
+};
+
+#endif /* IMAGE_ARENA_H */
@@ -0,0 +1,92 @@
+#ifndef IMAGE_SOURCE_H
+#define IMAGE_SOURCE_H
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A tar archive mapped once and shared by every image read from it. Only
+// regular files are indexed, by their path inside the archive (ustar
+// prefixes and GNU long names included).
+class ImageArchive
+{
+private:
+        struct Entry
+        {
+                size_t offset;
+                size_t size;
+        };
+
+        MappedFile file;
+        std::unordered_map<std::string, Entry> entries;
+
+        bool index();
+
+public:
+        ImageArchive();
+
+        ImageArchive(const ImageArchive &) = delete;
+        ImageArchive &operator=(const ImageArchive &) = delete;
+
+        bool open(const std::string &filepath);
+
+        // The open archive at filepath, mapped on the first call and shared
+        // until the last user is gone. Null if it can't be read.
+        static std::shared_ptr<const ImageArchive> get(const std::string &filepath);
+
+        bool find(const std::string &name, const unsigned char *&data, size_t &size) const;
+        std::vector<std::string> names() const;
+
+        const MappedFile &get_file() const;
+};
+
+// Encoded bytes of an image, decoded with stbi_load_from_memory instead of
+// reading through stdio. "DIR/NAME.tar/ENTRY" paths read ENTRY out of the
+// archive, any other path maps the file of its own.
+class ImageSource
+{
+private:
+        MappedFile file;
+        std::shared_ptr<const ImageArchive> archive;
+        const unsigned char *bytes;
+        size_t length;
+
+public:
+        ImageSource();
+        explicit ImageSource(const std::string &filepath);
+
+        ImageSource(const ImageSource &) = delete;
+        ImageSource &operator=(const ImageSource &) = delete;
+
+        bool open(const std::string &filepath);
+        void close();
+
+        bool is_open() const;
+        const unsigned char *data() const;
+        size_t size() const;
+
+        // Same as stbi_info and stbi_load, flip is per call so loads on
+        // other threads are free to ask otherwise. JPEGs decode at
+        // 1 / scale of their size for a scale of 2, 4 or 8, see
+        // scaled_size().
+        bool info(int *width, int *height, int *channels) const;
+        unsigned char *load(int *width, int *height, int *channels, int desired_channels, bool flip = false,
+                            int scale = 1) const;
+
+        // Decodes into the caller's memory with rows stride bytes apart,
+        // stb_image's scratch memory coming from the thread's ImageArena.
+        // desired_channels can't be 0, see stbi_load_from_memory_into.
+        bool load_into(unsigned char *dest, int stride, size_t size, int *width, int *height, int *channels,
+                       int desired_channels, bool flip = false, int scale = 1) const;
+
+        bool is_jpeg() const;
+
+        // Side of a JPEG decoded at scale, other formats ignore it
+        static int scaled_size(int size, int scale);
+};
+
+#endif /* IMAGE_SOURCE_H */
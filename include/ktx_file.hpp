@@ -0,0 +1,50 @@
+#ifndef KTX_FILE_H
+#define KTX_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The subset of KTX2 written by tools/texture_compressor: one 2D image
+// with its mip chain, no supercompression and no data format descriptor
+// (so strict KTX2 readers will refuse it). Level 0 is the full size one.
+//
+// Block formats are listed in block_compression.hpp, uncompressed levels
+// are RGBA8 with the formats below.
+constexpr uint32_t KTX_FORMAT_RGBA8 = 37;      // VK_FORMAT_R8G8B8A8_UNORM
+constexpr uint32_t KTX_FORMAT_RGBA8_SRGB = 43; // VK_FORMAT_R8G8B8A8_SRGB
+
+struct KtxImage
+{
+        struct Level
+        {
+                size_t offset;
+                size_t size;
+                int width;
+                int height;
+        };
+
+        uint32_t vk_format;
+        int width;
+        int height;
+        std::vector<Level> levels;
+
+        // Every level, at the offsets above
+        std::vector<unsigned char> data;
+
+        KtxImage();
+
+        // Fails unless every level holds exactly the bytes of its format
+        // and size, and the chain stops at 1x1
+        bool read(const unsigned char *bytes, size_t size);
+
+        // Only the header and the level index: offsets are into bytes and
+        // data is left empty, for reading parts of levels in place
+        bool read_index(const unsigned char *bytes, size_t size);
+        bool write(const std::string &filepath) const;
+
+        static bool is_ktx(const unsigned char *bytes, size_t size);
+};
+
+#endif /* KTX_FILE_H */
@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file, memory mapped where the platform allows
+// it and read into memory otherwise.
+class MappedFile
+{
+private:
+        const unsigned char *bytes;
+        size_t length;
+        bool opened;
+        bool mapped;
+        std::vector<unsigned char> buffer;
+
+public:
+        MappedFile();
+        explicit MappedFile(const std::string &filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool open(const std::string &filepath);
+        void close();
+
+        bool is_open() const;
+        const unsigned char *data() const;
+        size_t size() const;
+
+        // Tells the kernel a range is about to be read front to back, so it
+        // reads ahead instead of faulting page by page. Does nothing when
+        // the file was read into memory.
+        void advise_sequential(size_t offset, size_t size) const;
+};
+
+// Absolute path with symlinks and "." / ".." resolved, the path unchanged
+// if it can't be resolved
+std::string canonical_path(const std::string &path);
+
+#endif /* MAPPED_FILE_H */
@@ -0,0 +1,55 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <vector>
+
+// Builds the mip chain of an RGBA8 image on the CPU, for tools that bake
+// it next to the image instead of leaving it to glGenerateMipmap. Levels
+// are filtered in linear float from the previous one, color channels are
+// converted from and back to sRGB unless told otherwise, alpha is always
+// linear. Rows of each level are split across threads.
+//
+// Every kernel gives the same bytes: they add the same products in the
+// same order, and the file is built without contracting them into FMAs.
+enum class MipFilter
+{
+        BOX,    // 2x2 average
+        KAISER, // 8 tap Kaiser windowed sinc, sharper
+};
+
+enum class MipKernel
+{
+        AUTO, // Best one the CPU supports
+        SCALAR,
+        SSE2,
+        AVX2,
+};
+
+struct MipOptions
+{
+        MipFilter filter;
+        bool srgb;
+        unsigned int threads; // 0 for one per core
+        MipKernel kernel;
+
+        MipOptions();
+};
+
+struct MipLevel
+{
+        int width;
+        int height;
+        std::vector<unsigned char> pixels; // RGBA8
+};
+
+// Level 0 is a copy of the image, the last one is 1x1
+std::vector<MipLevel> generate_mips(const unsigned char *rgba, int width, int height,
+                                    const MipOptions &options = MipOptions());
+
+bool mip_kernel_supported(MipKernel kernel);
+const char *mip_kernel_name(MipKernel kernel);
+
+const char *mip_filter_name(MipFilter filter);
+bool parse_mip_filter(const char *name, MipFilter &filter);
+
+#endif /* MIP_GENERATOR_H */
@@ -0,0 +1,35 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "shader_source.hpp"
+
+// Persistent cache of linked program binaries (glGetProgramBinary).
+// Entries are keyed by the stage sources and the GL vendor, renderer and
+// version strings, so a driver update simply misses the cache.
+class ProgramCache
+{
+private:
+        std::string directory;
+        uint64_t driver_hash;
+        bool enabled;
+
+public:
+        ProgramCache() = delete;
+
+        explicit ProgramCache(const std::string &directory);
+
+        bool is_enabled() const;
+
+        uint64_t key(const ShaderSource &source) const;
+
+        bool load(uint64_t key, unsigned int program) const;
+        void store(uint64_t key, unsigned int program) const;
+
+private:
+        std::string entry_path(uint64_t key) const;
+};
+
+#endif /* PROGRAM_CACHE_H */
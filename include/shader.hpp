@@ -3,46 +3,121 @@
 
 #include <glad/glad.h>
 #include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+#include <chrono>
 #include <string>
 
+#include "program_cache.hpp"
+#include "shader_source.hpp"
+#include "uniform_table.hpp"
+#include "vertex_layout.hpp"
+
+// GL_KHR_parallel_shader_compile, not part of the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 class Shader
 {
-private:
-        unsigned int program_id;
-        std::string vertex_shader;
-        std::string fragment_shader;
-        bool is_bound;
-
 public:
         enum Type
         {
                 NONE = -1,
-                VERTEX,
-                FRAGMENT,
+                VERTEX = ShaderSource::VERTEX,
+                FRAGMENT = ShaderSource::FRAGMENT,
+                GEOMETRY = ShaderSource::GEOMETRY,
+                COMPUTE = ShaderSource::COMPUTE,
+        };
+
+        enum Status
+        {
+                PENDING,
+                READY,
+                FAILED,
+        };
+
+        // Tag for the constructors that submit the program to the driver
+        // and return without waiting for the compile and link to finish
+        struct Deferred
+        {
         };
 
+private:
+        unsigned int program_id;
+        std::string name;
+        std::string filepath;
+        uint32_t variant;
+        ShaderSource source;
+        UniformTable uniforms;
+        VertexInterface attributes;
+
+        Status status;
+        unsigned int stage_ids[ShaderSource::STAGE_COUNT];
+        uint64_t cache_key;
+        std::chrono::steady_clock::time_point submit_time;
+
+        static const ProgramCache *cache;
+        static bool completion_query;
+
+        friend class ShaderBatch;
+
+public:
         Shader() = delete;
 
         explicit Shader(const std::string &filepath);
         Shader(const std::string &vertex, const std::string &fragment);
         Shader(const std::string &str, Type);
 
+        Shader(const std::string &filepath, Deferred);
+        Shader(const std::string &vertex, const std::string &fragment, Deferred);
+        Shader(const std::string &filepath, const ShaderSource &source,
+               uint32_t variant, Deferred);
+
         void use();
 
         unsigned int get_program_id() const;
+        const std::string &get_name() const;
+        const std::string &get_filepath() const;
+        uint32_t get_variant() const;
+        const ShaderSource &get_source() const;
+        const VertexInterface &get_attributes() const;
+
+        Status get_status() const;
+        Status poll();
+        void wait();
+
+        // Relinks from new sources, keeping the current program if that
+        // fails. Uniform values and handles must be set up again after.
+        bool reload(const ShaderSource &new_source);
+
+        static void set_program_cache(const ProgramCache *program_cache);
 
         void set_bool(const std::string &name, bool val) const;
         void set_int(const std::string &name, int val) const;
         void set_float(const std::string &name, float val) const;
+        void set_vec4(const std::string &name, const glm::vec4 &val) const;
         void set_mat4(const std::string &name, const glm::mat4 &val) const;
 
+        UniformHandle uniform(const std::string &name) const;
+
+        void set_bool(UniformHandle uniform, bool val) const;
+        void set_int(UniformHandle uniform, int val) const;
+        void set_float(UniformHandle uniform, float val) const;
+        void set_vec4(UniformHandle uniform, const glm::vec4 &val) const;
+        void set_mat4(UniformHandle uniform, const glm::mat4 &val) const;
+
 private:
         void parse_shader(const char *filepath);
 
         unsigned int compile_shader(unsigned int type,
                                     const std::string &source) const;
+        void check_shader(unsigned int id, ShaderSource::Stage stage) const;
 
         void create_shaders();
+        void link_shaders();
+        void link_compute();
+        void finish_shaders();
+        void report(bool warm) const;
 };
 
 #endif /* SHADER_H */
@@ -0,0 +1,30 @@
+#ifndef SHADER_BATCH_H
+#define SHADER_BATCH_H
+
+#include <vector>
+
+#include "shader.hpp"
+
+// Tracks programs submitted with Shader::Deferred. Everything is handed to
+// the driver up front and completion is only queried from poll(), which
+// lets GL_KHR_parallel_shader_compile spread the work over the driver's
+// compiler threads.
+class ShaderBatch
+{
+private:
+        std::vector<Shader *> pending;
+        bool parallel;
+
+public:
+        ShaderBatch();
+
+        void add(Shader &shader);
+
+        unsigned int poll();
+        void wait();
+
+        unsigned int pending_count() const;
+        bool is_parallel() const;
+};
+
+#endif /* SHADER_BATCH_H */
@@ -0,0 +1,20 @@
+#ifndef SHADER_BUNDLE_H
+#define SHADER_BUNDLE_H
+
+#include "shader_source.hpp"
+
+#include <cstdint>
+
+// A shader file preprocessed at build time by tools/shader_bundler: stages
+// split, includes resolved, comments and whitespace stripped. The generated
+// shader_bundle_data.hpp holds one per file of res/shaders, keyed by the
+// FNV-1a hash of the path the program is loaded with.
+struct BundledShader
+{
+        const char *path;
+        uint64_t path_hash;
+        const char *keywords;
+        const char *stages[ShaderSource::STAGE_COUNT];
+};
+
+#endif /* SHADER_BUNDLE_H */
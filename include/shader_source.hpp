@@ -0,0 +1,48 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stage sources of a program file split on its "#shader <stage>" markers.
+// '#include "file"' lines are replaced by the file contents, resolved
+// relatively to the including file. Included files are preprocessed once
+// per process and shared by every program that includes them.
+//
+// "#keywords A B ..." declares the feature keywords of the file. A variant
+// is selected by a mask, bit i defining keywords[i] in every stage.
+struct ShaderSource
+{
+        enum Stage
+        {
+                VERTEX,
+                FRAGMENT,
+                GEOMETRY,
+                COMPUTE,
+                STAGE_COUNT,
+        };
+
+        std::string stages[STAGE_COUNT];
+
+        // Every included file, for the hot-reload watcher
+        std::vector<std::string> includes;
+
+        std::vector<std::string> keywords;
+
+        bool parse(const std::string &filepath);
+
+        // The copy baked in by tools/shader_bundler in EMBED_SHADERS builds,
+        // parse() otherwise or for files missing from the bundle
+        bool load(const std::string &filepath);
+        bool empty() const;
+
+        ShaderSource variant(uint32_t mask) const;
+
+        static const char *stage_name(Stage stage);
+
+        // Drops a changed file from the include cache
+        static void invalidate(const std::string &filepath);
+};
+
+#endif /* SHADER_SOURCE_H */
@@ -0,0 +1,41 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader.hpp"
+#include "shader_batch.hpp"
+
+// Every variant of a shader file declaring "#keywords". The file is parsed
+// once, a variant is only compiled the first time it is asked for and
+// stays cached, keyed by its keyword mask.
+class ShaderVariants
+{
+private:
+        std::string filepath;
+        ShaderSource source;
+        std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+
+public:
+        ShaderVariants() = delete;
+
+        explicit ShaderVariants(const std::string &filepath);
+
+        const std::vector<std::string> &keywords() const;
+
+        uint32_t mask(const std::vector<std::string> &keywords) const;
+
+        // Submits the variant on first use, use() waits for it
+        Shader &get(uint32_t mask);
+
+        // Submits every listed variant at once to compile them in parallel
+        void prewarm(const std::vector<uint32_t> &masks, ShaderBatch &batch);
+
+        unsigned int size() const;
+};
+
+#endif /* SHADER_VARIANTS_H */
@@ -0,0 +1,60 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shader.hpp"
+
+// Watches the files of the given shaders, and the files they include, with
+// inotify. Changed programs are parsed again on a background thread,
+// apply() relinks them on the render thread and costs a single atomic load
+// while nothing changed. Does nothing on platforms without inotify.
+class ShaderWatcher
+{
+private:
+        struct Watch
+        {
+                Shader *shader;
+                int descriptor;
+                std::string path;
+                std::string filename;
+        };
+
+        struct Reload
+        {
+                Shader *shader;
+                ShaderSource source;
+        };
+
+        int inotify_fd;
+        int wake_fds[2];
+        std::thread thread;
+
+        std::mutex mutex;
+        std::vector<Watch> watches;
+        std::vector<Reload> reloads;
+        std::atomic<bool> has_reloads;
+
+public:
+        ShaderWatcher();
+        ~ShaderWatcher();
+
+        ShaderWatcher(const ShaderWatcher &) = delete;
+        ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+        void watch(Shader &shader);
+
+        unsigned int apply();
+
+private:
+        void add_watch(Shader *shader, const std::string &path);
+
+        void run();
+        void changed(int descriptor, const char *filename);
+};
+
+#endif /* SHADER_WATCHER_H */
@@ -0,0 +1,46 @@
+#ifndef SKYLINE_PACKER_H
+#define SKYLINE_PACKER_H
+
+#include <cstddef>
+#include <vector>
+
+// Rectangles packed into a fixed size bin along its skyline, the top edge
+// of everything placed so far kept as a list of segments. A rectangle goes
+// where its top ends lowest, ties going to the narrowest segment
+// (bottom-left). Space hidden under an overhang is never reused, which
+// costs little when rectangles come in decreasing height.
+class SkylinePacker
+{
+private:
+        struct Segment
+        {
+                int x;
+                int y;
+                int width;
+        };
+
+        int width;
+        int height;
+        std::vector<Segment> skyline;
+        size_t used_area;
+
+        int fit(size_t index, int rect_width, int rect_height) const;
+        void place(size_t index, int x, int y, int rect_width, int rect_height);
+
+public:
+        SkylinePacker(int width, int height);
+
+        void clear();
+
+        // Bottom left corner of a free rect_width x rect_height area,
+        // false if there's none left
+        bool insert(int rect_width, int rect_height, int &x, int &y);
+
+        int get_width() const;
+        int get_height() const;
+
+        // Part of the bin covered by rectangles
+        float occupancy() const;
+};
+
+#endif /* SKYLINE_PACKER_H */
@@ -0,0 +1,44 @@
+#ifndef STAGING_BUFFER_H
+#define STAGING_BUFFER_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+// Pixel unpack buffer mapped once for good (glBufferStorage, GL 4.4 or
+// ARB_buffer_storage) and handed out in ranges, so decoders on other
+// threads write texels straight into memory the driver uploads from.
+// allocate() and release() are thread safe, the rest is for the GL thread.
+// A range must only be released once the uploads reading it are done.
+class StagingBuffer
+{
+private:
+        unsigned int buffer_id;
+        unsigned char *memory;
+        size_t capacity;
+
+        // Offset to size of the free ranges, merged with their neighbours
+        std::mutex mutex;
+        std::map<size_t, size_t> free_ranges;
+
+public:
+        static constexpr size_t npos = (size_t)-1;
+
+        // Needs glBufferStorage, is_mapped() tells whether it was there
+        explicit StagingBuffer(size_t size);
+        ~StagingBuffer();
+
+        StagingBuffer(const StagingBuffer &) = delete;
+        StagingBuffer &operator=(const StagingBuffer &) = delete;
+
+        bool is_mapped() const;
+        unsigned int get_buffer() const;
+
+        // First fit, npos if no free range is large enough
+        size_t allocate(size_t size);
+        void release(size_t offset, size_t size);
+
+        unsigned char *data(size_t offset) const;
+};
+
+#endif /* STAGING_BUFFER_H */
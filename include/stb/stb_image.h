@@ -233,6 +233,11 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// On top of SSE2, the JPEG IDCT, YCbCr->RGB conversion and 2x2 chroma
+// upsampling have AVX2 versions, compiled with function target attributes
+// and picked by CPUID at decode time. Define STBI_NO_AVX2 to leave them
+// out. stbi_set_simd_kernel() forces a given level, for benchmarks.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -475,6 +480,50 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// per-call versions of the three switches above, for decoding on several
+// threads at once. they replace the global and thread-local settings for
+// that one call; zeroed, nothing is flipped or converted. JPEG and PNG
+// write their rows bottom-up when flipping, other formats are flipped
+// after decoding
+//
+// jpeg_scale_denom 2, 4 or 8 decodes JPEGs at that fraction of their size
+// (rounded up, so stbi_info's w x h becomes (w+d-1)/d x (h+d-1)/d) with a
+// reduced size IDCT, never building the full image. other values, and
+// other formats, decode at full size
+typedef struct
+{
+   int flip_vertically;
+   int unpremultiply;
+   int convert_iphone_png_to_rgb;
+   int jpeg_scale_denom;
+} stbi_load_options;
+
+STBIDEF stbi_uc *stbi_load_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_ex(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+#endif
+
+// decodes into memory of the caller's, such as a mapped pixel buffer, with
+// rows dest_stride bytes apart. desired_channels can't be 0 here, and the
+// image must fit in dest_size bytes (check with stbi_info first). JPEG
+// rows are written straight to dest, and never read back, other formats
+// are decoded as usual and copied. returns 1 on success
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, int dest_stride, size_t dest_size, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+
+// kernel levels for the JPEG decoder's SIMD paths. AUTO picks the best one
+// the CPU supports, a level the CPU or build lacks falls back the same way.
+// global, so don't change it while other threads decode
+enum
+{
+   STBI_KERNEL_AUTO,
+   STBI_KERNEL_SCALAR,
+   STBI_KERNEL_SSE2,
+   STBI_KERNEL_AVX2
+};
+
+STBIDEF void stbi_set_simd_kernel(int kernel);
+STBIDEF int  stbi_simd_kernel_supported(int kernel);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -485,6 +534,11 @@ STBIDEF int   stbi_zlib_decode_buffer(char *obuffer, int olen, const char *ibuff
 STBIDEF char *stbi_zlib_decode_noheader_malloc(const char *buffer, int len, int *outlen);
 STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen);
 
+// by default compressed blocks are inflated from a 64-bit bit buffer with
+// tables that can resolve two literals per lookup. 0 switches back to the
+// original decoder, which gives the same bytes. global, like the above
+STBIDEF void  stbi_set_fast_inflate(int flag_true_if_fast);
+
 
 #ifdef __cplusplus
 }
@@ -596,6 +650,12 @@ typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
 #endif
 
+#ifdef _MSC_VER
+typedef unsigned __int64 stbi__uint64;
+#else
+typedef uint64_t stbi__uint64;
+#endif
+
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 
@@ -719,6 +779,40 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are built with target attributes on GCC/Clang, so the rest
+// of the file doesn't need -mavx2, and only run where CPUID reports them
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG) && \
+    (defined(_MSC_VER) && _MSC_VER >= 1700 || defined(__clang__) || \
+     defined(__GNUC__) && (__GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return 0;
+
+   // the OS must save the ymm registers too
+   __cpuid(info, 1);
+   if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+      return 0;
+
+   __cpuidex(info, 7, 0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -754,6 +848,12 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi_load_options const *options; // NULL: the global settings
+
+   stbi_uc *dest; // stbi_load_from_memory_into, NULL otherwise
+   int dest_stride;
+   size_t dest_size;
 } stbi__context;
 
 
@@ -762,6 +862,8 @@ static void stbi__refill_buffer(stbi__context *s);
 // initialize a memory-decode context
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
+   s->options = NULL;
+   s->dest = NULL;
    s->io.read = NULL;
    s->read_from_callbacks = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
@@ -771,6 +873,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 // initialize a callback-based context
 static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *user)
 {
+   s->options = NULL;
+   s->dest = NULL;
    s->io = *c;
    s->io_user_data = user;
    s->buflen = sizeof(s->buffer_start);
@@ -833,6 +937,7 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int flipped; // rows already written bottom-up
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -916,6 +1021,13 @@ static void *stbi__malloc(size_t size)
     return STBI_MALLOC(size);
 }
 
+// whether w x h pixels of n bytes fit the caller's destination
+static int stbi__dest_fits(stbi__context *s, int w, int h, int n)
+{
+   if (s->dest_stride < 0 || (size_t) w * n > (size_t) s->dest_stride) return 0;
+   return h == 0 || (size_t) (h - 1) * s->dest_stride + (size_t) w * n <= s->dest_size;
+}
+
 // stb_image uses ints pervasively, including for offset calculations.
 // therefore the largest decoded image size we can support with the
 // current code, even on 64-bit targets, is INT_MAX. this is not a
@@ -1046,6 +1158,8 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+#define stbi__flip_on_load(s)  ((s)->options ? (s)->options->flip_vertically : stbi__vertically_flip_on_load)
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1179,7 +1293,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__flip_on_load(s) && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1204,7 +1318,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__flip_on_load(s) && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1275,6 +1389,19 @@ STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int
    return result;
 }
 
+STBIDEF stbi_uc *stbi_load_ex(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   unsigned char *result;
+   stbi__context s;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   s.options = options;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
 STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    unsigned char *result;
@@ -1335,6 +1462,41 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.options = options;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, int dest_stride, size_t dest_size, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   stbi__context s;
+   stbi_uc *result;
+   int row;
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+
+   stbi__start_mem(&s,buffer,len);
+   s.options = options;
+   s.dest = dest;
+   s.dest_stride = dest_stride;
+   s.dest_size = dest_size;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   if (result == NULL) return 0;
+   if (result == dest) return 1;
+
+   // decoded into a buffer of its own, flipped already if asked
+   if (!stbi__dest_fits(&s, *x, *y, req_comp)) {
+      STBI_FREE(result);
+      return stbi__err("too large", "Destination too small");
+   }
+   for (row=0; row < *y; ++row)
+      memcpy(dest + (size_t) row * dest_stride, result + (size_t) row * *x * req_comp, (size_t) *x * req_comp);
+   STBI_FREE(result);
+   return 1;
+}
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1868,6 +2030,8 @@ typedef struct
       int dc_pred;
 
       int x,y,w2,h2;
+      int bs; // pixels per block side, below 8 for a scaled decode
+      void (*idct)(stbi_uc *out, int out_stride, short data[64]);
       stbi_uc *data;
       void *raw_data, *raw_coeff;
       stbi_uc *linebuf;
@@ -1893,6 +2057,8 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   int idct_size; // 8 / jpeg_scale_denom, the block size of full resolution components
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2408,6 +2574,91 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced size IDCTs for scaled decodes, derived from jidctred. they take
+// the full 8x8 coefficients and give the 4x4, 2x2 or 1x1 pixels an 8x8
+// IDCT followed by a box filter would, to within rounding, at a fraction
+// of the cost. rows and columns past the output size are never read
+#define stbi__descale(x,n)  (((x) + (1 << ((n)-1))) >> (n))
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,t0,t2,t10,t12,val[32],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, 4 doesn't contribute to a 4 point output
+   for (i=0; i < 8; ++i,++d,++v) {
+      if (i == 4) continue;
+      if (d[8]==0 && d[16]==0 && d[24]==0 && d[40]==0 && d[48]==0 && d[56]==0) {
+         v[0] = v[8] = v[16] = v[24] = d[0]*4;
+         continue;
+      }
+      t0  = d[0] * (1 << 13);
+      t2  = d[16]*stbi__f2f(1.847759065f) - d[48]*stbi__f2f(0.765366865f);
+      t10 = t0 + t2;
+      t12 = t0 - t2;
+      t0  = d[56]*stbi__f2f(-0.211164243f) + d[40]*stbi__f2f( 1.451774981f)
+          + d[24]*stbi__f2f(-2.172734803f) + d[ 8]*stbi__f2f( 1.061594337f);
+      t2  = d[56]*stbi__f2f(-0.509795579f) + d[40]*stbi__f2f(-0.601344887f)
+          + d[24]*stbi__f2f( 0.899976223f) + d[ 8]*stbi__f2f( 2.562915447f);
+      // keep 2 extra bits, like the 8x8 version
+      v[ 0] = stbi__descale(t10 + t2, 11);
+      v[24] = stbi__descale(t10 - t2, 11);
+      v[ 8] = stbi__descale(t12 + t0, 11);
+      v[16] = stbi__descale(t12 - t0, 11);
+   }
+
+   for (i=0, v=val, o=out; i < 4; ++i,v+=8,o+=out_stride) {
+      t0  = v[0] * (1 << 13);
+      t2  = v[2]*stbi__f2f(1.847759065f) - v[6]*stbi__f2f(0.765366865f);
+      t10 = t0 + t2;
+      t12 = t0 - t2;
+      t0  = v[7]*stbi__f2f(-0.211164243f) + v[5]*stbi__f2f( 1.451774981f)
+          + v[3]*stbi__f2f(-2.172734803f) + v[1]*stbi__f2f( 1.061594337f);
+      t2  = v[7]*stbi__f2f(-0.509795579f) + v[5]*stbi__f2f(-0.601344887f)
+          + v[3]*stbi__f2f( 0.899976223f) + v[1]*stbi__f2f( 2.562915447f);
+      o[0] = stbi__clamp(stbi__descale(t10 + t2, 18) + 128);
+      o[3] = stbi__clamp(stbi__descale(t10 - t2, 18) + 128);
+      o[1] = stbi__clamp(stbi__descale(t12 + t0, 18) + 128);
+      o[2] = stbi__clamp(stbi__descale(t12 - t0, 18) + 128);
+   }
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,t0,t10,val[16],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, the even ones past 0 don't contribute to a 2 point output
+   for (i=0; i < 8; ++i,++d,++v) {
+      if (i == 2 || i == 4 || i == 6) continue;
+      if (d[8]==0 && d[24]==0 && d[40]==0 && d[56]==0) {
+         v[0] = v[8] = d[0]*4;
+         continue;
+      }
+      t10 = d[0] * (1 << 14);
+      t0  = d[56]*stbi__f2f(-0.720959822f) + d[40]*stbi__f2f( 0.850430095f)
+          + d[24]*stbi__f2f(-1.272758580f) + d[ 8]*stbi__f2f( 3.624509785f);
+      v[0] = stbi__descale(t10 + t0, 12);
+      v[8] = stbi__descale(t10 - t0, 12);
+   }
+
+   for (i=0, v=val, o=out; i < 2; ++i,v+=8,o+=out_stride) {
+      t10 = v[0] * (1 << 14);
+      t0  = v[7]*stbi__f2f(-0.720959822f) + v[5]*stbi__f2f( 0.850430095f)
+          + v[3]*stbi__f2f(-1.272758580f) + v[1]*stbi__f2f( 3.624509785f);
+      o[0] = stbi__clamp(stbi__descale(t10 + t0, 19) + 128);
+      o[1] = stbi__clamp(stbi__descale(t10 - t0, 19) + 128);
+   }
+}
+
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(stbi__descale(data[0], 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2589,6 +2840,158 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above: the 32-bit intermediates of all 8
+// columns fit one register instead of a lo/hi pair, the 16-bit rows and
+// transposes stay as they are. bit-identical to the generic C version too.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out0 = c0[even]*x + c0[odd]*y, out1 = c1[even]*x + c1[odd]*y, on all 8 columns
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), \
+                                               _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         /* packs works per 128-bit lane, gather each output's halves */ \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2849,7 +3252,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*j*z->img_comp[n].bs+i*z->img_comp[n].bs, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2873,11 +3276,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*z->img_comp[n].bs;
+                        int y2 = (j*z->img_comp[n].v + y)*z->img_comp[n].bs;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -2974,7 +3377,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*j*z->img_comp[n].bs+i*z->img_comp[n].bs, z->img_comp[n].w2, data);
             }
          }
       }
@@ -3145,6 +3548,17 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
    return why;
 }
 
+// IDCT giving bs x bs pixels, only the full size one has SIMD versions
+static void (*stbi__idct_kernel(stbi__jpeg *z, int bs))(stbi_uc *out, int out_stride, short data[64])
+{
+   switch (bs) {
+      case 4:  return stbi__idct_4x4;
+      case 2:  return stbi__idct_2x2;
+      case 1:  return stbi__idct_1x1;
+      default: return z->idct_block_kernel;
+   }
+}
+
 static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 {
    stbi__context *s = z->s;
@@ -3204,8 +3618,18 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      //
+      // scaled decodes store bs instead of 8 pixels per block. subsampled
+      // components get larger blocks than the others, as far as their
+      // sampling allows, so they need less upsampling or none (libjpeg
+      // does the same)
+      z->img_comp[i].bs = z->idct_size;
+      while (z->img_comp[i].bs < 8 && (h_max / z->img_comp[i].h) % (2 * z->img_comp[i].bs / z->idct_size) == 0
+                                   && (v_max / z->img_comp[i].v) % (2 * z->img_comp[i].bs / z->idct_size) == 0)
+         z->img_comp[i].bs *= 2;
+      z->img_comp[i].idct = stbi__idct_kernel(z, z->img_comp[i].bs);
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->img_comp[i].bs;
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * z->img_comp[i].bs;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3215,10 +3639,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one 8x8 block of coefficients per block of w2, h2 (see above)
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3673,13 +4097,170 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 pixels at a time
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff);
+
+      // shift by one pixel across the 128-bit lanes: alignr works per
+      // lane, so it's fed the neighbouring lane as the other operand
+      __m256i lowz = _mm256_permute2x128_si256(curr, curr, 0x08); // zero, curr.lo
+      __m256i highz = _mm256_permute2x128_si256(curr, curr, 0x81); // curr.hi, zero
+      __m256i prev = _mm256_insert_epi16(_mm256_alignr_epi8(curr, lowz, 14), (short) t1, 0);
+      __m256i next = _mm256_insert_epi16(_mm256_alignr_epi8(highz, curr, 2),
+                                         (short) (3*in_near[i+16] + in_far[i+16]), 15);
+
+      // even pixels = cur*4 + (prev - cur), odd pixels = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleaving per lane then packing per lane keeps the pixels in order
+      __m256i int0 = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i int1 = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(int0, int1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+// same math as stbi__YCbCr_to_RGB_simd, 16 pixels at a time, which also
+// handles the rest of the row and step 3
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip); // -128
+
+         // to short, y as (y << 8) + 128 and cr, cb left-shifted by 8 like the sse2 unpacks
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // per lane: pixels 0-7 in the low one, 8-15 in the high one
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3, 8-11
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7, 12-15
+
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif // STBI_AVX2
+
+static int stbi__simd_kernel = STBI_KERNEL_AUTO;
+
+STBIDEF void stbi_set_simd_kernel(int kernel)
+{
+   stbi__simd_kernel = kernel;
+}
+
+STBIDEF int stbi_simd_kernel_supported(int kernel)
+{
+   switch (kernel) {
+      case STBI_KERNEL_AUTO:
+      case STBI_KERNEL_SCALAR:
+         return 1;
+#ifdef STBI_SSE2
+      case STBI_KERNEL_SSE2:
+         return stbi__sse2_available();
+#endif
+#ifdef STBI_AVX2
+      case STBI_KERNEL_AVX2:
+         return stbi__avx2_available();
+#endif
+      default:
+         return 0;
+   }
+}
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   int kernel = stbi__simd_kernel;
+   if (kernel == STBI_KERNEL_AUTO || !stbi_simd_kernel_supported(kernel))
+      kernel = STBI_KERNEL_AVX2;
+
+   j->idct_size = 8;
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
+   if (kernel == STBI_KERNEL_SCALAR)
+      return;
+
 #ifdef STBI_SSE2
    if (stbi__sse2_available()) {
       j->idct_block_kernel = stbi__idct_simd;
@@ -3688,6 +4269,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (kernel >= STBI_KERNEL_AVX2 && stbi__avx2_available()) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3695,6 +4284,12 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
 #endif
 }
 
+static void stbi__setup_jpeg_scale(stbi__jpeg *j, int denom)
+{
+   if (denom == 2 || denom == 4 || denom == 8)
+      j->idct_size = 8 / denom;
+}
+
 // clean up the temporary component buffers
 static void stbi__cleanup_jpeg(stbi__jpeg *j)
 {
@@ -3720,7 +4315,7 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
-   int n, decode_n, is_rgb;
+   int n, decode_n, is_rgb, flip, stride;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
 
    // validate req_comp
@@ -3729,6 +4324,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // from here on a scaled decode is just a smaller image, with the
+   // rows a component has at its own block size
+   if (z->idct_size < 8) {
+      int c, d = 8 / z->idct_size;
+      z->s->img_x = (z->s->img_x + d-1) / d;
+      z->s->img_y = (z->s->img_y + d-1) / d;
+      for (c=0; c < z->s->img_n; ++c)
+         z->img_comp[c].y = (z->img_comp[c].y * z->img_comp[c].bs + 7) / 8;
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3743,7 +4348,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    {
       int k;
       unsigned int i,j;
-      stbi_uc *output;
+      stbi_uc *output, *rowbuf = NULL;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
@@ -3756,8 +4361,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
+         // larger blocks of scaled decodes did part of the upsampling
+         r->hs      = z->img_h_max / z->img_comp[k].h / (z->img_comp[k].bs / z->idct_size);
+         r->vs      = z->img_v_max / z->img_comp[k].v / (z->img_comp[k].bs / z->idct_size);
          r->ystep   = r->vs >> 1;
          r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
          r->ypos    = 0;
@@ -3770,13 +4376,34 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      flip = stbi__flip_on_load(z->s);
+      if (z->s->dest) {
+         if (!stbi__dest_fits(z->s, z->s->img_x, z->s->img_y, n)) { stbi__cleanup_jpeg(z); return stbi__errpuc("too large", "Destination too small"); }
+         output = z->s->dest;
+         stride = z->s->dest_stride;
+      } else {
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         stride = n * z->s->img_x;
+      }
+
+      // 3 channel rows write a byte past their end, over the first byte of
+      // the row already written below when flipping, or past the caller's
+      // memory. those go through a line buffer
+      if (n == 3 && (flip || z->s->dest)) {
+         rowbuf = (stbi_uc *) stbi__malloc(n * z->s->img_x + 1);
+         if (!rowbuf) {
+            if (!z->s->dest) STBI_FREE(output);
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("outofmem", "Out of memory");
+         }
+      }
 
-      // now go ahead and resample
+      // can't error after this so, this is safe
+      // now go ahead and resample, into the rows from the bottom when flipping
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *row = output + (size_t) stride * (flip ? z->s->img_y - 1 - j : j);
+         stbi_uc *out = rowbuf ? rowbuf : row;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -3868,7 +4495,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (rowbuf) memcpy(row, rowbuf, n * z->s->img_x);
       }
+      STBI_FREE(rowbuf);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -3881,10 +4510,12 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
 {
    unsigned char* result;
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
+   if (s->options)
+      stbi__setup_jpeg_scale(j, s->options->jpeg_scale_denom);
    result = load_jpeg_image(j, x,y,comp,req_comp);
+   ri->flipped = stbi__flip_on_load(s);
    STBI_FREE(j);
    return result;
 }
@@ -3930,6 +4561,8 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - optional 64-bit bit buffer, two-literal lookups and word-wise
+//        match copies (stbi_set_fast_inflate)
 
 #ifndef STBI_NO_ZLIB
 
@@ -4013,6 +4646,66 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
    return 1;
 }
 
+// tables for the fast inflate: STBI__ZMULTI_BITS of input map to an entry
+// holding the bits used (0: longer code, take the slow path), how many
+// literals it decodes (0: the symbol is a length, end or distance code)
+// and up to two symbols. a literal is paired with the next one if both
+// codes fit in the table bits
+#define STBI__ZMULTI_BITS  11
+#define STBI__ZMULTI_MASK  ((1 << STBI__ZMULTI_BITS) - 1)
+
+#define STBI__ZMULTI_LEN(e)    ((int) (e) & 31)
+#define STBI__ZMULTI_COUNT(e)  ((int) ((e) >> 5) & 3)
+#define STBI__ZMULTI_SYM1(e)   ((int) ((e) >> 8) & 511)
+#define STBI__ZMULTI_SYM2(e)   ((int) ((e) >> 17))
+
+typedef struct
+{
+   stbi__uint32 entry[1 << STBI__ZMULTI_BITS];
+} stbi__zmulti;
+
+// called after stbi__zbuild_huffman accepted the same sizes
+static void stbi__zbuild_multi(stbi__zmulti *m, const stbi_uc *sizelist, int num, int literals)
+{
+   int i, code, next_code[16], sizes[16];
+
+   memset(sizes, 0, sizeof(sizes));
+   memset(m->entry, 0, sizeof(m->entry));
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   code = 0;
+   for (i=1; i < 16; ++i) {
+      next_code[i] = code;
+      code = (code + sizes[i]) << 1;
+   }
+   for (i=0; i < num; ++i) {
+      int s = sizelist[i];
+      if (s && s <= STBI__ZMULTI_BITS) {
+         stbi__uint32 e = (stbi__uint32) (s | (literals && i < 256 ? 1 << 5 : 0) | (i << 8));
+         int j = stbi__bit_reverse(next_code[s], s);
+         while (j < (1 << STBI__ZMULTI_BITS)) {
+            m->entry[j] = e;
+            j += (1 << s);
+         }
+      }
+      if (s) ++next_code[s];
+   }
+   if (!literals) return;
+
+   // the rest of the bits index the second literal. going down, the entry
+   // at j = i >> s < i still holds a single symbol
+   for (i=(1 << STBI__ZMULTI_BITS) - 1; i >= 0; --i) {
+      stbi__uint32 e = m->entry[i], f;
+      int s = STBI__ZMULTI_LEN(e);
+      if (STBI__ZMULTI_COUNT(e) != 1) continue;
+      f = m->entry[i >> s];
+      if (STBI__ZMULTI_COUNT(f) == 1 && s + STBI__ZMULTI_LEN(f) <= STBI__ZMULTI_BITS)
+         m->entry[i] = (stbi__uint32) (s + STBI__ZMULTI_LEN(f)) | (2 << 5) |
+                       (stbi__uint32) STBI__ZMULTI_SYM1(e) << 8 | (stbi__uint32) STBI__ZMULTI_SYM1(f) << 17;
+   }
+}
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -4029,8 +4722,10 @@ typedef struct
    char *zout_start;
    char *zout_end;
    int   z_expandable;
+   int   z_fast;
 
    stbi__zhuffman z_length, z_distance;
+   stbi__zmulti   m_length, m_distance;
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4165,6 +4860,164 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
    }
 }
 
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   int i;
+   stbi__uint64 v = 0;
+   for (i=7; i >= 0; --i)
+      v = v << 8 | p[i];
+   return v;
+#endif
+}
+
+// same search as stbi__zhuffman_decode_slowpath
+static int stbi__zmulti_slowpath(stbi__uint64 *bits, int *num_bits, stbi__zhuffman *z)
+{
+   int b,s,k;
+   k = stbi__bit_reverse((int) (*bits & 0xffff), 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s == 16) return -1; // invalid code!
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   STBI_ASSERT(z->size[b] == s);
+   *bits >>= s;
+   *num_bits -= s;
+   return z->value[b];
+}
+
+// tops the bit buffer up to 56+ bits: one unaligned load that advances by
+// the whole bytes it added, near the end a byte at a time. like
+// stbi__zget8, reading past the end gives zeros, which are counted so
+// they aren't handed back
+#define STBI__ZREFILL()                                             \
+   do {                                                             \
+      if (in_end - in >= 8) {                                       \
+         bits |= stbi__zload64(in) << num_bits;                     \
+         in += (63 - num_bits) >> 3;                                \
+         num_bits |= 56;                                            \
+      } else {                                                      \
+         while (num_bits <= 56) {                                   \
+            if (in < in_end) bits |= (stbi__uint64) *in++ << num_bits; \
+            else ++overread;                                        \
+            num_bits += 8;                                          \
+         }                                                          \
+      }                                                             \
+   } while (0)
+
+#define STBI__ZCONSUME(n)  do { bits >>= (n); num_bits -= (n); } while (0)
+
+// stbi__parse_huffman_block with a 64-bit buffer: one refill covers the
+// longest length + distance pair (48 bits)
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a)
+{
+   stbi_uc *in = a->zbuffer, *in_end = a->zbuffer_end;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits, overread = 0;
+   char *zout = a->zout;
+
+   for(;;) {
+      stbi__uint32 e;
+      stbi_uc *p;
+      int z,len,dist;
+
+      STBI__ZREFILL();
+      e = a->m_length.entry[bits & STBI__ZMULTI_MASK];
+      if (STBI__ZMULTI_COUNT(e)) {
+         int n = STBI__ZMULTI_COUNT(e);
+         if (a->zout_end - zout < n) {
+            if (!stbi__zexpand(a, zout, n)) return 0;
+            zout = a->zout;
+         }
+         zout[0] = (char) STBI__ZMULTI_SYM1(e);
+         if (n == 2) zout[1] = (char) STBI__ZMULTI_SYM2(e);
+         zout += n;
+         STBI__ZCONSUME(STBI__ZMULTI_LEN(e));
+         continue;
+      }
+
+      if (STBI__ZMULTI_LEN(e)) {
+         z = STBI__ZMULTI_SYM1(e);
+         STBI__ZCONSUME(STBI__ZMULTI_LEN(e));
+      } else {
+         z = stbi__zmulti_slowpath(&bits, &num_bits, &a->z_length);
+      }
+      if (z < 256) {
+         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+         if (zout >= a->zout_end) {
+            if (!stbi__zexpand(a, zout, 1)) return 0;
+            zout = a->zout;
+         }
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) break;
+
+      z -= 257;
+      len = stbi__zlength_base[z];
+      if (stbi__zlength_extra[z]) {
+         len += (int) (bits & ((1 << stbi__zlength_extra[z]) - 1));
+         STBI__ZCONSUME(stbi__zlength_extra[z]);
+      }
+      e = a->m_distance.entry[bits & STBI__ZMULTI_MASK];
+      if (STBI__ZMULTI_LEN(e)) {
+         z = STBI__ZMULTI_SYM1(e);
+         STBI__ZCONSUME(STBI__ZMULTI_LEN(e));
+      } else {
+         z = stbi__zmulti_slowpath(&bits, &num_bits, &a->z_distance);
+      }
+      if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) {
+         dist += (int) (bits & ((1 << stbi__zdist_extra[z]) - 1));
+         STBI__ZCONSUME(stbi__zdist_extra[z]);
+      }
+      if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+      if (zout + len > a->zout_end) {
+         if (!stbi__zexpand(a, zout, len)) return 0;
+         zout = a->zout;
+      }
+
+      p = (stbi_uc *) (zout - dist);
+      if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+         zout += len;
+      } else if (dist > 1 && a->z_expandable && a->zout_end - (zout + len) >= 8) {
+         // 8 bytes at a time, overshooting into the free space after the
+         // match. a source closer than 8 bytes repeats every dist bytes,
+         // so each store gets dist bytes right
+         char *end = zout + len;
+         int step = dist < 8 ? dist : 8;
+         while (zout < end) {
+            stbi__uint64 v;
+            memcpy(&v, p, 8);
+            memcpy(zout, &v, 8);
+            zout += step;
+            p += step;
+         }
+         zout = end;
+      } else {
+         if (len) { do *zout++ = *p++; while (--len); }
+      }
+   }
+
+   // give whole bytes back, the stock reader takes over between blocks
+   {
+      int n = num_bits >> 3;
+      in -= n > overread ? n - overread : 0;
+      a->zbuffer = in;
+      a->num_bits = num_bits & 7;
+      a->code_buffer = (stbi__uint32) (bits & ((1u << a->num_bits) - 1));
+      a->zout = zout;
+   }
+   return 1;
+}
+
 static int stbi__compute_huffman_codes(stbi__zbuf *a)
 {
    static const stbi_uc length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
@@ -4211,6 +5064,10 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   if (a->z_fast) {
+      stbi__zbuild_multi(&a->m_length, lencodes, hlit, 1);
+      stbi__zbuild_multi(&a->m_distance, lencodes+hlit, hdist, 0);
+   }
    return 1;
 }
 
@@ -4304,21 +5161,37 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
             // use fixed code lengths
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , 288)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            if (a->z_fast) {
+               stbi__zbuild_multi(&a->m_length  , stbi__zdefault_length  , 288, 1);
+               stbi__zbuild_multi(&a->m_distance, stbi__zdefault_distance,  32, 0);
+            }
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
-         if (!stbi__parse_huffman_block(a)) return 0;
+         if (a->z_fast) {
+            if (!stbi__parse_huffman_block_fast(a)) return 0;
+         } else {
+            if (!stbi__parse_huffman_block(a)) return 0;
+         }
       }
    } while (!final);
    return 1;
 }
 
+static int stbi__zlib_fast = 1;
+
+STBIDEF void stbi_set_fast_inflate(int flag_true_if_fast)
+{
+   stbi__zlib_fast = flag_true_if_fast;
+}
+
 static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
 {
    a->zout_start = obuf;
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->z_fast     = stbi__zlib_fast;
 
    return stbi__parse_zlib(a, parse_header);
 }
@@ -4475,7 +5348,8 @@ static int stbi__paeth(int a, int b, int c)
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// with flip, row j is stored at y-1-j and the prior row is the one below
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
    int bytes = (depth == 16? 2 : 1);
    stbi__context *s = a->s;
@@ -4502,7 +5376,8 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
    for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
+      stbi__uint32 row = flip ? y-1-j : j;
+      stbi_uc *cur = a->out + stride*row;
       stbi_uc *prior;
       int filter = *raw++;
 
@@ -4515,7 +5390,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          filter_bytes = 1;
          width = img_width_bytes;
       }
-      prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+      prior = flip ? cur + stride : cur - stride; // bugfix: need to compute this after 'cur +=' computation above
 
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
@@ -4591,7 +5466,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          // the loop above sets the high byte of the pixels' alpha, but for
          // 16 bit png files we also need the low byte set. we'll do that here.
          if (depth == 16) {
-            cur = a->out + stride*j; // start at the beginning of the row again
+            cur = a->out + stride*row; // start at the beginning of the row again
             for (i=0; i < x; ++i,cur+=output_bytes) {
                cur[filter_bytes+1] = 255;
             }
@@ -4603,6 +5478,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    // this could run two scanlines behind the above code, so it won't
    // intefere with filtering but will still be in the cache.
    if (depth < 8) {
+      // rows expand in place, so their order doesn't matter here
       for (j=0; j < y; ++j) {
          stbi_uc *cur = a->out + stride*j;
          stbi_uc *in  = a->out + stride*j + x*out_n - img_width_bytes;
@@ -4691,10 +5567,11 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 {
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
+   int flip = stbi__flip_on_load(a->s);
    stbi_uc *final;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, flip);
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4709,7 +5586,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
             STBI_FREE(final);
             return 0;
          }
@@ -4717,6 +5594,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
+               if (flip) out_y = a->s->img_y - 1 - out_y;
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
@@ -4846,7 +5724,7 @@ static void stbi__de_iphone(stbi__png *z)
       }
    } else {
       STBI_ASSERT(s->img_out_n == 4);
-      if (stbi__unpremultiply_on_load) {
+      if (z->s->options ? z->s->options->unpremultiply : stbi__unpremultiply_on_load) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
             stbi_uc a = p[3];
@@ -5009,7 +5887,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
                }
             }
-            if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+            if (is_iphone && (s->options ? s->options->convert_iphone_png_to_rgb : stbi__de_iphone_flag) && s->img_out_n > 2)
                stbi__de_iphone(z);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
@@ -5061,6 +5939,7 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
          ri->bits_per_channel = p->depth;
       result = p->out;
       p->out = NULL;
+      ri->flipped = stbi__flip_on_load(p->s);
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -0,0 +1,90 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Copies 2D textures into GL_TEXTURE_2D_ARRAYs, one per internal format,
+// so draws sampling any of them share a single bind. Textures of the
+// layer size get a layer of their own, smaller ones are packed several to
+// a layer along a skyline, each surrounded by padding texels repeating its
+// edges so filtering doesn't bleed across. Shaders remap their
+// coordinates through the texture's Region, packed textures don't repeat.
+//
+// Copies are framebuffer blits, block compressed textures can't be
+// rendered to and are left out.
+class TextureAtlas
+{
+public:
+        struct Region
+        {
+                unsigned int array;
+                int layer;
+                // Layer coordinates are uv * scale + offset
+                float offset[2];
+                float scale[2];
+        };
+
+private:
+        struct Array
+        {
+                unsigned int id;
+                GLenum internal_format;
+                int width;
+                int height;
+                int layers;
+                int levels;
+        };
+
+        struct Source
+        {
+                unsigned int texture;
+                int width;
+                int height;
+                GLint swizzle[4];
+        };
+
+        int padding;
+        std::vector<unsigned int> textures;
+        std::vector<Array> arrays;
+        std::unordered_map<unsigned int, Region> regions;
+
+        static bool texture_storage;
+
+public:
+        // padding is a power of two, it also caps the mip chain of arrays
+        // with packed layers: past log2(padding) levels, neighbours would
+        // share texels
+        explicit TextureAtlas(int padding = 8);
+        ~TextureAtlas();
+
+        TextureAtlas(const TextureAtlas &) = delete;
+        TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+        // Textures must be uploaded by the time build() runs
+        void add(unsigned int texture);
+
+        // Packs every texture added so far, replacing the previous arrays.
+        // The sources are left as they are. GL thread only.
+        void build();
+
+        // False if the texture isn't in any array
+        bool find(unsigned int texture, Region &region) const;
+
+        size_t array_count() const;
+        unsigned int get_array(size_t index) const;
+
+        // Bytes the arrays hold in video memory, mipmaps included
+        size_t bytes() const;
+
+private:
+        void clear();
+        void build_array(GLenum internal_format, std::vector<Source> &sources);
+        void blit(unsigned int texture, unsigned int array, int layer, int x, int y,
+                  int width, int height, int layer_width, int layer_height) const;
+};
+
+#endif /* TEXTURE_ATLAS_H */
@@ -0,0 +1,124 @@
+#ifndef TEXTURE_BUDGET_H
+#define TEXTURE_BUDGET_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the video memory of streamed textures under a budget. A texture
+// is handed over with its whole mip chain in memory and starts out with
+// only its smallest level; update() streams the larger ones in, smallest
+// first across every texture, moving GL_TEXTURE_BASE_LEVEL down as they
+// land. When the levels the textures want don't fit, the ones least
+// important on screen lose their top levels first, each dropped level
+// halving their resolution, and get them back once there's room. The
+// smallest level always stays.
+//
+// Levels are specified one by one (mutable storage, not glTexStorage2D)
+// so a dropped level can be respecified empty, which frees it.
+class TextureBudget
+{
+public:
+        struct Level
+        {
+                size_t offset;
+                size_t size;
+                int width;
+                int height;
+        };
+
+        struct Stats
+        {
+                // 0 is no budget
+                size_t budget;
+
+                // Bytes of the levels in video memory, and of the levels
+                // every texture would have with no budget
+                size_t used;
+                size_t wanted;
+
+                unsigned int textures;
+                unsigned int degraded;
+
+                // This frame
+                unsigned int streamed;
+                size_t streamed_bytes;
+                unsigned int evicted;
+                size_t evicted_bytes;
+
+                // Since the start
+                unsigned int total_streamed;
+                unsigned int total_evicted;
+        };
+
+private:
+        // Bytes streamed per frame, one level always goes through
+        static constexpr size_t FRAME_BUDGET = 16 * 1024 * 1024;
+
+        struct Entry
+        {
+                GLenum internal_format;
+                GLenum format; // 0 for block compressed levels
+                int channels;
+                std::vector<unsigned char> data;
+                std::vector<Level> levels;
+
+                // Finest level in video memory (the base level), the one
+                // the budget allows and the one its size on screen calls for
+                int resident;
+                int target;
+                int wanted;
+                float importance;
+        };
+
+        size_t budget;
+        std::unordered_map<unsigned int, Entry> entries;
+        Stats stats;
+
+public:
+        TextureBudget();
+
+        TextureBudget(const TextureBudget &) = delete;
+        TextureBudget &operator=(const TextureBudget &) = delete;
+
+        // 0 for no limit
+        void set_budget(size_t bytes);
+
+        // Takes over a texture whose levels are in data, level 0 first.
+        // format is the pixel format of uncompressed levels, 0 if
+        // internal_format is a block format. Uploads the smallest level.
+        void add(unsigned int texture, GLenum internal_format, GLenum format, int channels,
+                 std::vector<unsigned char> data, const std::vector<Level> &levels);
+
+        // The texture itself is deleted by the caller
+        void remove(unsigned int texture);
+
+        bool contains(unsigned int texture) const;
+
+        // Pixels the texture covers on screen, 0 when it isn't visible.
+        // It then only wants the level with about as many texels, and the
+        // least covered textures are the first to lose levels. Textures
+        // nobody set it for want every level and weigh the same.
+        void set_coverage(unsigned int texture, float pixels);
+
+        // Once per frame on the GL thread
+        void update();
+
+        // Bytes the texture holds in video memory, of one of its levels
+        // whether resident or not, and its finest resident level
+        size_t bytes(unsigned int texture) const;
+        size_t level_bytes(unsigned int texture, int level) const;
+        int resident_level(unsigned int texture) const;
+
+        const Stats &get_stats() const;
+
+private:
+        static size_t chain_bytes(const Entry &entry, int first);
+
+        void upload(unsigned int texture, Entry &entry, int level);
+        void evict(unsigned int texture, Entry &entry, int level);
+};
+
+#endif /* TEXTURE_BUDGET_H */
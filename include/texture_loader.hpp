@@ -0,0 +1,189 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include "staging_buffer.hpp"
+#include "texture_budget.hpp"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Decodes images on a pool of worker threads and uploads them from the GL
+// thread. load() returns a texture name right away, holding a 1x1
+// placeholder until the image is in. update() is called once per frame
+// and copies decoded images into a ring of pixel buffer objects, each
+// fenced, so the texture upload itself runs asynchronously in the driver.
+//
+// Textures get immutable storage (glTexStorage2D, GL 4.2 or
+// ARB_texture_storage) with a sized format matching the decoded channels:
+// R8 and RG8 swizzled to grey, RGB expanded to RGBA8 on the worker.
+// Older drivers get the same sized formats through glTexImage2D.
+//
+// Files are memory mapped and decoded from memory, see ImageSource for
+// paths into tar archives. With glBufferStorage (GL 4.4 or
+// ARB_buffer_storage) the workers decode straight into a persistently
+// mapped StagingBuffer and the GL thread copies nothing, the ring is
+// only left for KTX2 files and for when the staging buffer is full.
+//
+// KTX2 files from tools/texture_compressor are uploaded as they are with
+// their mip chain, or decoded on the worker when the driver lacks the
+// format.
+//
+// JPEGs larger than a load's max_size decode at 1/2, 1/4 or 1/8 of their
+// size in the DCT domain, far cheaper than decoding them whole and
+// scaling down. Other formats always load at full size.
+//
+// With a TextureBudget, images loaded afterwards get their mip chain built
+// on the worker and are handed to it, which streams the levels in.
+class TextureLoader
+{
+public:
+        enum Status
+        {
+                PENDING,
+                READY,
+                FAILED,
+        };
+
+        // Size of the decoded image, 1x1 RGBA for the placeholder. bytes is
+        // what the texture holds in video memory, mipmaps included.
+        struct Info
+        {
+                Status status;
+                int width;
+                int height;
+                int channels;
+                size_t bytes;
+        };
+
+private:
+        static constexpr unsigned int RING_SIZE = 3;
+
+        // Upload budget of a frame, one image always goes through
+        static constexpr size_t FRAME_BUDGET = 32 * 1024 * 1024;
+
+        // Decoded images waiting for or in upload, larger ones take the ring
+        static constexpr size_t STAGING_SIZE = 128 * 1024 * 1024;
+
+        struct Job
+        {
+                unsigned int texture;
+                std::string filepath;
+                bool flip;
+                int max_size;
+                bool streamed;
+        };
+
+        // Offsets in the image data, handed to the budget as they are
+        typedef TextureBudget::Level Level;
+
+        // Either stb_image pixels, in the staging buffer or on the heap, or
+        // levels read from a KTX2 file
+        struct Image
+        {
+                unsigned int texture;
+                std::string filepath;
+                size_t staged;
+                unsigned char *pixels;
+                std::vector<unsigned char> buffer;
+                std::vector<Level> levels;
+                GLenum compressed_format;
+                int width;
+                int height;
+                int channels;
+                bool streamed;
+
+                // RGBA8 levels holding sRGB colors, from a KTX2 file
+                bool srgb;
+
+                const unsigned char *data() const;
+                size_t size() const;
+        };
+
+        struct Slot
+        {
+                unsigned int buffer;
+                size_t capacity;
+                GLsync fence;
+        };
+
+        // Staging range read by uploads not known to be done yet
+        struct StagedUpload
+        {
+                GLsync fence;
+                size_t offset;
+                size_t size;
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::condition_variable image_ready;
+        std::deque<Job> jobs;
+        std::deque<Image> images;
+        bool stopping;
+
+        // Block formats the driver takes, read by the workers
+        bool s3tc_supported;
+        bool s3tc_srgb_supported;
+        bool etc2_supported;
+        bool texture_storage;
+
+        // Ranges allocated by the workers, released by the GL thread
+        std::unique_ptr<StagingBuffer> staging;
+
+        // GL thread only
+        TextureBudget *budget;
+        Slot ring[RING_SIZE];
+        unsigned int next_slot;
+        std::deque<StagedUpload> staged_uploads;
+        unsigned int pending;
+        std::unordered_map<unsigned int, Info> textures;
+        std::chrono::steady_clock::time_point start_time;
+
+public:
+        // threads = 0 uses one worker per core
+        explicit TextureLoader(unsigned int threads = 0);
+        ~TextureLoader();
+
+        TextureLoader(const TextureLoader &) = delete;
+        TextureLoader &operator=(const TextureLoader &) = delete;
+
+        // max_size = 0 loads JPEGs at full size, see above
+        unsigned int load(const std::string &filepath, bool flip = true, int max_size = 0);
+
+        // nullptr uploads textures whole again, see above
+        void set_budget(TextureBudget *budget);
+
+        // Returns the number of textures completed by the call
+        unsigned int update();
+        void wait();
+
+        Status get_status(unsigned int texture) const;
+        Info get_info(unsigned int texture) const;
+
+        // Drops the bookkeeping of a texture that is no longer pending
+        void forget(unsigned int texture);
+
+        unsigned int pending_count() const;
+        unsigned int thread_count() const;
+
+private:
+        void run();
+        bool decode(const Job &job, Image &image) const;
+        bool decode_ktx(const Job &job, Image &image) const;
+        static void build_mips(Image &image);
+        void release_staged();
+        unsigned int upload(bool blocking);
+        bool upload(const Image &image, bool blocking);
+};
+
+#endif /* TEXTURE_LOADER_H */
@@ -0,0 +1,113 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "texture_budget.hpp"
+#include "texture_loader.hpp"
+
+class TextureManager;
+
+// Counted reference to a texture of a TextureManager, the texture is
+// deleted when the last handle goes away. Handles must not outlive their
+// manager.
+class Texture
+{
+private:
+        TextureManager *manager;
+        unsigned int id;
+
+        friend class TextureManager;
+
+        Texture(TextureManager *manager, unsigned int id);
+
+public:
+        Texture();
+        ~Texture();
+
+        Texture(const Texture &other);
+        Texture(Texture &&other);
+        Texture &operator=(Texture other);
+
+        unsigned int get_id() const;
+        bool valid() const;
+
+        // Bytes the texture holds in video memory, mipmaps included
+        size_t vram_bytes() const;
+};
+
+// Loads each image once however many times it is asked for. Requests are
+// matched by canonical path first, then by a hash of the file contents so
+// copies under another name share the texture too. Images are flipped
+// for GL's bottom-left origin.
+class TextureManager
+{
+private:
+        struct Entry
+        {
+                std::vector<std::string> paths;
+                uint64_t content_hash;
+                unsigned int references;
+        };
+
+        // Outlives the loader, which hands it textures
+        TextureBudget budget;
+        TextureLoader loader;
+        int max_size;
+        std::unordered_map<unsigned int, Entry> entries;
+        std::unordered_map<std::string, unsigned int> by_path;
+        std::unordered_map<uint64_t, unsigned int> by_content;
+
+        // Released while still loading, deleted once the upload landed
+        std::vector<unsigned int> released;
+
+        friend class Texture;
+
+public:
+        // threads = 0 uses one loader thread per core
+        explicit TextureManager(unsigned int threads = 0);
+        ~TextureManager();
+
+        TextureManager(const TextureManager &) = delete;
+        TextureManager &operator=(const TextureManager &) = delete;
+
+        // An invalid handle when the file can't be read
+        Texture acquire(const std::string &filepath);
+
+        // JPEGs acquired afterwards are decoded smaller when their larger
+        // side exceeds size, see TextureLoader. 0, the default, is no
+        // limit. Images already loaded keep their size.
+        void set_max_size(int size);
+
+        // Textures acquired afterwards stream their mips in through a
+        // TextureBudget keeping them under bytes, the least covered on
+        // screen losing their top levels first. 0, the default, uploads
+        // them whole; textures already streaming keep streaming unbounded.
+        void set_budget(size_t bytes);
+        void set_coverage(const Texture &texture, float pixels);
+        const TextureBudget::Stats &budget_stats() const;
+
+        // Once per frame on the GL thread
+        void update();
+        void wait();
+
+        TextureLoader::Status get_status(const Texture &texture) const;
+        unsigned int pending_count() const;
+        size_t vram_bytes(unsigned int texture) const;
+        size_t total_vram_bytes() const;
+        unsigned int size() const;
+
+        void report(std::ostream &out) const;
+
+private:
+        void retain(unsigned int texture);
+        void release(unsigned int texture);
+        void destroy(unsigned int texture);
+};
+
+#endif /* TEXTURE_MANAGER_H */
@@ -0,0 +1,54 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/matrix.hpp>
+
+#include <cstddef>
+#include <string>
+
+// std140 layout of the Camera block declared in res/shaders/camera.glsl
+struct CameraBlock
+{
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 view_projection;
+};
+
+constexpr unsigned int CAMERA_BINDING = 0;
+
+// Uniform block shared by every program, bound at a fixed binding point.
+// Each frame writes its own slot of a three slot ring and fences it, so the
+// CPU only ever waits on a frame the GPU finished two frames ago.
+class UniformBuffer
+{
+private:
+        static constexpr unsigned int FRAMES = 3;
+
+        unsigned int buffer_id;
+        std::string block;
+        unsigned int binding;
+        size_t size;
+        size_t stride;
+        unsigned int frame;
+        GLsync fences[FRAMES];
+
+public:
+        UniformBuffer() = delete;
+
+        // Programs linked afterwards bind their block with this name to the
+        // binding point
+        UniformBuffer(const std::string &block, unsigned int binding, size_t size);
+        ~UniformBuffer();
+
+        UniformBuffer(const UniformBuffer &) = delete;
+        UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+        // Once per frame, before the draws reading the block
+        void update(const void *data);
+        void end_frame();
+
+        static void bind_blocks(unsigned int program);
+};
+
+#endif /* UNIFORM_BUFFER_H */
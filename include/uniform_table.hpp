@@ -0,0 +1,49 @@
+#ifndef UNIFORM_TABLE_H
+#define UNIFORM_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct UniformHandle
+{
+        int location;
+        unsigned int type;
+
+        UniformHandle() : location(-1), type(0) {}
+        UniformHandle(int location, unsigned int type)
+            : location(location), type(type) {}
+
+        bool valid() const { return location != -1; }
+};
+
+// Active uniforms of a linked program, filled once after link with
+// glGetActiveUniform and looked up by name without calling the driver.
+// Open addressing over a power of two array of slots.
+class UniformTable
+{
+private:
+        struct Slot
+        {
+                uint64_t hash;
+                std::string name;
+                UniformHandle handle;
+        };
+
+        std::vector<Slot> slots;
+        unsigned int count;
+
+public:
+        UniformTable();
+
+        void reflect(unsigned int program);
+        void clear();
+
+        UniformHandle find(const char *name) const;
+        unsigned int size() const;
+
+private:
+        void insert(const std::string &name, const UniformHandle &handle);
+};
+
+#endif /* UNIFORM_TABLE_H */
@@ -0,0 +1,39 @@
+#ifndef VERTEX_ARRAY_CACHE_H
+#define VERTEX_ARRAY_CACHE_H
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "shader.hpp"
+#include "vertex_layout.hpp"
+
+// Vertex array objects keyed by (layout, program interface, buffers).
+// Attribute state is set up the first time a combination is drawn and the
+// VAO is only bound afterwards, also across reloads and variants that keep
+// the same vertex inputs. Buffers are part of the key as GL 3.3 stores them
+// in the VAO along with the format.
+class VertexArrayCache
+{
+private:
+        std::unordered_map<uint64_t, unsigned int> vertex_arrays;
+
+public:
+        VertexArrayCache() = default;
+        ~VertexArrayCache();
+
+        VertexArrayCache(const VertexArrayCache &) = delete;
+        VertexArrayCache &operator=(const VertexArrayCache &) = delete;
+
+        // Returns the VAO bound, element_buffer may be 0
+        unsigned int bind(const VertexLayout &layout, const Shader &shader,
+                          unsigned int vertex_buffer, unsigned int element_buffer);
+
+        void clear();
+        unsigned int size() const;
+
+private:
+        unsigned int create(const VertexLayout &layout, const VertexInterface &interface,
+                            unsigned int vertex_buffer, unsigned int element_buffer) const;
+};
+
+#endif /* VERTEX_ARRAY_CACHE_H */
@@ -0,0 +1,71 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interleaved format of a vertex buffer, attributes in declaration order.
+// They are matched by name against the inputs of a program, so the layout
+// does not depend on the locations a given program picked.
+class VertexLayout
+{
+public:
+        struct Attribute
+        {
+                std::string name;
+                int components;
+                GLenum type;
+                bool normalized;
+                unsigned int offset;
+        };
+
+private:
+        std::vector<Attribute> attributes;
+        unsigned int stride;
+        uint64_t layout_hash;
+
+public:
+        VertexLayout();
+
+        VertexLayout &add(const std::string &name, int components,
+                          GLenum type = GL_FLOAT, bool normalized = false);
+
+        const std::vector<Attribute> &get_attributes() const;
+        unsigned int get_stride() const;
+        uint64_t hash() const;
+};
+
+// Active vertex inputs of a linked program, filled once after link with
+// glGetActiveAttrib. Two programs with the same hash can share a VAO.
+class VertexInterface
+{
+public:
+        struct Attribute
+        {
+                std::string name;
+                int location;
+                GLenum type;
+                int size;
+        };
+
+private:
+        std::vector<Attribute> attributes;
+        uint64_t interface_hash;
+
+public:
+        VertexInterface();
+
+        void reflect(unsigned int program);
+        void clear();
+
+        // nullptr when the program has no such active input
+        const Attribute *find(const std::string &name) const;
+
+        const std::vector<Attribute> &get_attributes() const;
+        uint64_t hash() const;
+};
+
+#endif /* VERTEX_LAYOUT_H */
@@ -0,0 +1,199 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "ktx_file.hpp"
+#include "mapped_file.hpp"
+#include "shader.hpp"
+#include "staging_buffer.hpp"
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Texture far larger than video memory, kept on disk as an RGBA8 KTX2 file
+// with its mip chain (texture_compressor -f rgba8) and only resident in
+// the tiles the camera sees. Every level is cut in pages of TILE_SIZE
+// texels, a resident page lives in a slot of the cache texture with a
+// border of its neighbours' texels so bilinear filtering doesn't need
+// them. The page table texture has a texel per page and per level
+// pointing at its slot, or at the slot of the closest resident ancestor.
+// The coarsest level is a single page, loaded with the file and never
+// evicted, so every lookup lands somewhere.
+//
+// Which pages are needed comes from a feedback pass: the scene drawn
+// small with the FEEDBACK variant of res/shaders/virtual.glsl, which
+// writes the page each fragment samples. Its pixels are read back
+// through fenced pixel buffers and parsed a few frames later, so the GL
+// thread never waits on the GPU. Missing pages, coarsest first, are cut
+// out of the mapped file by worker threads, straight into a persistently
+// mapped StagingBuffer when glBufferStorage is there, and uploaded by the
+// GL thread, least recently requested tiles making room.
+class VirtualTexture
+{
+public:
+        static constexpr int TILE_SIZE = 128;
+        static constexpr int TILE_BORDER = 4;
+        static constexpr int SLOT_SIZE = TILE_SIZE + 2 * TILE_BORDER;
+
+        // The feedback buffer is this many times smaller on each side
+        static constexpr int FEEDBACK_SCALE = 8;
+
+        struct Stats
+        {
+                // Pages the last parsed feedback asked for, ancestors
+                // included, and how many of them weren't resident
+                unsigned int requested;
+                unsigned int missing;
+
+                unsigned int resident;
+                unsigned int capacity;
+                unsigned int pending;
+
+                // Since open()
+                unsigned int loaded;
+                unsigned int evicted;
+        };
+
+private:
+        static constexpr unsigned int READBACKS = 3;
+
+        // Tiles being read by the workers, and uploaded per frame
+        static constexpr unsigned int MAX_PENDING = 64;
+        static constexpr unsigned int FRAME_UPLOADS = 16;
+
+        struct Tile
+        {
+                uint32_t page;
+                size_t staged;
+                std::vector<unsigned char> pixels;
+        };
+
+        // Pinned tiles aren't in the LRU list
+        struct Resident
+        {
+                int slot;
+                uint64_t last_used;
+                bool pinned;
+                std::list<uint32_t>::iterator position;
+        };
+
+        struct Readback
+        {
+                unsigned int buffer;
+                GLsync fence;
+                int width;
+                int height;
+        };
+
+        // Staging ranges of the tiles uploaded in a frame
+        struct StagedUpload
+        {
+                GLsync fence;
+                std::vector<size_t> offsets;
+        };
+
+        MappedFile file;
+        KtxImage image;
+        GLenum internal_format;
+        int page_levels;
+        int pages_x;
+        int pages_y;
+
+        unsigned int page_table;
+        unsigned int cache;
+        int cache_size;
+
+        // Page table levels as uploaded, RGBA8UI: slot x, slot y, level
+        std::vector<std::vector<unsigned char>> entries;
+        bool entries_dirty;
+
+        // GL thread only
+        std::unordered_map<uint32_t, Resident> resident;
+        std::list<uint32_t> lru;
+        std::vector<int> free_slots;
+        std::unordered_set<uint32_t> in_flight;
+        uint64_t frame;
+        Stats stats;
+
+        unsigned int feedback_framebuffer;
+        unsigned int feedback_color;
+        unsigned int feedback_depth;
+        int feedback_width;
+        int feedback_height;
+        int viewport_width;
+        int viewport_height;
+        Readback readbacks[READBACKS];
+        unsigned int next_readback;
+
+        std::unique_ptr<StagingBuffer> staging;
+        std::deque<StagedUpload> staged_uploads;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::deque<uint32_t> jobs;
+        std::deque<Tile> tiles;
+        bool stopping;
+
+public:
+        // cache_size slots on each side of the cache texture, threads = 0
+        // uses one worker per core
+        explicit VirtualTexture(int cache_size = 16, unsigned int threads = 0);
+        ~VirtualTexture();
+
+        VirtualTexture(const VirtualTexture &) = delete;
+        VirtualTexture &operator=(const VirtualTexture &) = delete;
+
+        // Once per object. Power of two sizes up to 256 pages on a side,
+        // with enough of the mip chain to get down to a single page.
+        bool open(const std::string &filepath);
+        bool is_open() const;
+
+        // Draws in between, with the FEEDBACK variant, go to the feedback
+        // buffer. width and height are the viewport's, restored after.
+        void begin_feedback(int width, int height);
+        void end_feedback();
+
+        // Once per frame on the GL thread: parses the feedback read back
+        // so far, queues the missing pages and uploads the tiles read
+        void update();
+
+        // Sizes and samplers of res/shaders/virtual.glsl, the textures are
+        // bound to the units by the caller
+        void set_uniforms(const Shader &shader, unsigned int page_table_unit,
+                          unsigned int cache_unit) const;
+
+        unsigned int get_page_table() const;
+        unsigned int get_cache() const;
+        int get_width() const;
+        int get_height() const;
+
+        const Stats &get_stats() const;
+
+private:
+        static uint32_t page_key(int level, int x, int y);
+
+        int level_pages_x(int level) const;
+        int level_pages_y(int level) const;
+
+        void run();
+        void read_tile(uint32_t page, unsigned char *out) const;
+
+        void parse_feedback(const unsigned char *pixels, int width, int height);
+        void upload_tiles();
+        bool upload(Tile &tile);
+        void release_staged();
+        void update_page_table();
+};
+
+#endif /* VIRTUAL_TEXTURE_H */
@@ -0,0 +1,7 @@
+// Per-frame camera, shared by every program through the uniform buffer
+// bound at CAMERA_BINDING (see include/uniform_buffer.hpp)
+layout(std140) uniform Camera {
+        mat4 u_view;
+        mat4 u_projection;
+        mat4 u_view_projection;
+};
@@ -0,0 +1,63 @@
+#keywords TRANSFORM PROJECTION ARRAY
+
+#shader vertex
+#version 330 core
+
+in vec3 position;
+in vec3 color;
+in vec2 texture_coord;
+
+#if defined(PROJECTION)
+#include "camera.glsl"
+uniform mat4 u_model;
+#elif defined(TRANSFORM)
+uniform mat4 u_transform;
+#endif
+
+out vec2 ex_tex_coord;
+
+void main() {
+        ex_tex_coord = texture_coord;
+#if defined(PROJECTION)
+        gl_Position = u_view_projection * u_model * vec4(position, 1.f);
+#elif defined(TRANSFORM)
+        gl_Position = u_transform * vec4(position, 1.f);
+#else
+        gl_Position = vec4(position, 1.f);
+#endif
+}
+
+
+#shader fragment
+#version 330 core
+
+in vec2 ex_tex_coord;
+out vec4 FragColor;
+
+#if defined(ARRAY)
+// Both textures in one array, rects map the coordinates into their layer:
+// offset in xy, scale in zw
+uniform sampler2DArray texture_array;
+uniform vec4 texture_rect1;
+uniform vec4 texture_rect2;
+uniform float texture_layer1;
+uniform float texture_layer2;
+#else
+uniform sampler2D texture_data1;
+uniform sampler2D texture_data2;
+#endif
+
+void main() {
+       // FragColor = texture(texture_data, ex_tex_coord);// * vec4(ex_color, 1.0f);
+#if defined(ARRAY)
+        FragColor = mix(
+                texture(texture_array, vec3(ex_tex_coord * texture_rect1.zw + texture_rect1.xy, texture_layer1)),
+                texture(texture_array, vec3(ex_tex_coord * texture_rect2.zw + texture_rect2.xy, texture_layer2)),
+                0.2);
+#else
+        FragColor = mix(
+                texture(texture_data1, ex_tex_coord),
+                texture(texture_data2, ex_tex_coord),
+                0.2);
+#endif
+}
@@ -0,0 +1,75 @@
+#keywords FEEDBACK
+
+#shader vertex
+#version 330 core
+
+in vec3 position;
+in vec2 texture_coord;
+
+#include "camera.glsl"
+uniform mat4 u_model;
+
+out vec2 ex_tex_coord;
+
+void main() {
+        ex_tex_coord = texture_coord;
+        gl_Position = u_view_projection * u_model * vec4(position, 1.f);
+}
+
+
+#shader fragment
+#version 330 core
+
+// Virtual texture streamed by VirtualTexture (include/virtual_texture.hpp).
+// FEEDBACK writes the page each fragment needs instead of its color.
+
+const float TILE_SIZE = 128.0;
+const float TILE_BORDER = 4.0;
+const float SLOT_SIZE = TILE_SIZE + 2.0 * TILE_BORDER;
+
+in vec2 ex_tex_coord;
+out vec4 FragColor;
+
+// Slot x, slot y and level of the tile mapped for each page
+uniform usampler2D virtual_page_table;
+// Texels of level 0 in xy, pages in zw
+uniform vec4 virtual_size;
+uniform float virtual_max_level;
+
+#if defined(FEEDBACK)
+uniform float virtual_lod_bias;
+#else
+uniform sampler2D virtual_cache;
+uniform float virtual_cache_texels;
+#endif
+
+void main() {
+        vec2 uv = clamp(ex_tex_coord, 0.0, 1.0);
+
+        vec2 texels = ex_tex_coord * virtual_size.xy;
+        vec2 dx = dFdx(texels);
+        vec2 dy = dFdy(texels);
+        float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+#if defined(FEEDBACK)
+        lod += virtual_lod_bias;
+#endif
+        float level = clamp(floor(lod), 0.0, virtual_max_level);
+
+        vec2 pages = max(virtual_size.zw / exp2(level), 1.0);
+        ivec2 page = ivec2(min(floor(uv * pages), pages - 1.0));
+
+#if defined(FEEDBACK)
+        FragColor = vec4(vec3(page, level) / 255.0, 1.0);
+#else
+        // The tile may be an ancestor's, coarser than the level asked for
+        uvec4 entry = texelFetch(virtual_page_table, page, int(level));
+        float mapped = float(entry.b);
+        vec2 mapped_pages = max(virtual_size.zw / exp2(mapped), 1.0);
+        vec2 extent = min(max(virtual_size.xy / exp2(mapped), 1.0), vec2(TILE_SIZE));
+
+        vec2 scaled = uv * mapped_pages;
+        vec2 local = scaled - min(floor(scaled), mapped_pages - 1.0);
+        vec2 texel = vec2(entry.rg) * SLOT_SIZE + TILE_BORDER + local * extent;
+        FragColor = texture(virtual_cache, texel / virtual_cache_texels);
+#endif
+}
@@ -0,0 +1,901 @@
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+typedef unsigned char Block[16][4];
+
+// Pixels past the right and bottom edges repeat the last column and row
+void fetch_block(const unsigned char *rgba, int width, int height, int bx, int by,
+                 Block block)
+{
+        for (int y = 0; y < 4; ++y)
+        {
+                int sy = std::min(by * 4 + y, height - 1);
+                for (int x = 0; x < 4; ++x)
+                {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(block[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+                }
+        }
+}
+
+void store_block(const Block block, int width, int height, int bx, int by,
+                 unsigned char *rgba)
+{
+        for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+        {
+                for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+                        memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4,
+                               block[y * 4 + x], 4);
+        }
+}
+
+int clamp_byte(int value)
+{
+        return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+int square(int value)
+{
+        return value * value;
+}
+
+// BC1
+
+uint16_t pack_565(const float color[3])
+{
+        int r = (int)std::lround(std::min(std::max(color[0], 0.f), 255.f) * 31.f / 255.f);
+        int g = (int)std::lround(std::min(std::max(color[1], 0.f), 255.f) * 63.f / 255.f);
+        int b = (int)std::lround(std::min(std::max(color[2], 0.f), 255.f) * 31.f / 255.f);
+
+        return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+void unpack_565(uint16_t color, int out[3])
+{
+        int r = color >> 11;
+        int g = (color >> 5) & 0x3F;
+        int b = color & 0x1F;
+
+        out[0] = r << 3 | r >> 2;
+        out[1] = g << 2 | g >> 4;
+        out[2] = b << 3 | b >> 2;
+}
+
+void bc1_palette(uint16_t c0, uint16_t c1, bool four_colors, int palette[4][4])
+{
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+
+        for (int i = 0; i < 3; ++i)
+        {
+                if (four_colors)
+                {
+                        palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+                        palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+                }
+                else
+                {
+                        palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+                        palette[3][i] = 0;
+                }
+        }
+
+        palette[2][3] = 255;
+        palette[3][3] = four_colors ? 255 : 0;
+}
+
+// Picks the nearest palette entry of every pixel, returns the total error
+int bc1_indices(const Block block, uint16_t c0, uint16_t c1, uint8_t indices[16])
+{
+        int palette[4][4];
+        bc1_palette(c0, c1, true, palette);
+
+        int total = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+                int best = std::numeric_limits<int>::max();
+                for (int p = 0; p < 4; ++p)
+                {
+                        int error = square(block[i][0] - palette[p][0]) +
+                                    square(block[i][1] - palette[p][1]) +
+                                    square(block[i][2] - palette[p][2]);
+                        if (error < best)
+                        {
+                                best = error;
+                                indices[i] = (uint8_t)p;
+                        }
+                }
+
+                total += best;
+        }
+
+        return total;
+}
+
+// Endpoints minimizing the squared error for the given indices
+bool bc1_refit(const Block block, const uint8_t indices[16], uint16_t &c0, uint16_t &c1)
+{
+        static const float weights[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        float ax[3] = {0.f, 0.f, 0.f}, bx[3] = {0.f, 0.f, 0.f};
+        for (int i = 0; i < 16; ++i)
+        {
+                float a = weights[indices[i]];
+                float b = 1.f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < 3; ++c)
+                {
+                        ax[c] += a * block[i][c];
+                        bx[c] += b * block[i][c];
+                }
+        }
+
+        float det = aa * bb - ab * ab;
+        if (std::fabs(det) < 1e-6f)
+                return false;
+
+        float e0[3], e1[3];
+        for (int c = 0; c < 3; ++c)
+        {
+                e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+                e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+
+        c0 = pack_565(e0);
+        c1 = pack_565(e1);
+
+        return true;
+}
+
+void encode_bc1(const Block block, unsigned char out[8])
+{
+        // Principal axis of the colors by power iteration on the covariance
+        float mean[3] = {0.f, 0.f, 0.f};
+        for (int i = 0; i < 16; ++i)
+        {
+                for (int c = 0; c < 3; ++c)
+                        mean[c] += block[i][c] / 16.f;
+        }
+
+        float covariance[3][3] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+                float d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+                for (int r = 0; r < 3; ++r)
+                {
+                        for (int c = 0; c < 3; ++c)
+                                covariance[r][c] += d[r] * d[c];
+                }
+        }
+
+        float axis[3] = {1.f, 1.f, 1.f};
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+                float next[3];
+                for (int r = 0; r < 3; ++r)
+                        next[r] = covariance[r][0] * axis[0] + covariance[r][1] * axis[1] +
+                                  covariance[r][2] * axis[2];
+
+                float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+                if (length < 1e-6f)
+                        break;
+
+                for (int c = 0; c < 3; ++c)
+                        axis[c] = next[c] / length;
+        }
+
+        float low = std::numeric_limits<float>::max();
+        float high = -low;
+        for (int i = 0; i < 16; ++i)
+        {
+                float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] +
+                          (block[i][2] - mean[2]) * axis[2];
+                low = std::min(low, t);
+                high = std::max(high, t);
+        }
+
+        float e0[3], e1[3];
+        for (int c = 0; c < 3; ++c)
+        {
+                e0[c] = mean[c] + axis[c] * high;
+                e1[c] = mean[c] + axis[c] * low;
+        }
+
+        uint16_t c0 = pack_565(e0);
+        uint16_t c1 = pack_565(e1);
+        uint8_t indices[16];
+        int error = bc1_indices(block, c0, c1, indices);
+
+        for (int iteration = 0; iteration < 2 && error > 0; ++iteration)
+        {
+                uint16_t r0, r1;
+                uint8_t refit[16];
+                if (!bc1_refit(block, indices, r0, r1))
+                        break;
+
+                int refit_error = bc1_indices(block, r0, r1, refit);
+                if (refit_error >= error)
+                        break;
+
+                c0 = r0;
+                c1 = r1;
+                error = refit_error;
+                memcpy(indices, refit, sizeof(indices));
+        }
+
+        // c0 > c1 selects the four color mode
+        if (c0 < c1)
+        {
+                std::swap(c0, c1);
+                for (auto &index : indices)
+                        index ^= 1;
+        }
+        else if (c0 == c1)
+        {
+                memset(indices, 0, sizeof(indices));
+        }
+
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; ++i)
+                bits |= (uint32_t)indices[i] << (2 * i);
+
+        out[0] = (unsigned char)(c0 & 0xFF);
+        out[1] = (unsigned char)(c0 >> 8);
+        out[2] = (unsigned char)(c1 & 0xFF);
+        out[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+                out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// BC3 and BC5 color blocks always use four colors
+void decode_bc1(const unsigned char in[8], bool allow_three_colors, Block block)
+{
+        uint16_t c0 = (uint16_t)(in[0] | in[1] << 8);
+        uint16_t c1 = (uint16_t)(in[2] | in[3] << 8);
+        uint32_t bits = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 |
+                        (uint32_t)in[7] << 24;
+
+        int palette[4][4];
+        bc1_palette(c0, c1, !allow_three_colors || c0 > c1, palette);
+
+        for (int i = 0; i < 16; ++i)
+        {
+                const int *color = palette[(bits >> (2 * i)) & 3];
+                for (int c = 0; c < 4; ++c)
+                        block[i][c] = (unsigned char)color[c];
+        }
+}
+
+// BC4, one channel
+
+void bc4_palette(int a0, int a1, int palette[8])
+{
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+                for (int i = 1; i < 7; ++i)
+                        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+        else
+        {
+                for (int i = 1; i < 5; ++i)
+                        palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                palette[6] = 0;
+                palette[7] = 255;
+        }
+}
+
+void encode_bc4(const Block block, int channel, unsigned char out[8])
+{
+        int low = 255, high = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+                low = std::min(low, (int)block[i][channel]);
+                high = std::max(high, (int)block[i][channel]);
+        }
+
+        int palette[8];
+        bc4_palette(high, low, palette);
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 16 && high != low; ++i)
+        {
+                int best = 0;
+                for (int p = 1; p < 8; ++p)
+                {
+                        if (std::abs(palette[p] - block[i][channel]) <
+                            std::abs(palette[best] - block[i][channel]))
+                                best = p;
+                }
+
+                bits |= (uint64_t)best << (3 * i);
+        }
+
+        out[0] = (unsigned char)high;
+        out[1] = (unsigned char)low;
+        for (int i = 0; i < 6; ++i)
+                out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+void decode_bc4(const unsigned char in[8], int channel, Block block)
+{
+        int palette[8];
+        bc4_palette(in[0], in[1], palette);
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; ++i)
+                bits |= (uint64_t)in[2 + i] << (8 * i);
+
+        for (int i = 0; i < 16; ++i)
+                block[i][channel] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+// ETC1 / ETC2
+
+const int etc_modifiers[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183},
+};
+
+// Pixel index value 0 to 3 to modifier
+int etc_modifier(int table, int value)
+{
+        int modifier = etc_modifiers[table][value & 1];
+        return value & 2 ? -modifier : modifier;
+}
+
+// Pixels are numbered column first in the index bits
+bool in_subblock(int x, int y, bool flip, int subblock)
+{
+        return (flip ? y >= 2 : x >= 2) == (subblock == 1);
+}
+
+// Best table and indices of a subblock for a base color, returns the error
+int etc_fit_subblock(const Block block, bool flip, int subblock, const int base[3],
+                     int &table, uint8_t indices[16])
+{
+        int best_error = std::numeric_limits<int>::max();
+        uint8_t candidate[16];
+        for (int t = 0; t < 8; ++t)
+        {
+                int error = 0;
+                for (int y = 0; y < 4; ++y)
+                {
+                        for (int x = 0; x < 4; ++x)
+                        {
+                                if (!in_subblock(x, y, flip, subblock))
+                                        continue;
+
+                                const unsigned char *pixel = block[y * 4 + x];
+                                int best = std::numeric_limits<int>::max();
+                                for (int value = 0; value < 4; ++value)
+                                {
+                                        int modifier = etc_modifier(t, value);
+                                        int e = 0;
+                                        for (int c = 0; c < 3; ++c)
+                                                e += square(clamp_byte(base[c] + modifier) - pixel[c]);
+
+                                        if (e < best)
+                                        {
+                                                best = e;
+                                                candidate[x * 4 + y] = (uint8_t)value;
+                                        }
+                                }
+
+                                error += best;
+                        }
+                }
+
+                if (error < best_error)
+                {
+                        best_error = error;
+                        table = t;
+                        for (int y = 0; y < 4; ++y)
+                        {
+                                for (int x = 0; x < 4; ++x)
+                                {
+                                        if (in_subblock(x, y, flip, subblock))
+                                                indices[x * 4 + y] = candidate[x * 4 + y];
+                                }
+                        }
+                }
+        }
+
+        return best_error;
+}
+
+void etc_average(const Block block, bool flip, int subblock, float average[3])
+{
+        average[0] = average[1] = average[2] = 0.f;
+        for (int y = 0; y < 4; ++y)
+        {
+                for (int x = 0; x < 4; ++x)
+                {
+                        if (!in_subblock(x, y, flip, subblock))
+                                continue;
+
+                        for (int c = 0; c < 3; ++c)
+                                average[c] += block[y * 4 + x][c] / 8.f;
+                }
+        }
+}
+
+int quantize(float value, int max)
+{
+        return std::min(max, std::max(0, (int)std::lround(value * max / 255.f)));
+}
+
+int expand_4(int value)
+{
+        return value << 4 | value;
+}
+
+int expand_5(int value)
+{
+        return value << 3 | value >> 2;
+}
+
+// Searches the quantized colors around the subblock average, with bits
+// of precision per channel
+int etc_fit_base(const Block block, bool flip, int subblock, int bits, int quantized[3],
+                 int &table, uint8_t indices[16])
+{
+        int max = (1 << bits) - 1;
+        float average[3];
+        etc_average(block, flip, subblock, average);
+
+        int center[3];
+        for (int c = 0; c < 3; ++c)
+                center[c] = quantize(average[c], max);
+
+        int best_error = std::numeric_limits<int>::max();
+        uint8_t candidate[16];
+        for (int offset = 0; offset < 27; ++offset)
+        {
+                int q[3] = {center[0] + offset % 3 - 1, center[1] + offset / 3 % 3 - 1,
+                            center[2] + offset / 9 - 1};
+                if (std::min(q[0], std::min(q[1], q[2])) < 0 ||
+                    std::max(q[0], std::max(q[1], q[2])) > max)
+                        continue;
+
+                int base[3];
+                for (int c = 0; c < 3; ++c)
+                        base[c] = bits == 4 ? expand_4(q[c]) : expand_5(q[c]);
+
+                int t = 0;
+                int error = etc_fit_subblock(block, flip, subblock, base, t, candidate);
+                if (error < best_error)
+                {
+                        best_error = error;
+                        table = t;
+                        memcpy(quantized, q, sizeof(q));
+                        for (int y = 0; y < 4; ++y)
+                        {
+                                for (int x = 0; x < 4; ++x)
+                                {
+                                        if (in_subblock(x, y, flip, subblock))
+                                                indices[x * 4 + y] = candidate[x * 4 + y];
+                                }
+                        }
+                }
+        }
+
+        return best_error;
+}
+
+void encode_etc(const Block block, unsigned char out[8])
+{
+        int best_error = std::numeric_limits<int>::max();
+        for (int flip = 0; flip < 2; ++flip)
+        {
+                for (int differential = 0; differential < 2; ++differential)
+                {
+                        int bits = differential ? 5 : 4;
+                        int quantized[2][3];
+                        int tables[2] = {};
+                        uint8_t indices[16] = {};
+                        int error = etc_fit_base(block, flip, 0, bits, quantized[0], tables[0], indices) +
+                                    etc_fit_base(block, flip, 1, bits, quantized[1], tables[1], indices);
+
+                        // The second color is a 3 bit signed delta, the
+                        // individual mode covers blocks where it doesn't fit
+                        bool valid = true;
+                        for (int c = 0; c < 3 && differential; ++c)
+                        {
+                                int delta = quantized[1][c] - quantized[0][c];
+                                valid = valid && delta >= -4 && delta <= 3;
+                        }
+
+                        if (!valid || error >= best_error)
+                                continue;
+
+                        best_error = error;
+                        for (int c = 0; c < 3; ++c)
+                        {
+                                if (differential)
+                                        out[c] = (unsigned char)(quantized[0][c] << 3 |
+                                                                 ((quantized[1][c] - quantized[0][c]) & 7));
+                                else
+                                        out[c] = (unsigned char)(quantized[0][c] << 4 | quantized[1][c]);
+                        }
+
+                        out[3] = (unsigned char)(tables[0] << 5 | tables[1] << 2 | differential << 1 | flip);
+
+                        uint32_t index_bits = 0;
+                        for (int i = 0; i < 16; ++i)
+                        {
+                                index_bits |= (uint32_t)(indices[i] & 1) << i;
+                                index_bits |= (uint32_t)(indices[i] >> 1) << (i + 16);
+                        }
+
+                        out[4] = (unsigned char)(index_bits >> 24);
+                        out[5] = (unsigned char)(index_bits >> 16);
+                        out[6] = (unsigned char)(index_bits >> 8);
+                        out[7] = (unsigned char)index_bits;
+                }
+        }
+}
+
+int etc_index(const unsigned char in[8], int x, int y)
+{
+        int i = x * 4 + y;
+        uint32_t bits = (uint32_t)in[4] << 24 | (uint32_t)in[5] << 16 | (uint32_t)in[6] << 8 | in[7];
+
+        return (int)((bits >> i) & 1) | (int)((bits >> (i + 16)) & 1) << 1;
+}
+
+int signed_3(int value)
+{
+        return value & 4 ? value - 8 : value;
+}
+
+// T and H modes paint every pixel with one of four colors
+void decode_etc_paint(const unsigned char in[8], const int paint[4][3], Block block)
+{
+        for (int y = 0; y < 4; ++y)
+        {
+                for (int x = 0; x < 4; ++x)
+                {
+                        const int *color = paint[etc_index(in, x, y)];
+                        for (int c = 0; c < 3; ++c)
+                                block[y * 4 + x][c] = (unsigned char)clamp_byte(color[c]);
+                        block[y * 4 + x][3] = 255;
+                }
+        }
+}
+
+void decode_etc(const unsigned char in[8], Block block)
+{
+        static const int distances[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+        bool differential = in[3] & 2;
+        bool flip = in[3] & 1;
+        int base[2][3];
+
+        if (!differential)
+        {
+                for (int c = 0; c < 3; ++c)
+                {
+                        base[0][c] = expand_4(in[c] >> 4);
+                        base[1][c] = expand_4(in[c] & 0xF);
+                }
+        }
+        else
+        {
+                int r = in[0] >> 3, dr = signed_3(in[0] & 7);
+                int g = in[1] >> 3, dg = signed_3(in[1] & 7);
+                int b = in[2] >> 3, db = signed_3(in[2] & 7);
+
+                if (r + dr < 0 || r + dr > 31)
+                {
+                        // T mode
+                        int c1[3] = {expand_4(((in[0] >> 1) & 0xC) | (in[0] & 3)),
+                                     expand_4(in[1] >> 4), expand_4(in[1] & 0xF)};
+                        int c2[3] = {expand_4(in[2] >> 4), expand_4(in[2] & 0xF),
+                                     expand_4(in[3] >> 4)};
+                        int d = distances[((in[3] >> 1) & 6) | (in[3] & 1)];
+
+                        int paint[4][3];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                                paint[0][c] = c1[c];
+                                paint[1][c] = c2[c] + d;
+                                paint[2][c] = c2[c];
+                                paint[3][c] = c2[c] - d;
+                        }
+
+                        decode_etc_paint(in, paint, block);
+                        return;
+                }
+
+                if (g + dg < 0 || g + dg > 31)
+                {
+                        // H mode
+                        int r1 = (in[0] >> 3) & 0xF;
+                        int g1 = (in[0] & 7) << 1 | ((in[1] >> 4) & 1);
+                        int b1 = (in[1] & 8) | (in[1] & 3) << 1 | in[2] >> 7;
+                        int r2 = (in[2] >> 3) & 0xF;
+                        int g2 = (in[2] & 7) << 1 | in[3] >> 7;
+                        int b2 = (in[3] >> 3) & 0xF;
+
+                        int order = (r1 << 8 | g1 << 4 | b1) >= (r2 << 8 | g2 << 4 | b2);
+                        int d = distances[(in[3] & 4) | (in[3] & 1) << 1 | order];
+
+                        int c1[3] = {expand_4(r1), expand_4(g1), expand_4(b1)};
+                        int c2[3] = {expand_4(r2), expand_4(g2), expand_4(b2)};
+
+                        int paint[4][3];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                                paint[0][c] = c1[c] + d;
+                                paint[1][c] = c1[c] - d;
+                                paint[2][c] = c2[c] + d;
+                                paint[3][c] = c2[c] - d;
+                        }
+
+                        decode_etc_paint(in, paint, block);
+                        return;
+                }
+
+                if (b + db < 0 || b + db > 31)
+                {
+                        // Planar mode, three colors interpolated over the block
+                        int ro = (in[0] >> 1) & 0x3F;
+                        int go = (in[0] & 1) << 6 | ((in[1] >> 1) & 0x3F);
+                        int bo = (in[1] & 1) << 5 | (in[2] & 0x18) | (in[2] & 3) << 1 | in[3] >> 7;
+                        int rh = ((in[3] >> 1) & 0x3E) | (in[3] & 1);
+                        int gh = in[4] >> 1;
+                        int bh = (in[4] & 1) << 5 | in[5] >> 3;
+                        int rv = (in[5] & 7) << 3 | in[6] >> 5;
+                        int gv = (in[6] & 0x1F) << 2 | in[7] >> 6;
+                        int bv = in[7] & 0x3F;
+
+                        int o[3] = {ro << 2 | ro >> 4, go << 1 | go >> 6, bo << 2 | bo >> 4};
+                        int h[3] = {rh << 2 | rh >> 4, gh << 1 | gh >> 6, bh << 2 | bh >> 4};
+                        int v[3] = {rv << 2 | rv >> 4, gv << 1 | gv >> 6, bv << 2 | bv >> 4};
+
+                        for (int y = 0; y < 4; ++y)
+                        {
+                                for (int x = 0; x < 4; ++x)
+                                {
+                                        for (int c = 0; c < 3; ++c)
+                                                block[y * 4 + x][c] = (unsigned char)clamp_byte(
+                                                    (x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2);
+                                        block[y * 4 + x][3] = 255;
+                                }
+                        }
+                        return;
+                }
+
+                int deltas[3] = {dr, dg, db};
+                int colors[3] = {r, g, b};
+                for (int c = 0; c < 3; ++c)
+                {
+                        base[0][c] = expand_5(colors[c]);
+                        base[1][c] = expand_5(colors[c] + deltas[c]);
+                }
+        }
+
+        int tables[2] = {in[3] >> 5, (in[3] >> 2) & 7};
+        for (int y = 0; y < 4; ++y)
+        {
+                for (int x = 0; x < 4; ++x)
+                {
+                        int subblock = in_subblock(x, y, flip, 1) ? 1 : 0;
+                        int modifier = etc_modifier(tables[subblock], etc_index(in, x, y));
+                        for (int c = 0; c < 3; ++c)
+                                block[y * 4 + x][c] = (unsigned char)clamp_byte(base[subblock][c] + modifier);
+                        block[y * 4 + x][3] = 255;
+                }
+        }
+}
+}
+
+size_t block_size(BlockFormat format)
+{
+        return format == BlockFormat::BC1 || format == BlockFormat::ETC2_RGB ? 8 : 16;
+}
+
+size_t compressed_size(BlockFormat format, int width, int height)
+{
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_size(format);
+}
+
+int block_channels(BlockFormat format)
+{
+        switch (format)
+        {
+        case BlockFormat::BC3:
+                return 4;
+        case BlockFormat::BC5:
+                return 2;
+        default:
+                return 3;
+        }
+}
+
+const char *block_format_name(BlockFormat format)
+{
+        switch (format)
+        {
+        case BlockFormat::BC1:
+                return "bc1";
+        case BlockFormat::BC3:
+                return "bc3";
+        case BlockFormat::BC5:
+                return "bc5";
+        default:
+                return "etc2";
+        }
+}
+
+bool parse_block_format(const char *name, BlockFormat &format)
+{
+        for (BlockFormat candidate : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5,
+                                      BlockFormat::ETC2_RGB})
+        {
+                if (strcmp(name, block_format_name(candidate)) == 0)
+                {
+                        format = candidate;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+GLenum block_gl_format(BlockFormat format, bool srgb)
+{
+        switch (format)
+        {
+        case BlockFormat::BC1:
+                return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3:
+                return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC5:
+                return GL_COMPRESSED_RG_RGTC2;
+        default:
+                return srgb ? GL_COMPRESSED_SRGB8_ETC2 : GL_COMPRESSED_RGB8_ETC2;
+        }
+}
+
+// The sRGB VkFormat of each follows its UNORM one
+uint32_t block_vk_format(BlockFormat format, bool srgb)
+{
+        switch (format)
+        {
+        case BlockFormat::BC1:
+                return srgb ? 132 : 131; // VK_FORMAT_BC1_RGB_SRGB_BLOCK, _UNORM_BLOCK
+        case BlockFormat::BC3:
+                return srgb ? 138 : 137; // VK_FORMAT_BC3_SRGB_BLOCK, _UNORM_BLOCK
+        case BlockFormat::BC5:
+                return 141; // VK_FORMAT_BC5_UNORM_BLOCK
+        default:
+                return srgb ? 148 : 147; // VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, _UNORM_BLOCK
+        }
+}
+
+bool block_format_from_vk(uint32_t vk_format, BlockFormat &format, bool *srgb)
+{
+        for (BlockFormat candidate : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5,
+                                      BlockFormat::ETC2_RGB})
+        {
+                for (bool candidate_srgb : {false, true})
+                {
+                        if (block_vk_format(candidate, candidate_srgb) == vk_format)
+                        {
+                                format = candidate;
+                                if (srgb)
+                                        *srgb = candidate_srgb && candidate != BlockFormat::BC5;
+                                return true;
+                        }
+                }
+        }
+
+        return false;
+}
+
+void compress_blocks(BlockFormat format, const unsigned char *rgba, int width,
+                     int height, unsigned char *out)
+{
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        for (int by = 0; by < blocks_y; ++by)
+        {
+                for (int bx = 0; bx < blocks_x; ++bx)
+                {
+                        Block block;
+                        fetch_block(rgba, width, height, bx, by, block);
+
+                        switch (format)
+                        {
+                        case BlockFormat::BC1:
+                                encode_bc1(block, out);
+                                break;
+                        case BlockFormat::BC3:
+                                encode_bc4(block, 3, out);
+                                encode_bc1(block, out + 8);
+                                break;
+                        case BlockFormat::BC5:
+                                encode_bc4(block, 0, out);
+                                encode_bc4(block, 1, out + 8);
+                                break;
+                        case BlockFormat::ETC2_RGB:
+                                encode_etc(block, out);
+                                break;
+                        }
+
+                        out += block_size(format);
+                }
+        }
+}
+
+void decompress_blocks(BlockFormat format, const unsigned char *blocks, int width,
+                       int height, unsigned char *rgba)
+{
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        for (int by = 0; by < blocks_y; ++by)
+        {
+                for (int bx = 0; bx < blocks_x; ++bx)
+                {
+                        Block block;
+                        switch (format)
+                        {
+                        case BlockFormat::BC1:
+                                decode_bc1(blocks, true, block);
+                                break;
+                        case BlockFormat::BC3:
+                                decode_bc1(blocks + 8, false, block);
+                                decode_bc4(blocks, 3, block);
+                                break;
+                        case BlockFormat::BC5:
+                                for (auto &pixel : block)
+                                {
+                                        pixel[2] = 0;
+                                        pixel[3] = 255;
+                                }
+                                decode_bc4(blocks, 0, block);
+                                decode_bc4(blocks + 8, 1, block);
+                                break;
+                        case BlockFormat::ETC2_RGB:
+                                decode_etc(blocks, block);
+                                break;
+                        }
+
+                        store_block(block, width, height, bx, by, rgba);
+                        blocks += block_size(format);
+                }
+        }
+}
+
+double psnr(const unsigned char *a, const unsigned char *b, int width, int height,
+            int channels)
+{
+        double error = 0.;
+        size_t pixels = (size_t)width * height;
+        for (size_t i = 0; i < pixels; ++i)
+        {
+                for (int c = 0; c < channels; ++c)
+                {
+                        double d = (double)a[i * 4 + c] - b[i * 4 + c];
+                        error += d * d;
+                }
+        }
+
+        if (error == 0.)
+                return std::numeric_limits<double>::infinity();
+
+        double mse = error / ((double)pixels * channels);
+        return 10. * std::log10(255. * 255. / mse);
+}
@@ -1,3 +1,4 @@
+#include "gl_state.hpp"
 #include "callbacks.hpp"
 
 void processInputs(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -6,5 +7,5 @@ void processInputs(GLFWwindow *window, int key, int scancode, int action, int mo
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-	glViewport(0, 0, width, height);
+	GLState::viewport(0, 0, width, height);
 }
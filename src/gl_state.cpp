@@ -0,0 +1,361 @@
+#include "gl_state.hpp"
+
+namespace
+{
+constexpr unsigned int UNKNOWN = 0xFFFFFFFF;
+}
+
+unsigned int GLState::program;
+unsigned int GLState::vertex_array;
+unsigned int GLState::buffers[BUFFER_TARGET_COUNT];
+unsigned int GLState::active_unit;
+unsigned int GLState::textures[TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+unsigned int GLState::framebuffers[FRAMEBUFFER_TARGET_COUNT];
+int GLState::capabilities[CAPABILITY_COUNT];
+GLenum GLState::blend_factors[2];
+GLenum GLState::depth_function;
+int GLState::viewport_rect[4];
+
+GLState::Stats GLState::frame;
+GLState::Stats GLState::last_frame;
+
+namespace
+{
+// Force the first call of every kind through before main() runs
+struct Initializer
+{
+        Initializer() { GLState::invalidate(); }
+} initializer;
+}
+
+void GLState::use_program(unsigned int id)
+{
+        if (changed(program, id))
+                glUseProgram(id);
+}
+
+void GLState::bind_vertex_array(unsigned int id)
+{
+        if (changed(vertex_array, id))
+        {
+                glBindVertexArray(id);
+
+                // The element array binding belongs to the vertex array
+                buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN;
+        }
+}
+
+void GLState::bind_buffer(GLenum target, unsigned int id)
+{
+        int index;
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:
+                index = ARRAY_BUFFER;
+                break;
+        case GL_ELEMENT_ARRAY_BUFFER:
+                index = ELEMENT_ARRAY_BUFFER;
+                break;
+        case GL_UNIFORM_BUFFER:
+                index = UNIFORM_BUFFER;
+                break;
+        case GL_PIXEL_PACK_BUFFER:
+                index = PIXEL_PACK_BUFFER;
+                break;
+        case GL_PIXEL_UNPACK_BUFFER:
+                index = PIXEL_UNPACK_BUFFER;
+                break;
+        default:
+                ++frame.issued;
+                glBindBuffer(target, id);
+                return;
+        }
+
+        if (changed(buffers[index], id))
+                glBindBuffer(target, id);
+}
+
+void GLState::bind_buffer_range(GLenum target, unsigned int index,
+                                unsigned int id, GLintptr offset,
+                                GLsizeiptr size)
+{
+        // Indexed ranges move every frame with the uniform ring, only keep
+        // the generic binding they also set up to date
+        ++frame.issued;
+        glBindBufferRange(target, index, id, offset, size);
+
+        if (target == GL_UNIFORM_BUFFER)
+                buffers[UNIFORM_BUFFER] = id;
+}
+
+void GLState::active_texture(unsigned int unit)
+{
+        if (changed(active_unit, unit))
+                glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bind_texture(GLenum target, unsigned int id)
+{
+        int index;
+        switch (target)
+        {
+        case GL_TEXTURE_2D:
+                index = TEXTURE_2D;
+                break;
+        case GL_TEXTURE_2D_ARRAY:
+                index = TEXTURE_2D_ARRAY;
+                break;
+        default:
+                index = -1;
+                break;
+        }
+
+        if (index == -1 || active_unit >= TEXTURE_UNITS)
+        {
+                ++frame.issued;
+                glBindTexture(target, id);
+                return;
+        }
+
+        if (changed(textures[active_unit][index], id))
+                glBindTexture(target, id);
+}
+
+void GLState::bind_texture(unsigned int unit, GLenum target, unsigned int id)
+{
+        active_texture(unit);
+        bind_texture(target, id);
+}
+
+void GLState::bind_framebuffer(GLenum target, unsigned int id)
+{
+        switch (target)
+        {
+        case GL_READ_FRAMEBUFFER:
+                if (changed(framebuffers[READ_FRAMEBUFFER], id))
+                        glBindFramebuffer(target, id);
+                return;
+        case GL_DRAW_FRAMEBUFFER:
+                if (changed(framebuffers[DRAW_FRAMEBUFFER], id))
+                        glBindFramebuffer(target, id);
+                return;
+        default:
+                break;
+        }
+
+        if (framebuffers[READ_FRAMEBUFFER] == id && framebuffers[DRAW_FRAMEBUFFER] == id)
+        {
+                ++frame.eliminated;
+                return;
+        }
+
+        ++frame.issued;
+        framebuffers[READ_FRAMEBUFFER] = id;
+        framebuffers[DRAW_FRAMEBUFFER] = id;
+        glBindFramebuffer(target, id);
+}
+
+void GLState::enable(GLenum capability)
+{
+        set_capability(capability, true);
+}
+
+void GLState::disable(GLenum capability)
+{
+        set_capability(capability, false);
+}
+
+void GLState::blend_func(GLenum source, GLenum destination)
+{
+        if (blend_factors[0] == source && blend_factors[1] == destination)
+        {
+                ++frame.eliminated;
+                return;
+        }
+
+        ++frame.issued;
+        blend_factors[0] = source;
+        blend_factors[1] = destination;
+        glBlendFunc(source, destination);
+}
+
+void GLState::depth_func(GLenum function)
+{
+        if (changed(depth_function, function))
+                glDepthFunc(function);
+}
+
+void GLState::viewport(int x, int y, int width, int height)
+{
+        if (viewport_rect[0] == x && viewport_rect[1] == y &&
+            viewport_rect[2] == width && viewport_rect[3] == height)
+        {
+                ++frame.eliminated;
+                return;
+        }
+
+        ++frame.issued;
+        viewport_rect[0] = x;
+        viewport_rect[1] = y;
+        viewport_rect[2] = width;
+        viewport_rect[3] = height;
+        glViewport(x, y, width, height);
+}
+
+int GLState::unpack_alignment(size_t row_bytes)
+{
+        for (int alignment = 8; alignment > 1; alignment /= 2)
+                if (row_bytes % alignment == 0)
+                        return alignment;
+
+        return 1;
+}
+
+void GLState::delete_program(unsigned int id)
+{
+        if (program == id)
+                program = UNKNOWN;
+
+        glDeleteProgram(id);
+}
+
+void GLState::delete_vertex_array(unsigned int id)
+{
+        if (vertex_array == id)
+        {
+                vertex_array = UNKNOWN;
+                buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN;
+        }
+
+        glDeleteVertexArrays(1, &id);
+}
+
+void GLState::delete_buffer(unsigned int id)
+{
+        for (auto &buffer : buffers)
+        {
+                if (buffer == id)
+                        buffer = UNKNOWN;
+        }
+
+        glDeleteBuffers(1, &id);
+}
+
+void GLState::delete_texture(unsigned int id)
+{
+        for (auto &unit : textures)
+        {
+                for (auto &texture : unit)
+                {
+                        if (texture == id)
+                                texture = UNKNOWN;
+                }
+        }
+
+        glDeleteTextures(1, &id);
+}
+
+void GLState::delete_framebuffer(unsigned int id)
+{
+        for (auto &framebuffer : framebuffers)
+        {
+                if (framebuffer == id)
+                        framebuffer = UNKNOWN;
+        }
+
+        glDeleteFramebuffers(1, &id);
+}
+
+void GLState::invalidate()
+{
+        program = UNKNOWN;
+        vertex_array = UNKNOWN;
+        active_unit = UNKNOWN;
+        depth_function = UNKNOWN;
+
+        for (auto &buffer : buffers)
+                buffer = UNKNOWN;
+
+        for (auto &unit : textures)
+        {
+                for (auto &texture : unit)
+                        texture = UNKNOWN;
+        }
+
+        for (auto &framebuffer : framebuffers)
+                framebuffer = UNKNOWN;
+
+        for (auto &capability : capabilities)
+                capability = -1;
+
+        blend_factors[0] = UNKNOWN;
+        blend_factors[1] = UNKNOWN;
+
+        viewport_rect[0] = 0;
+        viewport_rect[1] = 0;
+        viewport_rect[2] = -1;
+        viewport_rect[3] = -1;
+}
+
+void GLState::end_frame()
+{
+        last_frame = frame;
+        frame = Stats{0, 0};
+}
+
+const GLState::Stats &GLState::frame_stats()
+{
+        return last_frame;
+}
+
+bool GLState::changed(unsigned int &cached, unsigned int value)
+{
+        if (cached == value)
+        {
+                ++frame.eliminated;
+                return false;
+        }
+
+        ++frame.issued;
+        cached = value;
+
+        return true;
+}
+
+void GLState::set_capability(GLenum capability, bool enabled)
+{
+        int index;
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:
+                index = DEPTH_TEST;
+                break;
+        case GL_BLEND:
+                index = BLEND;
+                break;
+        case GL_CULL_FACE:
+                index = CULL_FACE;
+                break;
+        case GL_SCISSOR_TEST:
+                index = SCISSOR_TEST;
+                break;
+        default:
+                index = -1;
+                break;
+        }
+
+        if (index != -1 && capabilities[index] == (int)enabled)
+        {
+                ++frame.eliminated;
+                return;
+        }
+
+        ++frame.issued;
+        if (index != -1)
+                capabilities[index] = (int)enabled;
+
+        if (enabled)
+                glEnable(capability);
+        else
+                glDisable(capability);
+}
@@ -0,0 +1,175 @@
+#include "image_arena.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// Each block starts with its size, which keeps the 16 byte alignment
+constexpr size_t ALIGNMENT = 16;
+constexpr size_t HEADER = 16;
+
+constexpr size_t MIN_CHUNK = 1 << 20;
+
+// Kept per thread between scopes, enough for a 4K RGBA PNG
+constexpr size_t MAX_RETAINED = 160 << 20;
+
+struct Chunk
+{
+        unsigned char *memory;
+        size_t size;
+        size_t used;
+};
+
+struct Arena
+{
+        std::vector<Chunk> chunks;
+        int depth = 0;
+
+        ~Arena()
+        {
+                for (auto &chunk : chunks)
+                        free(chunk.memory);
+        }
+};
+
+thread_local Arena arena;
+
+size_t round_up(size_t size)
+{
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t &block_size(void *block)
+{
+        return *(size_t *)((unsigned char *)block - HEADER);
+}
+
+Chunk *owner(void *block)
+{
+        unsigned char *bytes = (unsigned char *)block;
+        for (auto &chunk : arena.chunks)
+                if (bytes >= chunk.memory && bytes < chunk.memory + chunk.size)
+                        return &chunk;
+
+        return nullptr;
+}
+}
+
+ImageArena::Scope::Scope()
+{
+        ++arena.depth;
+}
+
+ImageArena::Scope::~Scope()
+{
+        if (--arena.depth > 0)
+                return;
+
+        size_t used = 0;
+        size_t capacity = 0;
+        for (auto &chunk : arena.chunks)
+        {
+                used += chunk.used;
+                capacity += chunk.size;
+                chunk.used = 0;
+        }
+
+        // Replaced by a single chunk the size of what the scope used, so
+        // the next image alike bumps through it and grows blocks in place
+        if (arena.chunks.size() > 1 || capacity > MAX_RETAINED)
+        {
+                for (auto &chunk : arena.chunks)
+                        free(chunk.memory);
+                arena.chunks.clear();
+
+                size_t size = std::min(used, MAX_RETAINED);
+                unsigned char *memory = size >= MIN_CHUNK ? (unsigned char *)malloc(size) : nullptr;
+                if (memory)
+                        arena.chunks.push_back(Chunk{memory, size, 0});
+        }
+}
+
+void *ImageArena::allocate(size_t size)
+{
+        if (arena.depth == 0)
+                return malloc(size);
+
+        size_t needed = HEADER + round_up(size);
+        Chunk *chunk = nullptr;
+        for (auto &candidate : arena.chunks)
+        {
+                if (candidate.size - candidate.used >= needed)
+                {
+                        chunk = &candidate;
+                        break;
+                }
+        }
+
+        if (!chunk)
+        {
+                // Doubling what the thread holds keeps the chunks few
+                size_t capacity = 0;
+                for (auto &candidate : arena.chunks)
+                        capacity += candidate.size;
+
+                size_t chunk_size = std::max(needed, std::max(MIN_CHUNK, capacity));
+                unsigned char *memory = (unsigned char *)malloc(chunk_size);
+                if (!memory)
+                        return nullptr;
+
+                arena.chunks.push_back(Chunk{memory, chunk_size, 0});
+                chunk = &arena.chunks.back();
+        }
+
+        void *block = chunk->memory + chunk->used + HEADER;
+        chunk->used += needed;
+        block_size(block) = size;
+
+        return block;
+}
+
+void *ImageArena::reallocate(void *block, size_t size)
+{
+        if (!block)
+                return allocate(size);
+
+        // Allocated before the scope or on no scope at all
+        Chunk *chunk = owner(block);
+        if (!chunk)
+                return realloc(block, size);
+
+        // The last block of a chunk grows where it is, like the zlib output
+        unsigned char *bytes = (unsigned char *)block;
+        size_t old_size = block_size(block);
+        if (bytes + round_up(old_size) == chunk->memory + chunk->used &&
+            bytes + round_up(size) <= chunk->memory + chunk->size)
+        {
+                chunk->used = (size_t)(bytes + round_up(size) - chunk->memory);
+                block_size(block) = size;
+                return block;
+        }
+
+        void *moved = allocate(size);
+        if (moved)
+                memcpy(moved, block, std::min(old_size, size));
+
+        return moved;
+}
+
+void ImageArena::release(void *block)
+{
+        if (block && !owner(block))
+                free(block);
+}
+
+size_t ImageArena::retained()
+{
+        size_t size = 0;
+        for (auto &chunk : arena.chunks)
+                size += chunk.size;
+
+        return size;
+}
@@ -0,0 +1,245 @@
+#include "image_source.hpp"
+
+#include "image_arena.hpp"
+#include "stb/stb_image.h"
+
+#include <climits>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+constexpr size_t TAR_BLOCK = 512;
+
+size_t parse_octal(const unsigned char *field, size_t size)
+{
+        size_t value = 0;
+        for (size_t i = 0; i < size && field[i] >= '0' && field[i] <= '7'; ++i)
+                value = value * 8 + (field[i] - '0');
+
+        return value;
+}
+
+std::string parse_string(const unsigned char *field, size_t size)
+{
+        const char *begin = (const char *)field;
+        return std::string(begin, strnlen(begin, size));
+}
+}
+
+ImageArchive::ImageArchive()
+{
+}
+
+bool ImageArchive::open(const std::string &filepath)
+{
+        entries.clear();
+        return file.open(filepath) && index();
+}
+
+bool ImageArchive::index()
+{
+        const unsigned char *bytes = file.data();
+        size_t length = file.size();
+        std::string long_name;
+
+        size_t offset = 0;
+        while (offset + TAR_BLOCK <= length)
+        {
+                const unsigned char *header = bytes + offset;
+
+                // Archives end with zeroed blocks
+                if (header[0] == 0)
+                        return true;
+
+                size_t size = parse_octal(header + 124, 12);
+                char type = (char)header[156];
+                size_t data = offset + TAR_BLOCK;
+                if (data > length || size > length - data)
+                        return false;
+
+                std::string name = long_name;
+                if (name.empty())
+                {
+                        name = parse_string(header, 100);
+                        if (memcmp(header + 257, "ustar", 5) == 0 && header[345])
+                                name = parse_string(header + 345, 155) + "/" + name;
+                }
+
+                if (name.compare(0, 2, "./") == 0)
+                        name.erase(0, 2);
+
+                if (type == 'L')
+                {
+                        // GNU long name of the next entry
+                        long_name = parse_string(bytes + data, size);
+                }
+                else
+                {
+                        if (type == '0' || type == '\0' || type == '7')
+                                entries[name] = Entry{data, size};
+                        long_name.clear();
+                }
+
+                offset = data + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        }
+
+        return true;
+}
+
+std::shared_ptr<const ImageArchive> ImageArchive::get(const std::string &filepath)
+{
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::weak_ptr<const ImageArchive>> archives;
+
+        std::string path = canonical_path(filepath);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::shared_ptr<const ImageArchive> shared = archives[path].lock();
+        if (shared)
+                return shared;
+
+        std::shared_ptr<ImageArchive> archive = std::make_shared<ImageArchive>();
+        if (!archive->open(path))
+        {
+                archives.erase(path);
+                return nullptr;
+        }
+
+        archives[path] = archive;
+        return archive;
+}
+
+bool ImageArchive::find(const std::string &name, const unsigned char *&data, size_t &size) const
+{
+        auto entry = entries.find(name);
+        if (entry == entries.end())
+                return false;
+
+        data = file.data() + entry->second.offset;
+        size = entry->second.size;
+
+        return true;
+}
+
+std::vector<std::string> ImageArchive::names() const
+{
+        std::vector<std::string> result;
+        for (auto &entry : entries)
+                result.push_back(entry.first);
+
+        return result;
+}
+
+const MappedFile &ImageArchive::get_file() const
+{
+        return file;
+}
+
+ImageSource::ImageSource() : bytes(nullptr), length(0)
+{
+}
+
+ImageSource::ImageSource(const std::string &filepath) : bytes(nullptr), length(0)
+{
+        open(filepath);
+}
+
+bool ImageSource::open(const std::string &filepath)
+{
+        close();
+
+        size_t split = filepath.find(".tar/");
+        if (split != std::string::npos)
+        {
+                archive = ImageArchive::get(filepath.substr(0, split + 4));
+                if (!archive || !archive->find(filepath.substr(split + 5), bytes, length))
+                {
+                        close();
+                        return false;
+                }
+
+                const MappedFile &shared = archive->get_file();
+                shared.advise_sequential((size_t)(bytes - shared.data()), length);
+
+                return true;
+        }
+
+        if (!file.open(filepath))
+                return false;
+
+        bytes = file.data();
+        length = file.size();
+        file.advise_sequential(0, length);
+
+        return true;
+}
+
+void ImageSource::close()
+{
+        file.close();
+        archive.reset();
+        bytes = nullptr;
+        length = 0;
+}
+
+bool ImageSource::is_open() const
+{
+        return file.is_open() || archive;
+}
+
+const unsigned char *ImageSource::data() const
+{
+        return bytes;
+}
+
+size_t ImageSource::size() const
+{
+        return length;
+}
+
+bool ImageSource::info(int *width, int *height, int *channels) const
+{
+        if (length > INT_MAX)
+                return false;
+
+        return stbi_info_from_memory(bytes, (int)length, width, height, channels) != 0;
+}
+
+unsigned char *ImageSource::load(int *width, int *height, int *channels, int desired_channels, bool flip,
+                                 int scale) const
+{
+        if (length > INT_MAX)
+                return nullptr;
+
+        stbi_load_options options = {};
+        options.flip_vertically = flip;
+        options.jpeg_scale_denom = scale;
+
+        return stbi_load_from_memory_ex(bytes, (int)length, width, height, channels, desired_channels, &options);
+}
+
+bool ImageSource::load_into(unsigned char *dest, int stride, size_t size, int *width, int *height, int *channels,
+                            int desired_channels, bool flip, int scale) const
+{
+        if (length > INT_MAX)
+                return false;
+
+        stbi_load_options options = {};
+        options.flip_vertically = flip;
+        options.jpeg_scale_denom = scale;
+
+        ImageArena::Scope scope;
+        return stbi_load_from_memory_into(bytes, (int)length, dest, stride, size, width, height, channels,
+                                          desired_channels, &options) != 0;
+}
+
+bool ImageSource::is_jpeg() const
+{
+        return length >= 2 && bytes[0] == 0xff && bytes[1] == 0xd8;
+}
+
+int ImageSource::scaled_size(int size, int scale)
+{
+        return (size + scale - 1) / scale;
+}
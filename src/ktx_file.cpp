@@ -0,0 +1,188 @@
+#include "ktx_file.hpp"
+
+#include "block_compression.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+const unsigned char IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Identifier, 9 header fields and the index of the optional sections
+constexpr size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+constexpr size_t LEVEL_INDEX_SIZE = 3 * 8;
+
+// Level data is aligned to the largest block size
+constexpr size_t LEVEL_ALIGNMENT = 16;
+
+uint64_t read_le(const unsigned char *bytes, int size)
+{
+        uint64_t value = 0;
+        for (int i = size - 1; i >= 0; --i)
+                value = value << 8 | bytes[i];
+
+        return value;
+}
+
+// Exact bytes of a level, 0 for formats nothing here can read
+size_t level_size(uint32_t vk_format, int width, int height)
+{
+        if (vk_format == KTX_FORMAT_RGBA8 || vk_format == KTX_FORMAT_RGBA8_SRGB)
+                return (size_t)width * height * 4;
+
+        BlockFormat format;
+        if (!block_format_from_vk(vk_format, format))
+                return 0;
+
+        return compressed_size(format, width, height);
+}
+
+void write_le(std::vector<unsigned char> &out, uint64_t value, int size)
+{
+        for (int i = 0; i < size; ++i)
+                out.push_back((unsigned char)(value >> (8 * i)));
+}
+}
+
+KtxImage::KtxImage() : vk_format(0), width(0), height(0)
+{
+}
+
+bool KtxImage::is_ktx(const unsigned char *bytes, size_t size)
+{
+        return size >= sizeof(IDENTIFIER) && memcmp(bytes, IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+}
+
+bool KtxImage::read(const unsigned char *bytes, size_t size)
+{
+        if (!read_index(bytes, size))
+                return false;
+
+        // Levels packed back to back, in the order of the index
+        size_t total = 0;
+        for (auto &level : levels)
+                total += level.size;
+        data.resize(total);
+
+        size_t position = 0;
+        for (auto &level : levels)
+        {
+                memcpy(data.data() + position, bytes + level.offset, level.size);
+                level.offset = position;
+                position += level.size;
+        }
+
+        return true;
+}
+
+bool KtxImage::read_index(const unsigned char *bytes, size_t size)
+{
+        if (size < HEADER_SIZE || !is_ktx(bytes, size))
+                return false;
+
+        const unsigned char *header = bytes + sizeof(IDENTIFIER);
+        vk_format = (uint32_t)read_le(header, 4);
+        width = (int)read_le(header + 8, 4);
+        height = (int)read_le(header + 12, 4);
+        uint32_t depth = (uint32_t)read_le(header + 16, 4);
+        uint32_t layers = (uint32_t)read_le(header + 20, 4);
+        uint32_t faces = (uint32_t)read_le(header + 24, 4);
+        uint32_t level_count = (uint32_t)read_le(header + 28, 4);
+        uint32_t supercompression = (uint32_t)read_le(header + 32, 4);
+
+        if (depth > 1 || layers > 1 || faces != 1 || supercompression != 0 ||
+            width <= 0 || height <= 0)
+                return false;
+
+        // 0 asks the loader to generate mipmaps, there is still one level
+        if (level_count == 0)
+                level_count = 1;
+
+        // Down to 1x1 at most
+        uint32_t max_levels = 1;
+        while ((width | height) >> max_levels)
+                ++max_levels;
+        if (level_count > max_levels)
+                return false;
+
+        if (size < HEADER_SIZE + level_count * LEVEL_INDEX_SIZE)
+                return false;
+
+        levels.clear();
+        data.clear();
+        const unsigned char *index = bytes + HEADER_SIZE;
+        for (uint32_t i = 0; i < level_count; ++i)
+        {
+                uint64_t offset = read_le(index + i * LEVEL_INDEX_SIZE, 8);
+                uint64_t length = read_le(index + i * LEVEL_INDEX_SIZE + 8, 8);
+                if (offset > size || length > size - offset)
+                        return false;
+
+                Level level;
+                level.offset = (size_t)offset;
+                level.size = (size_t)length;
+                level.width = width >> i > 0 ? width >> i : 1;
+                level.height = height >> i > 0 ? height >> i : 1;
+
+                // Readers upload and decode the whole level from its size
+                size_t expected = level_size(vk_format, level.width, level.height);
+                if (!expected || level.size != expected)
+                        return false;
+
+                levels.push_back(level);
+        }
+
+        return true;
+}
+
+bool KtxImage::write(const std::string &filepath) const
+{
+        std::vector<unsigned char> out(IDENTIFIER, IDENTIFIER + sizeof(IDENTIFIER));
+        write_le(out, vk_format, 4);
+        write_le(out, 1, 4); // typeSize, 1 for block formats
+        write_le(out, width, 4);
+        write_le(out, height, 4);
+        write_le(out, 0, 4); // pixelDepth
+        write_le(out, 0, 4); // layerCount
+        write_le(out, 1, 4); // faceCount
+        write_le(out, levels.size(), 4);
+        write_le(out, 0, 4); // supercompressionScheme
+        for (int i = 0; i < 4; ++i)
+                write_le(out, 0, 4); // No data format descriptor nor key/values
+        write_le(out, 0, 8);
+        write_le(out, 0, 8);
+
+        // The format stores the smallest level first
+        size_t position = HEADER_SIZE + levels.size() * LEVEL_INDEX_SIZE;
+        std::vector<size_t> offsets(levels.size());
+        for (size_t i = levels.size(); i-- > 0;)
+        {
+                position = (position + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+                offsets[i] = position;
+                position += levels[i].size;
+        }
+
+        for (size_t i = 0; i < levels.size(); ++i)
+        {
+                write_le(out, offsets[i], 8);
+                write_le(out, levels[i].size, 8);
+                write_le(out, levels[i].size, 8); // uncompressedByteLength
+        }
+
+        for (size_t i = levels.size(); i-- > 0;)
+        {
+                out.resize(offsets[i], 0);
+                out.insert(out.end(), data.begin() + levels[i].offset,
+                           data.begin() + levels[i].offset + levels[i].size);
+        }
+
+        FILE *file = fopen(filepath.c_str(), "wb");
+        if (!file)
+                return false;
+
+        bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+        written = fclose(file) == 0 && written;
+
+        return written;
+}
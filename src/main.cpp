@@ -1,17 +1,31 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include "stb/stb_image.h"
 #include "callbacks.hpp"
+#include "gl_state.hpp"
 #include "shader.hpp"
+#include "shader_batch.hpp"
+#include "shader_variants.hpp"
+#include "shader_watcher.hpp"
+#include "texture_atlas.hpp"
+#include "texture_manager.hpp"
+#include "uniform_buffer.hpp"
+#include "vertex_array_cache.hpp"
+#include "vertex_layout.hpp"
+#include "virtual_texture.hpp"
 
 constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGHT = 640;
@@ -19,16 +33,66 @@ constexpr int WINDOW_HEIGHT = 640;
 void usage(const char *command, bool error = false)
 {
 	std::stringstream message;
-	message << "Usage : " << command << " SHADER_FILE [TEXTURE_FILES]"
-			<< "\n";
+	message << "Usage : " << command << " [-D KEYWORD]... [-m MAX_TEXTURE_SIZE] [-b BUDGET_MIB] SHADER_FILE [TEXTURE_FILES]"
+			<< "\n"
+			<< "-b is ignored by variants with the ARRAY keyword, their texture array needs every level\n";
 	if (error)
 		std::cerr << message.str();
 	else
 		std::cout << message.str();
 }
 
+// Pixels the triangles cover once transformed, halved since the faces of
+// a closed mesh turned away cover the same silhouette as those facing the
+// camera. Triangles crossing the near plane are left out.
+float projected_area(const float *vertices, int stride, const unsigned int *indices, int index_count,
+					 const glm::mat4 &transform, int width, int height)
+{
+	float area = 0.f;
+	for (int i = 0; i + 2 < index_count; i += 3)
+	{
+		glm::vec2 corners[3];
+		bool visible = true;
+		for (int j = 0; j < 3; ++j)
+		{
+			const float *position = vertices + indices[i + j] * stride;
+			glm::vec4 clip = transform * glm::vec4(position[0], position[1], position[2], 1.f);
+			visible = visible && clip.w > 0.f;
+			corners[j] = glm::vec2(clip) / clip.w;
+		}
+
+		if (visible)
+		{
+			glm::vec2 u = corners[1] - corners[0], v = corners[2] - corners[0];
+			area += 0.5f * std::abs(u.x * v.y - u.y * v.x);
+		}
+	}
+
+	// From normalized device coordinates, 2 units on each side
+	return std::min(area * 0.5f * width * height / 4.f, (float)width * height);
+}
+
 int main(int argc, char *argv[])
 {
+	// Keywords selecting the shader variant, the largest side JPEGs are
+	// decoded at and the texture memory budget, the remaining arguments
+	// are shifted so the shader file is argv[1] again
+	std::vector<std::string> keywords;
+	int max_texture_size = 0;
+	size_t texture_budget = 0;
+	while (argc >= 3 && (strcmp(argv[1], "-D") == 0 || strcmp(argv[1], "-m") == 0 || strcmp(argv[1], "-b") == 0))
+	{
+		if (strcmp(argv[1], "-D") == 0)
+			keywords.push_back(argv[2]);
+		else if (strcmp(argv[1], "-m") == 0)
+			max_texture_size = atoi(argv[2]);
+		else
+			texture_budget = (size_t)atoi(argv[2]) * 1024 * 1024;
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
 	// Check if we passed shader to the program
 	if (argc == 1)
 	{
@@ -77,245 +141,414 @@ int main(int argc, char *argv[])
 	}
 
 	// Setting the viewport and callbacks
-	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+	GLState::viewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetKeyCallback(window, processInputs);
 
-	// Get the texture if passed to the program
-	int width, height, nb_channels;
-	unsigned char *texture_data = nullptr;
-	unsigned int textures[2];
-	bool use_texture = false;
-
-	if (argc >= 3)
+	// Everything holding GL objects goes before the context does
 	{
-		stbi_set_flip_vertically_on_load(true);
-
-		texture_data = stbi_load(argv[2], &width, &height, &nb_channels, 0);
-
-		if (texture_data)
-		{
-			glGenTextures(2, textures);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, textures[0]);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, (strstr(argv[2], ".jpg") != nullptr) ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, texture_data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			stbi_image_free(texture_data);
-			texture_data = nullptr;
-			use_texture = true;
-		}
-		else
+		// Submit the shader program, reusing the binary linked by a previous
+		// run when the driver accepts it. It compiles while the textures load.
+		ProgramCache program_cache("shader_cache");
+		Shader::set_program_cache(&program_cache);
+
+		// Camera matrices shared by every program declaring the Camera block,
+		// registered before linking so the programs pick up its binding
+		UniformBuffer camera_buffer("Camera", CAMERA_BINDING, sizeof(CameraBlock));
+
+		ShaderBatch shader_batch;
+		ShaderVariants shader_variants(argv[1]);
+		uint32_t variant = shader_variants.mask(keywords);
+
+		// Files declaring a FEEDBACK keyword sample a virtual texture, their
+		// feedback variant draws the scene again to tell which tiles it needs
+		const std::vector<std::string> &declared = shader_variants.keywords();
+		bool is_virtual = std::find(declared.begin(), declared.end(), "FEEDBACK") != declared.end();
+		uint32_t feedback_variant = is_virtual ? variant | shader_variants.mask({"FEEDBACK"}) : variant;
+		is_virtual = is_virtual && feedback_variant != variant;
+
+		std::vector<uint32_t> variants = {variant};
+		if (is_virtual)
+			variants.push_back(feedback_variant);
+		shader_variants.prewarm(variants, shader_batch);
+
+		Shader &shaders = shader_variants.get(variant);
+		Shader &feedback_shaders = shader_variants.get(feedback_variant);
+
+		// Texture arrays copy level 0 of the textures once they are loaded,
+		// the budget would have evicted it by then
+		bool is_array_variant = std::find(declared.begin(), declared.end(), "ARRAY") != declared.end() &&
+								(variant & shader_variants.mask({"ARRAY"}));
+		if (texture_budget && is_array_variant)
 		{
-			std::cerr << "Error while loading texture \"" << argv[2] << "\""
-					  << "\n";
-			return 1;
+			std::cerr << "The texture budget doesn't apply to texture arrays, ignoring it" << std::endl;
+			texture_budget = 0;
 		}
 
-		if (argc == 4)
+		// Textures decode on worker threads and show a placeholder until
+		// they are uploaded, the same image given twice is loaded once
+		TextureManager texture_manager;
+		texture_manager.set_max_size(max_texture_size);
+		texture_manager.set_budget(texture_budget);
+		Texture textures[2];
+		bool use_texture = argc >= 3 && !is_virtual;
+
+		// Or the first texture file is streamed in tiles, see VirtualTexture
+		std::unique_ptr<VirtualTexture> virtual_texture;
+		if (is_virtual && argc >= 3)
 		{
-			texture_data = stbi_load(argv[3], &width, &height, &nb_channels, 0);
+			virtual_texture.reset(new VirtualTexture());
+			if (!virtual_texture->open(argv[2]))
+				virtual_texture.reset();
+		}
 
-			if (texture_data)
+		for (int i = 2; i < argc && i < 4 && use_texture; ++i)
+			textures[i - 2] = texture_manager.acquire(argv[i]);
+		bool textures_reported = !use_texture;
+
+		// Variants sampling a texture array get both textures copied into
+		// one once they are loaded, a single bind then covers every draw
+		TextureAtlas atlas;
+		unsigned int texture_array = 0;
+		bool is_array = false;
+
+		float vertices[] = {
+			/* x      y     z        color         texture coords  */
+			0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,	  // top right
+			0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,  // bottom right
+			-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, // bottom left
+			-0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,  // bottom right
+
+			0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+			0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+			-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+			-0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+
+			-0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+			-0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+			-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+			-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+
+			0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+			0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+			0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+			0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+
+			0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+			0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+			-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+			-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+
+			0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+			0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+			-0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+			-0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+		};
+
+		unsigned int indices[] = {
+			0, 1, 2,
+			0, 2, 3,
+
+			4, 5, 6,
+			4, 6, 7,
+
+			8, 9, 10,
+			8, 10, 11,
+
+			12, 13, 14,
+			12, 14, 15,
+
+			16, 17, 18,
+			16, 18, 19,
+
+			20, 21, 22,
+			20, 22, 23,
+		};
+
+		std::vector<glm::vec3> cubes_positions({
+			glm::vec3( 0.0f,  0.0f,  0.0f), 
+			glm::vec3( 2.0f,  5.0f, -15.0f), 
+			glm::vec3(-1.5f, -2.2f, -2.5f),  
+			glm::vec3(-3.8f, -2.0f, -12.3f),  
+			glm::vec3( 2.4f, -0.4f, -3.5f),  
+			glm::vec3(-1.7f,  3.0f, -7.5f),  
+			glm::vec3( 1.3f, -2.0f, -2.5f),  
+			glm::vec3( 1.5f,  2.0f, -2.5f), 
+			glm::vec3( 1.5f,  0.2f, -1.5f), 
+			glm::vec3(-1.3f,  1.0f, -1.5f),
+		});
+
+		unsigned int VBO, EBO; // VBO = Vertex Buffer Object
+							   // EBO = Element Buffer Object
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		// Fill the VBO
+		GLState::bind_buffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+		// Fill the EBO, through a target that isn't part of the vertex array
+		// state since no vertex array is bound yet
+		GLState::bind_buffer(GL_COPY_WRITE_BUFFER, EBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		// Interleaved position, color and texture coordinates, matched by name
+		// against the inputs of the program
+		VertexLayout layout;
+		layout.add("position", 3)
+			.add("color", 3)
+			.add("texture_coord", 2);
+
+		VertexArrayCache vertex_arrays;
+		unsigned int VAO = 0; // VAO = Vertex Array Object
+		unsigned int feedback_VAO = 0;
+
+		bool is_transform = false;
+		bool is_projection = false;
+
+		UniformHandle u_transform;
+		UniformHandle u_model;
+		UniformHandle u_feedback_model;
+
+		// Where each texture landed in the array, nothing before it is built
+		auto set_regions = [&]() {
+			texture_array = 0;
+			for (int i = 0; i < 2; ++i)
 			{
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, textures[1]);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, (strstr(argv[3], ".jpg") != nullptr) ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, texture_data);
-				glGenerateMipmap(GL_TEXTURE_2D);
+				TextureAtlas::Region region;
+				if (!atlas.find(textures[i].get_id(), region))
+					continue;
+
+				if (texture_array && region.array != texture_array)
+				{
+					std::cerr << "The textures don't share a format, only one array is bound" << std::endl;
+					continue;
+				}
+				texture_array = region.array;
+
+				std::string index = std::to_string(i + 1);
+				shaders.set_vec4("texture_rect" + index,
+								 glm::vec4(region.offset[0], region.offset[1], region.scale[0], region.scale[1]));
+				shaders.set_float("texture_layer" + index, (float)region.layer);
+			}
+		};
 
-				stbi_image_free(texture_data);
-				texture_data = nullptr;
+		// Everything tied to the program object, run again after a hot reload
+		auto setup_program = [&]() {
+			if (virtual_texture)
+			{
+				feedback_VAO = vertex_arrays.bind(layout, feedback_shaders, VBO, EBO);
+				feedback_shaders.use();
+				virtual_texture->set_uniforms(feedback_shaders, 0, 1);
+				u_feedback_model = feedback_shaders.uniform("u_model");
 			}
-			else
+
+			// Attributes the variant doesn't read are left out
+			VAO = vertex_arrays.bind(layout, shaders, VBO, EBO);
+
+			shaders.use();
+
+			// Setting the textures
+			if (use_texture)
 			{
-				std::cerr << "Error while loading texture \"" << argv[3] << "\""
-						  << "\n";
-				return 1;
+				is_array = shaders.uniform("texture_array").valid();
+				if (is_array)
+				{
+					shaders.set_int("texture_array", 0);
+					set_regions();
+				}
+				else
+				{
+					shaders.set_int("texture_data1", 0);
+					shaders.set_int("texture_data2", 1);
+				}
 			}
-		}
-	}
 
-	// Build and compile the vertex shader program
-	Shader shaders(argv[1]);
-
-	float vertices[] = {
-		/* x      y     z        color         texture coords  */
-		0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,	  // top right
-		0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,  // bottom right
-		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, // bottom left
-		-0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,  // bottom right
-
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-
-		-0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-
-		0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-		0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-
-		0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-
-		0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		-0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-	};
-
-	unsigned int indices[] = {
-		0, 1, 2,
-		0, 2, 3,
-
-		4, 5, 6,
-		4, 6, 7,
-
-		8, 9, 10,
-		8, 10, 11,
-
-		12, 13, 14,
-		12, 14, 15,
-
-		16, 17, 18,
-		16, 18, 19,
-
-		20, 21, 22,
-		20, 22, 23,
-	};
-
-	std::vector<glm::vec3> cubes_positions({
-		glm::vec3( 0.0f,  0.0f,  0.0f), 
-		glm::vec3( 2.0f,  5.0f, -15.0f), 
-		glm::vec3(-1.5f, -2.2f, -2.5f),  
-		glm::vec3(-3.8f, -2.0f, -12.3f),  
-		glm::vec3( 2.4f, -0.4f, -3.5f),  
-		glm::vec3(-1.7f,  3.0f, -7.5f),  
-		glm::vec3( 1.3f, -2.0f, -2.5f),  
-		glm::vec3( 1.5f,  2.0f, -2.5f), 
-		glm::vec3( 1.5f,  0.2f, -1.5f), 
-		glm::vec3(-1.3f,  1.0f, -1.5f),
-	});
-
-	unsigned int VBO, VAO, EBO; // VBO = Vertex Buffer Object
-								// VAO = Vertex Array Object
-								// EBO = Element Buffer Object
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	// Bind the VAO to the current Vertex Array Object
-	glBindVertexArray(VAO);
-
-	// Bind the VBO to the current Vertex Buffer Object + fills it
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// Attribution of an index for each Vertex Shader inputs
-	unsigned int posAttrib = glGetAttribLocation(shaders.get_program_id(), "position");
-	unsigned int colorAttrib = glGetAttribLocation(shaders.get_program_id(), "color");
-	unsigned int textureAttrib = glGetAttribLocation(shaders.get_program_id(), "texture_coord");
-
-	// Attribution of the position data
-	glEnableVertexAttribArray(posAttrib);
-	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-
-	// Attribution of the color data
-	glEnableVertexAttribArray(colorAttrib);
-	glVertexAttribPointer(colorAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-
-	// Attribution of the texture data
-	glEnableVertexAttribArray(textureAttrib);
-	glVertexAttribPointer(textureAttrib, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-	// glBindTexture(GL_TEXTURE_2D, texture);
-
-	// Bind the EBO to the current Element Buffer Object + fills it
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	shaders.use();
-
-	// Setting the textures
-	if (use_texture)
-	{
-		shaders.set_int("texture_data1", 0);
-		shaders.set_int("texture_data2", 1);
-	}
+			if (virtual_texture)
+				virtual_texture->set_uniforms(shaders, 0, 1);
 
-	bool is_transform = false;
-	bool is_projection = false;
+			// The variant tells how vertices are transformed
+			u_transform = shaders.uniform("u_transform");
+			u_model = shaders.uniform("u_model");
+			is_transform = u_transform.valid();
+			is_projection = u_model.valid();
+		};
 
-	if (strstr(argv[1], "transform") != nullptr)
-	{
-		is_transform = true;
-	}
-	else if (strstr(argv[1], "projection") != nullptr)
-	{
-		is_projection = true;
-		glm::mat4 view(1.f);
-		view = glm::translate(view, glm::vec3(0.f, 0.f, -3.f));
+		shader_batch.wait();
+		setup_program();
 
-		shaders.set_mat4("u_view", view);
+		// Edits to the shader file are picked up without restarting
+		// Embedded shaders are stripped copies, editing the files on disk
+		// can't be reloaded over them
+		ShaderWatcher shader_watcher;
+	#ifndef EMBED_SHADERS
+		shader_watcher.watch(shaders);
+		if (is_virtual)
+			shader_watcher.watch(feedback_shaders);
+	#endif
 
-		glm::mat4 projection(1.f);
-		projection = glm::perspective(glm::radians(45.f), (float)(WINDOW_WIDTH / WINDOW_HEIGHT), 0.1f, 100.f);
+		auto cube_model = [&](unsigned int i) {
+			glm::mat4 model(1.f);
+			model = glm::translate(model, cubes_positions[i]);
 
-		shaders.set_mat4("u_projection", projection);
-	}
+			float angle = 20.f * i;
 
-	glEnable(GL_DEPTH_TEST);
+			return glm::rotate(model, glm::radians(angle), glm::vec3(1.f, 1.f, 0.f));
+		};
 
+		auto draw_cubes = [&](Shader &program, UniformHandle model_uniform, unsigned int vertex_array) {
+			for (unsigned int i = 0; i < cubes_positions.size(); ++i) {
+				program.set_mat4(model_uniform, cube_model(i));
 
-	// Main loop
-	while (!glfwWindowShouldClose(window))
-	{
-		glClearColor(0.f, 0.f, 0.f, 1.f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				GLState::bind_vertex_array(vertex_array);
+				glDrawElements(GL_TRIANGLES, sizeof(vertices) / sizeof(float), GL_UNSIGNED_INT, 0);
+			}
+		};
+
+		GLState::enable(GL_DEPTH_TEST);
+
+		double stats_time = glfwGetTime();
 
-		if (is_transform)
+		// Main loop
+		while (!glfwWindowShouldClose(window))
 		{
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+
 			glm::mat4 transform = glm::mat4(1.f);
 			transform = glm::rotate(transform, (float)glfwGetTime(), glm::vec3(1.f, 0.f, 0.f));
 			transform = glm::translate(transform, glm::vec3(0.5f, -0.5f, 0.f));
 
-			shaders.set_mat4("u_transform", transform);
-		}
-		else if (is_projection)
-		{
-			unsigned int i = 0;
-			for (auto &vec : cubes_positions) {
-				glm::mat4 model(1.f);
-				model = glm::translate(model, vec);
+			CameraBlock camera;
+			camera.view = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -3.f));
+			camera.projection = glm::perspective(glm::radians(45.f), (float)(WINDOW_WIDTH / WINDOW_HEIGHT), 0.1f, 100.f);
+			camera.view_projection = camera.projection * camera.view;
+
+			// Both textures cover every face drawn, the budget keeps the
+			// ones the scene shows largest the sharpest
+			if (texture_budget && use_texture)
+			{
+				int index_count = sizeof(indices) / sizeof(unsigned int);
+				float pixels = 0.f;
+				if (is_projection)
+				{
+					for (unsigned int i = 0; i < cubes_positions.size(); ++i)
+						pixels += projected_area(vertices, 8, indices, index_count,
+												 camera.view_projection * cube_model(i), width, height);
+				}
+				else
+				{
+					pixels = projected_area(vertices, 8, indices, index_count, is_transform ? transform : glm::mat4(1.f),
+											width, height);
+				}
+
+				for (auto &texture : textures)
+					texture_manager.set_coverage(texture, pixels);
+			}
 
-				float angle = 20.f * i;
+			texture_manager.update();
+			if (!textures_reported && texture_manager.pending_count() == 0)
+			{
+				texture_manager.report(std::cout);
+				textures_reported = true;
+
+				if (is_array)
+				{
+					for (auto &texture : textures)
+						atlas.add(texture.get_id());
+					atlas.build();
+
+					shaders.use();
+					set_regions();
+					std::cout << atlas.array_count() << " texture arrays, " << atlas.bytes() / 1024 << " KiB"
+							  << std::endl;
+				}
+			}
 
-				model = glm::rotate(model, glm::radians(angle), glm::vec3(1.f, 1.f, 0.f));
+			if (shader_watcher.apply())
+				setup_program();
 
-				shaders.set_mat4("u_model", model);
+			glClearColor(0.f, 0.f, 0.f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+			// Redundant binds are filtered by GLState, draws can state
+			// everything they rely on
+			shaders.use();
+			GLState::bind_vertex_array(VAO);
+			if (use_texture && is_array)
+			{
+				GLState::bind_texture(0, GL_TEXTURE_2D_ARRAY, texture_array);
+			}
+			else if (use_texture)
+			{
+				GLState::bind_texture(0, GL_TEXTURE_2D, textures[0].get_id());
+				GLState::bind_texture(1, GL_TEXTURE_2D, textures[1].get_id());
+			}
+
+			if (is_transform)
+			{
+				shaders.set_mat4(u_transform, transform);
+			}
+			else if (is_projection)
+			{
+				camera_buffer.update(&camera);
+
+				// The feedback pass draws the same cubes into its own
+				// framebuffer, the tiles it asks for arrive frames later
+				if (virtual_texture)
+				{
+					virtual_texture->update();
+					virtual_texture->begin_feedback(width, height);
+					feedback_shaders.use();
+					draw_cubes(feedback_shaders, u_feedback_model, feedback_VAO);
+					virtual_texture->end_feedback();
+
+					shaders.use();
+					GLState::bind_texture(0, GL_TEXTURE_2D, virtual_texture->get_page_table());
+					GLState::bind_texture(1, GL_TEXTURE_2D, virtual_texture->get_cache());
+				}
+
+				draw_cubes(shaders, u_model, VAO);
+			}
+
+			// glDrawArrays(GL_TRIANGLES, 0, 3);
+			if (!is_projection)
 				glDrawElements(GL_TRIANGLES, sizeof(vertices) / sizeof(float), GL_UNSIGNED_INT, 0);
 
-				++i;
+			camera_buffer.end_frame();
+			GLState::end_frame();
+
+			// Show the state calls of the last frame once per second
+			if (glfwGetTime() - stats_time >= 1.)
+			{
+				std::stringstream title;
+				title << "LearnOpenGL - " << GLState::frame_stats().issued << " GL state calls, "
+					  << GLState::frame_stats().eliminated << " filtered";
+				if (virtual_texture)
+				{
+					const VirtualTexture::Stats &tiles = virtual_texture->get_stats();
+					title << ", " << tiles.resident << "/" << tiles.capacity << " tiles, " << tiles.missing << " missing";
+				}
+				if (texture_budget)
+				{
+					const TextureBudget::Stats &budget = texture_manager.budget_stats();
+					title << ", textures " << budget.used / 1024 << "/" << budget.budget / 1024 << " KiB, "
+						  << budget.degraded << " degraded, " << budget.total_evicted << " mips evicted";
+				}
+				glfwSetWindowTitle(window, title.str().c_str());
+				stats_time = glfwGetTime();
 			}
-		}
 
-		// glDrawArrays(GL_TRIANGLES, 0, 3);
-		if (!is_projection)
-			glDrawElements(GL_TRIANGLES, sizeof(vertices) / sizeof(float), GL_UNSIGNED_INT, 0);
+			glfwPollEvents();
+			glfwSwapBuffers(window);
+		}
 
-		glfwPollEvents();
-		glfwSwapBuffers(window);
+		GLState::delete_program(shaders.get_program_id());
+		GLState::delete_buffer(VBO);
+		GLState::delete_buffer(EBO);
+		Shader::set_program_cache(nullptr);
 	}
 
-	glDeleteProgram(shaders.get_program_id());
-
 	glfwTerminate();
 	return 0;
 }
@@ -0,0 +1,149 @@
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : bytes(nullptr), length(0), opened(false), mapped(false)
+{
+}
+
+MappedFile::MappedFile(const std::string &filepath)
+    : bytes(nullptr), length(0), opened(false), mapped(false)
+{
+        open(filepath);
+}
+
+MappedFile::~MappedFile()
+{
+        close();
+}
+
+bool MappedFile::open(const std::string &filepath)
+{
+        close();
+
+#ifdef MAPPED_FILE_MMAP
+        int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+                return false;
+
+        struct stat info;
+        if (fstat(fd, &info) == -1)
+        {
+                ::close(fd);
+                return false;
+        }
+
+        length = (size_t)info.st_size;
+        if (length == 0)
+        {
+                // mmap refuses empty files, an empty view is still valid
+                ::close(fd);
+                opened = true;
+                return true;
+        }
+
+        void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED)
+        {
+                length = 0;
+                return false;
+        }
+
+        bytes = (const unsigned char *)address;
+        opened = true;
+        mapped = true;
+
+        return true;
+#else
+        FILE *file = fopen(filepath.c_str(), "rb");
+        if (!file)
+                return false;
+
+        fseek(file, 0, SEEK_END);
+        long end = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        buffer.resize(end > 0 ? (size_t)end : 0);
+        length = fread(buffer.data(), 1, buffer.size(), file);
+        fclose(file);
+
+        bytes = buffer.data();
+        opened = true;
+
+        return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef MAPPED_FILE_MMAP
+        if (mapped)
+                munmap((void *)bytes, length);
+#endif
+
+        bytes = nullptr;
+        length = 0;
+        opened = false;
+        mapped = false;
+        buffer.clear();
+}
+
+bool MappedFile::is_open() const
+{
+        return opened;
+}
+
+const unsigned char *MappedFile::data() const
+{
+        return bytes;
+}
+
+size_t MappedFile::size() const
+{
+        return length;
+}
+
+void MappedFile::advise_sequential(size_t offset, size_t size) const
+{
+#ifdef MAPPED_FILE_MMAP
+        if (!mapped || offset >= length)
+                return;
+
+        // madvise wants a page aligned start
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = offset / page * page;
+        size_t end = std::min(length, offset + std::min(size, length - offset));
+
+        void *address = (void *)(bytes + start);
+        madvise(address, end - start, MADV_SEQUENTIAL);
+        madvise(address, end - start, MADV_WILLNEED);
+#endif
+}
+
+std::string canonical_path(const std::string &path)
+{
+#ifdef _WIN32
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), sizeof(resolved)))
+                return resolved;
+#else
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+                return resolved;
+#endif
+
+        return path;
+}
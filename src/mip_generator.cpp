@@ -0,0 +1,527 @@
+#include "mip_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MIP_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+constexpr int TAPS = 8;
+
+// Levels smaller than this many rows per thread aren't worth splitting
+constexpr int MIN_ROWS = 32;
+
+// Linear RGBA
+struct Image
+{
+        int width;
+        int height;
+        std::vector<float> pixels;
+};
+
+// The box kernels average full pairs of columns, the Kaiser ones run the
+// same weights over clamped source indices (8 per output).
+struct Kernels
+{
+        void (*box_row)(const float *row0, const float *row1, int width, float *out);
+        void (*horizontal_row)(const float *row, const int *taps, const float *weights,
+                               int width, float *out);
+        void (*vertical_row)(const float *const *rows, const float *weights, int floats,
+                             float *out);
+};
+
+inline void box_pixel(const float *a, const float *b, const float *c, const float *d, float *out)
+{
+        for (int i = 0; i < 4; ++i)
+                out[i] = ((a[i] + b[i]) + (c[i] + d[i])) * 0.25f;
+}
+
+inline void horizontal_pixel(const float *row, const int *taps, const float *weights, float *out)
+{
+        for (int i = 0; i < 4; ++i)
+        {
+                float sum = weights[0] * row[taps[0] * 4 + i];
+                for (int k = 1; k < TAPS; ++k)
+                        sum = sum + weights[k] * row[taps[k] * 4 + i];
+                out[i] = sum;
+        }
+}
+
+inline float vertical_float(const float *const *rows, const float *weights, int i)
+{
+        float sum = weights[0] * rows[0][i];
+        for (int k = 1; k < TAPS; ++k)
+                sum = sum + weights[k] * rows[k][i];
+
+        return sum;
+}
+
+void box_row_scalar(const float *row0, const float *row1, int width, float *out)
+{
+        for (int x = 0; x < width; ++x)
+                box_pixel(row0 + x * 8, row0 + x * 8 + 4, row1 + x * 8, row1 + x * 8 + 4, out + x * 4);
+}
+
+void horizontal_row_scalar(const float *row, const int *taps, const float *weights, int width,
+                           float *out)
+{
+        for (int x = 0; x < width; ++x)
+                horizontal_pixel(row, taps + x * TAPS, weights, out + x * 4);
+}
+
+void vertical_row_scalar(const float *const *rows, const float *weights, int floats, float *out)
+{
+        for (int i = 0; i < floats; ++i)
+                out[i] = vertical_float(rows, weights, i);
+}
+
+#ifdef MIP_X86
+// One pixel per register
+__attribute__((target("sse2"))) void box_row_sse2(const float *row0, const float *row1, int width,
+                                                  float *out)
+{
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (int x = 0; x < width; ++x)
+        {
+                __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4));
+                __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4));
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+        }
+}
+
+__attribute__((target("sse2"))) void horizontal_row_sse2(const float *row, const int *taps,
+                                                         const float *weights, int width, float *out)
+{
+        for (int x = 0; x < width; ++x)
+        {
+                const int *tap = taps + x * TAPS;
+                __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(row + tap[0] * 4));
+                for (int k = 1; k < TAPS; ++k)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(row + tap[k] * 4)));
+                _mm_storeu_ps(out + x * 4, sum);
+        }
+}
+
+__attribute__((target("sse2"))) void vertical_row_sse2(const float *const *rows, const float *weights,
+                                                       int floats, float *out)
+{
+        int i = 0;
+        for (; i + 4 <= floats; i += 4)
+        {
+                __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + i));
+                for (int k = 1; k < TAPS; ++k)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+                _mm_storeu_ps(out + i, sum);
+        }
+
+        for (; i < floats; ++i)
+                out[i] = vertical_float(rows, weights, i);
+}
+
+// Two pixels per register
+__attribute__((target("avx2"))) void box_row_avx2(const float *row0, const float *row1, int width,
+                                                  float *out)
+{
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        int x = 0;
+        for (; x + 2 <= width; x += 2)
+        {
+                // [p0 p1] [p2 p3] to [p0 p2] + [p1 p3]
+                __m256 a = _mm256_loadu_ps(row0 + x * 8);
+                __m256 b = _mm256_loadu_ps(row0 + x * 8 + 8);
+                __m256 top = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+
+                a = _mm256_loadu_ps(row1 + x * 8);
+                b = _mm256_loadu_ps(row1 + x * 8 + 8);
+                __m256 bottom = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+
+                _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(top, bottom), quarter));
+        }
+
+        for (; x < width; ++x)
+                box_pixel(row0 + x * 8, row0 + x * 8 + 4, row1 + x * 8, row1 + x * 8 + 4, out + x * 4);
+}
+
+__attribute__((target("avx2"))) void horizontal_row_avx2(const float *row, const int *taps,
+                                                         const float *weights, int width, float *out)
+{
+        int x = 0;
+        for (; x + 2 <= width; x += 2)
+        {
+                const int *left = taps + x * TAPS;
+                const int *right = left + TAPS;
+                __m256 sum = _mm256_setzero_ps();
+                for (int k = 0; k < TAPS; ++k)
+                {
+                        __m256 pixels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row + left[k] * 4)),
+                                                             _mm_loadu_ps(row + right[k] * 4), 1);
+                        __m256 product = _mm256_mul_ps(_mm256_set1_ps(weights[k]), pixels);
+                        sum = k == 0 ? product : _mm256_add_ps(sum, product);
+                }
+                _mm256_storeu_ps(out + x * 4, sum);
+        }
+
+        for (; x < width; ++x)
+                horizontal_pixel(row, taps + x * TAPS, weights, out + x * 4);
+}
+
+__attribute__((target("avx2"))) void vertical_row_avx2(const float *const *rows, const float *weights,
+                                                       int floats, float *out)
+{
+        int i = 0;
+        for (; i + 8 <= floats; i += 8)
+        {
+                __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + i));
+                for (int k = 1; k < TAPS; ++k)
+                        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+                _mm256_storeu_ps(out + i, sum);
+        }
+
+        for (; i < floats; ++i)
+                out[i] = vertical_float(rows, weights, i);
+}
+#endif
+
+const Kernels SCALAR_KERNELS = {box_row_scalar, horizontal_row_scalar, vertical_row_scalar};
+#ifdef MIP_X86
+const Kernels SSE2_KERNELS = {box_row_sse2, horizontal_row_sse2, vertical_row_sse2};
+const Kernels AVX2_KERNELS = {box_row_avx2, horizontal_row_avx2, vertical_row_avx2};
+#endif
+
+MipKernel best_kernel()
+{
+        if (mip_kernel_supported(MipKernel::AVX2))
+                return MipKernel::AVX2;
+        if (mip_kernel_supported(MipKernel::SSE2))
+                return MipKernel::SSE2;
+
+        return MipKernel::SCALAR;
+}
+
+// Unsupported kernels fall back to the best one
+const Kernels &select_kernels(MipKernel kernel)
+{
+        if (kernel == MipKernel::AUTO || !mip_kernel_supported(kernel))
+                kernel = best_kernel();
+
+#ifdef MIP_X86
+        if (kernel == MipKernel::AVX2)
+                return AVX2_KERNELS;
+        if (kernel == MipKernel::SSE2)
+                return SSE2_KERNELS;
+#endif
+
+        return SCALAR_KERNELS;
+}
+
+double bessel_i0(double x)
+{
+        double sum = 1., term = 1.;
+        for (int k = 1; k < 32; ++k)
+        {
+                term *= (x / (2. * k)) * (x / (2. * k));
+                sum += term;
+        }
+
+        return sum;
+}
+
+// Halfband sinc under a Kaiser window, sampled at the 8 source pixels
+// around an output one, normalized so flat areas stay flat
+struct KaiserWeights
+{
+        float weights[TAPS];
+
+        KaiserWeights()
+        {
+                const double pi = 3.14159265358979323846;
+                const double beta = 4.;
+                const double radius = TAPS / 2.;
+
+                double raw[TAPS], total = 0.;
+                for (int k = 0; k < TAPS; ++k)
+                {
+                        double t = k - TAPS / 2 + 0.5;
+                        double sinc = std::sin(pi * t / 2.) / (pi * t / 2.);
+                        double window = bessel_i0(beta * std::sqrt(1. - (t / radius) * (t / radius))) / bessel_i0(beta);
+                        raw[k] = sinc * window;
+                        total += raw[k];
+                }
+
+                for (int k = 0; k < TAPS; ++k)
+                        weights[k] = (float)(raw[k] / total);
+        }
+};
+
+const float *kaiser_weights()
+{
+        static const KaiserWeights kaiser;
+        return kaiser.weights;
+}
+
+double srgb_to_linear(double value)
+{
+        return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+// Decoding table and the linear values halfway between two sRGB codes,
+// so encoding rounds exactly. The start table gives the code at the
+// bottom of each of ENCODE_STEPS linear intervals, at most a couple of
+// thresholds below the answer.
+constexpr int ENCODE_STEPS = 4096;
+
+struct SrgbTables
+{
+        float decode[256];
+        float thresholds[256];
+        unsigned char start[ENCODE_STEPS + 1];
+
+        SrgbTables()
+        {
+                for (int i = 0; i < 256; ++i)
+                        decode[i] = (float)srgb_to_linear(i / 255.);
+                for (int i = 0; i < 255; ++i)
+                        thresholds[i] = (float)srgb_to_linear((i + 0.5) / 255.);
+                thresholds[255] = 2.f; // Past any clamped value
+
+                int code = 0;
+                for (int i = 0; i <= ENCODE_STEPS; ++i)
+                {
+                        float value = (float)i / ENCODE_STEPS;
+                        while (code < 255 && thresholds[code] <= value)
+                                ++code;
+                        start[i] = (unsigned char)code;
+                }
+        }
+};
+
+const SrgbTables &srgb_tables()
+{
+        static const SrgbTables tables;
+        return tables;
+}
+
+inline unsigned char encode_linear(float value)
+{
+        value = std::min(1.f, std::max(0.f, value));
+        return (unsigned char)(value * 255.f + 0.5f);
+}
+
+inline unsigned char encode_srgb(const SrgbTables &tables, float value)
+{
+        value = std::min(1.f, std::max(0.f, value));
+
+        // The truncated index starts at or below the answer
+        int code = tables.start[(int)(value * ENCODE_STEPS)];
+        while (value >= tables.thresholds[code])
+                ++code;
+
+        return (unsigned char)code;
+}
+
+template <typename Function>
+void parallel_rows(int rows, unsigned int threads, Function function)
+{
+        unsigned int count = std::min(threads, (unsigned int)std::max(1, rows / MIN_ROWS));
+        if (count <= 1)
+        {
+                function(0, rows);
+                return;
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned int i = 1; i < count; ++i)
+                workers.emplace_back(function, (int)(rows * (size_t)i / count),
+                                     (int)(rows * (size_t)(i + 1) / count));
+        function(0, (int)(rows / count));
+
+        for (auto &worker : workers)
+                worker.join();
+}
+
+Image decode(const unsigned char *rgba, int width, int height, bool srgb, unsigned int threads)
+{
+        Image image{width, height, std::vector<float>((size_t)width * height * 4)};
+        const SrgbTables &tables = srgb_tables();
+
+        parallel_rows(height, threads, [&](int begin, int end) {
+                for (size_t i = (size_t)begin * width * 4; i < (size_t)end * width * 4; i += 4)
+                {
+                        for (int c = 0; c < 3; ++c)
+                                image.pixels[i + c] = srgb ? tables.decode[rgba[i + c]] : rgba[i + c] / 255.f;
+                        image.pixels[i + 3] = rgba[i + 3] / 255.f;
+                }
+        });
+
+        return image;
+}
+
+MipLevel encode(const Image &image, bool srgb, unsigned int threads)
+{
+        MipLevel level{image.width, image.height,
+                       std::vector<unsigned char>((size_t)image.width * image.height * 4)};
+        const SrgbTables &tables = srgb_tables();
+
+        parallel_rows(image.height, threads, [&](int begin, int end) {
+                for (size_t i = (size_t)begin * image.width * 4; i < (size_t)end * image.width * 4; i += 4)
+                {
+                        for (int c = 0; c < 3; ++c)
+                                level.pixels[i + c] = srgb ? encode_srgb(tables, image.pixels[i + c])
+                                                           : encode_linear(image.pixels[i + c]);
+                        level.pixels[i + 3] = encode_linear(image.pixels[i + 3]);
+                }
+        });
+
+        return level;
+}
+
+// Odd sizes drop the last row / column, like glGenerateMipmap on most drivers
+Image downsample_box(const Image &source, const Kernels &kernels, unsigned int threads)
+{
+        Image half{std::max(1, source.width / 2), std::max(1, source.height / 2), {}};
+        half.pixels.resize((size_t)half.width * half.height * 4);
+
+        parallel_rows(half.height, threads, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y)
+                {
+                        const float *row0 = &source.pixels[(size_t)std::min(y * 2, source.height - 1) * source.width * 4];
+                        const float *row1 = &source.pixels[(size_t)std::min(y * 2 + 1, source.height - 1) * source.width * 4];
+                        float *out = &half.pixels[(size_t)y * half.width * 4];
+
+                        // A single column has nothing to pair with
+                        if (source.width == 1)
+                                box_pixel(row0, row0, row1, row1, out);
+                        else
+                                kernels.box_row(row0, row1, half.width, out);
+                }
+        });
+
+        return half;
+}
+
+// Source pixels under each output one, clamped at the edges
+std::vector<int> kaiser_taps(int source_size, int size)
+{
+        std::vector<int> taps((size_t)size * TAPS);
+        for (int i = 0; i < size; ++i)
+                for (int k = 0; k < TAPS; ++k)
+                        taps[(size_t)i * TAPS + k] = std::min(source_size - 1, std::max(0, i * 2 - TAPS / 2 + 1 + k));
+
+        return taps;
+}
+
+Image downsample_kaiser(const Image &source, const Kernels &kernels, unsigned int threads)
+{
+        const float *weights = kaiser_weights();
+
+        Image half{std::max(1, source.width / 2), std::max(1, source.height / 2), {}};
+        half.pixels.resize((size_t)half.width * half.height * 4);
+
+        // Columns first, at the source height
+        std::vector<int> columns = kaiser_taps(source.width, half.width);
+        std::vector<float> narrow((size_t)half.width * source.height * 4);
+        parallel_rows(source.height, threads, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y)
+                        kernels.horizontal_row(&source.pixels[(size_t)y * source.width * 4], columns.data(),
+                                               weights, half.width, &narrow[(size_t)y * half.width * 4]);
+        });
+
+        std::vector<int> rows = kaiser_taps(source.height, half.height);
+        parallel_rows(half.height, threads, [&](int begin, int end) {
+                const float *taps[TAPS];
+                for (int y = begin; y < end; ++y)
+                {
+                        for (int k = 0; k < TAPS; ++k)
+                                taps[k] = &narrow[(size_t)rows[(size_t)y * TAPS + k] * half.width * 4];
+                        kernels.vertical_row(taps, weights, half.width * 4, &half.pixels[(size_t)y * half.width * 4]);
+                }
+        });
+
+        return half;
+}
+}
+
+MipOptions::MipOptions() : filter(MipFilter::KAISER), srgb(true), threads(0), kernel(MipKernel::AUTO)
+{
+}
+
+std::vector<MipLevel> generate_mips(const unsigned char *rgba, int width, int height,
+                                    const MipOptions &options)
+{
+        const Kernels &kernels = select_kernels(options.kernel);
+        unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<MipLevel> levels;
+        levels.push_back(MipLevel{width, height, std::vector<unsigned char>(rgba, rgba + (size_t)width * height * 4)});
+
+        Image image = decode(rgba, width, height, options.srgb, threads);
+        while (image.width > 1 || image.height > 1)
+        {
+                if (options.filter == MipFilter::BOX)
+                        image = downsample_box(image, kernels, threads);
+                else
+                        image = downsample_kaiser(image, kernels, threads);
+
+                levels.push_back(encode(image, options.srgb, threads));
+        }
+
+        return levels;
+}
+
+bool mip_kernel_supported(MipKernel kernel)
+{
+        switch (kernel)
+        {
+        case MipKernel::AUTO:
+        case MipKernel::SCALAR:
+                return true;
+#ifdef MIP_X86
+        case MipKernel::SSE2:
+                return __builtin_cpu_supports("sse2");
+        case MipKernel::AVX2:
+                return __builtin_cpu_supports("avx2");
+#endif
+        default:
+                return false;
+        }
+}
+
+const char *mip_kernel_name(MipKernel kernel)
+{
+        switch (kernel)
+        {
+        case MipKernel::AUTO:
+                return mip_kernel_name(best_kernel());
+        case MipKernel::SCALAR:
+                return "scalar";
+        case MipKernel::SSE2:
+                return "sse2";
+        case MipKernel::AVX2:
+                return "avx2";
+        }
+
+        return "unknown";
+}
+
+const char *mip_filter_name(MipFilter filter)
+{
+        return filter == MipFilter::BOX ? "box" : "kaiser";
+}
+
+bool parse_mip_filter(const char *name, MipFilter &filter)
+{
+        if (strcmp(name, "box") == 0)
+                filter = MipFilter::BOX;
+        else if (strcmp(name, "kaiser") == 0)
+                filter = MipFilter::KAISER;
+        else
+                return false;
+
+        return true;
+}
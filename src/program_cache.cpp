@@ -0,0 +1,172 @@
+#include "program_cache.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "hash.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+const char CACHE_MAGIC[4] = {'G', 'L', 'P', 'B'};
+
+struct EntryHeader
+{
+        char magic[4];
+        uint32_t format;
+        uint32_t length;
+        uint32_t padding;
+        uint64_t key;
+};
+
+uint64_t hash_gl_string(GLenum name, uint64_t seed)
+{
+        const char *str = (const char *)glGetString(name);
+        return str ? hash_string(str, seed) : seed;
+}
+}
+
+ProgramCache::ProgramCache(const std::string &directory)
+    : directory(directory), driver_hash(FNV_OFFSET), enabled(false)
+{
+        // Needs a current context: GL 4.1 (or ARB_get_program_binary)
+        // and at least one binary format. The loader only fetches the
+        // functions for 4.1 contexts, older ones may have the extension.
+        if (!GLAD_GL_VERSION_4_1)
+        {
+                if (!glfwExtensionSupported("GL_ARB_get_program_binary"))
+                        return;
+
+                glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+                glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+                glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+                if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+                        return;
+        }
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0)
+                return;
+
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+
+        driver_hash = hash_gl_string(GL_VENDOR, driver_hash);
+        driver_hash = hash_gl_string(GL_RENDERER, driver_hash);
+        driver_hash = hash_gl_string(GL_VERSION, driver_hash);
+        enabled = true;
+}
+
+bool ProgramCache::is_enabled() const
+{
+        return enabled;
+}
+
+uint64_t ProgramCache::key(const ShaderSource &source) const
+{
+        // Hash the lengths too so moving text between stages changes the key
+        uint64_t sizes[ShaderSource::STAGE_COUNT];
+        for (int stage = 0; stage < ShaderSource::STAGE_COUNT; ++stage)
+                sizes[stage] = source.stages[stage].size();
+
+        uint64_t hash = hash_bytes(sizes, sizeof(sizes), driver_hash);
+        for (auto &stage : source.stages)
+                hash = hash_bytes(stage.data(), stage.size(), hash);
+
+        return hash;
+}
+
+bool ProgramCache::load(uint64_t key, unsigned int program) const
+{
+        if (!enabled)
+                return false;
+
+        FILE *file = fopen(entry_path(key).c_str(), "rb");
+        if (!file)
+                return false;
+
+        EntryHeader header;
+        std::vector<char> binary;
+        bool read = fread(&header, sizeof(header), 1, file) == 1 &&
+                    memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                    header.key == key;
+        if (read)
+        {
+                binary.resize(header.length);
+                read = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+
+        if (!read)
+                return false;
+
+        glProgramBinary(program, header.format, binary.data(), (int)binary.size());
+
+        int result;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+
+        return result == GL_TRUE;
+}
+
+void ProgramCache::store(uint64_t key, unsigned int program) const
+{
+        if (!enabled)
+                return;
+
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+                return;
+
+        EntryHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.padding = 0;
+        header.key = key;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        header.format = format;
+        header.length = (uint32_t)length;
+
+        // Write aside and rename so a crash never leaves a torn entry
+        std::string path = entry_path(key);
+        std::string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if (!file)
+                return;
+
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(binary.data(), 1, length, file) == (size_t)length;
+        fclose(file);
+
+        if (written)
+        {
+                remove(path.c_str());
+                written = rename(temporary.c_str(), path.c_str()) == 0;
+        }
+
+        if (!written)
+                remove(temporary.c_str());
+}
+
+std::string ProgramCache::entry_path(uint64_t key) const
+{
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+        return directory + "/" + name;
+}
@@ -1,54 +1,78 @@
 #include "shader.hpp"
 
+#include "gl_state.hpp"
+#include "uniform_buffer.hpp"
+
+#include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
-#include <cstring>
+#include <cctype>
 #include <iostream>
-#include <sstream>
+
+const ProgramCache *Shader::cache = nullptr;
+bool Shader::completion_query = false;
 
 Shader::Shader(const std::string &filepath)
-    : vertex_shader(""), fragment_shader(""), is_bound(false)
+    : Shader(filepath, Deferred())
 {
-        parse_shader(filepath.c_str());
-        create_shaders();
+        wait();
 }
 
 Shader::Shader(const std::string &vertex,
                const std::string &fragment)
-    : vertex_shader(vertex), fragment_shader(fragment), is_bound(false)
+    : Shader(vertex, fragment, Deferred())
 {
-        create_shaders();
+        wait();
 }
 
 Shader::Shader(const std::string &str, Shader::Type type)
-    : vertex_shader(""), fragment_shader(""), is_bound(false)
+    : name("<source>"), variant(0)
 {
-        switch (type)
-        {
-        case Shader::Type::VERTEX:
-                vertex_shader = str;
-                break;
+        if (type != Shader::Type::NONE)
+                source.stages[type] = str;
 
-        case Shader::Type::FRAGMENT:
-                fragment_shader = str;
-                break;
+        create_shaders();
+        wait();
+}
 
-        default:
-                break;
-        }
+Shader::Shader(const std::string &filepath, Deferred)
+    : name(filepath), filepath(filepath), variant(0)
+{
+        parse_shader(filepath.c_str());
+        create_shaders();
+}
 
+Shader::Shader(const std::string &vertex,
+               const std::string &fragment, Deferred)
+    : name("<source>"), variant(0)
+{
+        source.stages[ShaderSource::VERTEX] = vertex;
+        source.stages[ShaderSource::FRAGMENT] = fragment;
         create_shaders();
 }
 
-void Shader::use()
+Shader::Shader(const std::string &filepath, const ShaderSource &source,
+               uint32_t variant, Deferred)
+    : name(filepath), filepath(filepath), variant(variant),
+      source(source.variant(variant))
 {
-        if (!is_bound)
+        for (size_t i = 0; i < source.keywords.size(); ++i)
         {
-                glUseProgram(program_id);
-                is_bound = true;
+                if (variant & (1u << i))
+                        name += " " + source.keywords[i];
         }
+
+        create_shaders();
+}
+
+void Shader::use()
+{
+        wait();
+
+        GLState::use_program(program_id);
 }
 
 unsigned int Shader::get_program_id() const
@@ -56,58 +80,160 @@ unsigned int Shader::get_program_id() const
         return program_id;
 }
 
+const std::string &Shader::get_name() const
+{
+        return name;
+}
+
+const std::string &Shader::get_filepath() const
+{
+        return filepath;
+}
+
+uint32_t Shader::get_variant() const
+{
+        return variant;
+}
+
+const ShaderSource &Shader::get_source() const
+{
+        return source;
+}
+
+const VertexInterface &Shader::get_attributes() const
+{
+        return attributes;
+}
+
+Shader::Status Shader::get_status() const
+{
+        return status;
+}
+
+Shader::Status Shader::poll()
+{
+        if (status == Status::PENDING)
+        {
+                // Without the completion query the link status blocks until
+                // the driver is done, so only finish when asked to
+                int done = GL_TRUE;
+                if (completion_query)
+                        glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &done);
+
+                if (done == GL_TRUE)
+                        finish_shaders();
+        }
+
+        return status;
+}
+
+void Shader::wait()
+{
+        if (status == Status::PENDING)
+                finish_shaders();
+}
+
+void Shader::set_program_cache(const ProgramCache *program_cache)
+{
+        cache = program_cache;
+}
+
 void Shader::set_bool(const std::string &name, bool val) const
 {
-        glUniform1i(glGetUniformLocation(program_id, name.c_str()), (int)val);
+        set_bool(uniform(name), val);
 }
 
 void Shader::set_int(const std::string &name, int val) const
 {
-        glUniform1i(glGetUniformLocation(program_id, name.c_str()), val);
+        set_int(uniform(name), val);
 }
 
 void Shader::set_float(const std::string &name, float val) const
 {
-        glUniform1f(glGetUniformLocation(program_id, name.c_str()), val);
+        set_float(uniform(name), val);
+}
+
+void Shader::set_vec4(const std::string &name, const glm::vec4 &val) const
+{
+        set_vec4(uniform(name), val);
 }
 
 void Shader::set_mat4(const std::string &name, const glm::mat4 &val) const
 {
-        glUniformMatrix4fv(glGetUniformLocation(program_id, name.c_str()), 1, GL_FALSE, glm::value_ptr(val));
+        set_mat4(uniform(name), val);
+}
+
+UniformHandle Shader::uniform(const std::string &name) const
+{
+        return uniforms.find(name.c_str());
+}
+
+void Shader::set_bool(UniformHandle uniform, bool val) const
+{
+        glUniform1i(uniform.location, (int)val);
+}
+
+void Shader::set_int(UniformHandle uniform, int val) const
+{
+        glUniform1i(uniform.location, val);
+}
+
+void Shader::set_float(UniformHandle uniform, float val) const
+{
+        glUniform1f(uniform.location, val);
+}
+
+void Shader::set_vec4(UniformHandle uniform, const glm::vec4 &val) const
+{
+        glUniform4fv(uniform.location, 1, glm::value_ptr(val));
+}
+
+void Shader::set_mat4(UniformHandle uniform, const glm::mat4 &val) const
+{
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(val));
 }
 
 void Shader::parse_shader(const char *filepath)
 {
-        FILE *shader = fopen(filepath, "r");
-        if (!shader)
+        if (!source.load(filepath))
         {
                 std::string message = "Can't open the file " + std::string(filepath);
                 perror(message.c_str());
                 exit(-1);
         }
+}
+
+bool Shader::reload(const ShaderSource &new_source)
+{
+        wait();
+
+        unsigned int previous_id = program_id;
+        ShaderSource previous_source = source;
+        UniformTable previous_uniforms = uniforms;
+        VertexInterface previous_attributes = attributes;
+
+        source = new_source;
+        create_shaders();
+        wait();
 
-        char line[256];
-        std::stringstream ss[2];
-        Shader::Type type = Shader::Type::NONE;
-        while (fgets(line, sizeof(line), shader))
+        if (status == Status::FAILED)
         {
-                if (strstr(line, "#shader"))
-                {
-                        if (strstr(line, "vertex"))
-                                type = Shader::Type::VERTEX;
-                        else if (strstr(line, "fragment"))
-                                type = Shader::Type::FRAGMENT;
-                }
-                else
-                {
-                        ss[type] << line << '\n';
-                }
+                std::cerr << "Reloading " << name << " failed, keeping the previous program"
+                          << std::endl;
+
+                GLState::delete_program(program_id);
+                program_id = previous_id;
+                source = previous_source;
+                uniforms = previous_uniforms;
+                attributes = previous_attributes;
+                status = Status::READY;
+
+                return false;
         }
 
-        fclose(shader);
+        GLState::delete_program(previous_id);
 
-        vertex_shader = ss[Shader::Type::VERTEX].str();
-        fragment_shader = ss[Shader::Type::FRAGMENT].str();
+        return true;
 }
 
 unsigned int Shader::compile_shader(unsigned int type,
@@ -118,6 +244,11 @@ unsigned int Shader::compile_shader(unsigned int type,
         glShaderSource(id, 1, &src, nullptr);
         glCompileShader(id);
 
+        return id;
+}
+
+void Shader::check_shader(unsigned int id, ShaderSource::Stage stage) const
+{
         int result;
         glGetShaderiv(id, GL_COMPILE_STATUS, &result);
         if (result == GL_FALSE)
@@ -126,43 +257,162 @@ unsigned int Shader::compile_shader(unsigned int type,
                 glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
                 char *message = (char *)alloca(length * sizeof(char));
                 glGetShaderInfoLog(id, length, &length, message);
-                std::cerr << "ERROR::SHADER::"
-                          << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT")
-                          << "::COMPILATION_FAILED\n"
+
+                std::string type = ShaderSource::stage_name(stage);
+                for (auto &c : type)
+                        c = (char)toupper(c);
+
+                std::cerr << "ERROR::SHADER::" << type << "::COMPILATION_FAILED\n"
                           << message << std::endl;
-                glDeleteShader(id);
-                return 0;
         }
-
-        return id;
 }
 
 void Shader::create_shaders()
 {
+        submit_time = std::chrono::steady_clock::now();
+        status = Status::PENDING;
+        for (auto &id : stage_ids)
+                id = 0;
+
         program_id = glCreateProgram();
-        int vs = -1;
-        int fs = -1;
 
-        if (vertex_shader != "")
+        cache_key = 0;
+        if (cache && cache->is_enabled())
         {
-                vs = compile_shader(GL_VERTEX_SHADER, vertex_shader);
-                glAttachShader(program_id, vs);
+                cache_key = cache->key(source);
+                if (cache->load(cache_key, program_id))
+                {
+                        status = Status::READY;
+                        uniforms.reflect(program_id);
+                        attributes.reflect(program_id);
+                        UniformBuffer::bind_blocks(program_id);
+                        report(true);
+                        return;
+                }
+
+                // A rejected binary leaves the program unusable, start over
+                GLState::delete_program(program_id);
+                program_id = glCreateProgram();
+                glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         }
 
-        if (fragment_shader != "")
+        link_shaders();
+}
+
+void Shader::link_shaders()
+{
+        static const unsigned int types[ShaderSource::COMPUTE] = {
+            GL_VERTEX_SHADER,
+            GL_FRAGMENT_SHADER,
+            GL_GEOMETRY_SHADER,
+        };
+
+        bool graphics = false;
+        for (int stage = 0; stage < ShaderSource::COMPUTE; ++stage)
+                graphics = graphics || !source.stages[stage].empty();
+
+        const std::string &compute = source.stages[ShaderSource::COMPUTE];
+        if (!graphics && !compute.empty())
         {
-                fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader);
-                glAttachShader(program_id, fs);
+                link_compute();
+                return;
         }
 
+        // A compute stage can't be linked with the graphics ones
+        if (!compute.empty())
+                std::cerr << name << ": ignoring the compute stage of a graphics program" << std::endl;
+
+        // Only submit the work here, every status query is left to
+        // finish_shaders so the driver can compile in the background
+        for (int stage = 0; stage < ShaderSource::COMPUTE; ++stage)
+        {
+                if (source.stages[stage].empty())
+                        continue;
+
+                stage_ids[stage] = compile_shader(types[stage], source.stages[stage]);
+                glAttachShader(program_id, stage_ids[stage]);
+        }
+
+        glLinkProgram(program_id);
+}
+
+// A program of its own, compute needs GL 4.3 or ARB_compute_shader while
+// main only asks for 3.3. Left unlinked otherwise, so it fails to link.
+void Shader::link_compute()
+{
+        if (!GLAD_GL_VERSION_4_3)
+        {
+                if (!glfwExtensionSupported("GL_ARB_compute_shader"))
+                {
+                        std::cerr << name << ": compute shaders need GL 4.3 or GL_ARB_compute_shader" << std::endl;
+                        return;
+                }
+
+                glad_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)glfwGetProcAddress("glDispatchCompute");
+                glad_glDispatchComputeIndirect =
+                    (PFNGLDISPATCHCOMPUTEINDIRECTPROC)glfwGetProcAddress("glDispatchComputeIndirect");
+        }
+
+        stage_ids[ShaderSource::COMPUTE] = compile_shader(GL_COMPUTE_SHADER, source.stages[ShaderSource::COMPUTE]);
+        glAttachShader(program_id, stage_ids[ShaderSource::COMPUTE]);
         glLinkProgram(program_id);
-        glValidateProgram(program_id);
+}
 
-        // glDeleteShader(vs);
-        // glDeleteShader(fs);
-        if (vs != -1)
-                glDetachShader(program_id, vs);
+void Shader::finish_shaders()
+{
+        int result;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+        if (result == GL_FALSE)
+        {
+                for (int stage = 0; stage < ShaderSource::STAGE_COUNT; ++stage)
+                {
+                        if (stage_ids[stage])
+                                check_shader(stage_ids[stage], (ShaderSource::Stage)stage);
+                }
+
+                int length;
+                glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &length);
+                char *message = (char *)alloca((length + 1) * sizeof(char));
+                message[0] = '\0';
+                glGetProgramInfoLog(program_id, length + 1, &length, message);
+                std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
+                          << message << std::endl;
+
+                status = Status::FAILED;
+        }
+        else
+        {
+                glValidateProgram(program_id);
+                status = Status::READY;
+
+                if (cache && cache->is_enabled())
+                        cache->store(cache_key, program_id);
+        }
+
+        for (auto &id : stage_ids)
+        {
+                if (id)
+                {
+                        glDetachShader(program_id, id);
+                        glDeleteShader(id);
+                        id = 0;
+                }
+        }
+
+        uniforms.reflect(program_id);
+        attributes.reflect(program_id);
+        UniformBuffer::bind_blocks(program_id);
+        report(false);
+}
+
+void Shader::report(bool warm) const
+{
+        if (!cache || !cache->is_enabled())
+                return;
 
-        if (fs != -1)
-                glDetachShader(program_id, fs);
+        auto elapsed = std::chrono::steady_clock::now() - submit_time;
+        std::cout << "Shader " << name << " ("
+                  << (warm ? "warm" : "cold") << "): "
+                  << std::chrono::duration<double, std::milli>(elapsed).count()
+                  << " ms" << std::endl;
 }
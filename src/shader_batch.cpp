@@ -0,0 +1,80 @@
+#include "shader_batch.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+
+namespace
+{
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+// Let the driver pick its own thread count
+constexpr GLuint MAX_COMPILER_THREADS = 0xFFFFFFFF;
+}
+
+ShaderBatch::ShaderBatch() : parallel(false)
+{
+        const char *extensions[][2] = {
+            {"GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR"},
+            {"GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB"},
+        };
+
+        for (auto &extension : extensions)
+        {
+                if (!glfwExtensionSupported(extension[0]))
+                        continue;
+
+                auto max_threads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)glfwGetProcAddress(extension[1]);
+                if (max_threads)
+                        max_threads(MAX_COMPILER_THREADS);
+
+                parallel = true;
+                break;
+        }
+
+        Shader::completion_query = parallel;
+}
+
+void ShaderBatch::add(Shader &shader)
+{
+        if (shader.get_status() == Shader::Status::PENDING)
+                pending.push_back(&shader);
+}
+
+unsigned int ShaderBatch::poll()
+{
+        if (parallel)
+        {
+                auto done = std::remove_if(pending.begin(), pending.end(), [](Shader *shader) {
+                        return shader->poll() != Shader::Status::PENDING;
+                });
+                pending.erase(done, pending.end());
+        }
+        else if (!pending.empty())
+        {
+                // Every query blocks, finish one program per call so a frame
+                // loop spreads the stalls
+                pending.front()->wait();
+                pending.erase(pending.begin());
+        }
+
+        return (unsigned int)pending.size();
+}
+
+void ShaderBatch::wait()
+{
+        for (Shader *shader : pending)
+                shader->wait();
+
+        pending.clear();
+}
+
+unsigned int ShaderBatch::pending_count() const
+{
+        return (unsigned int)pending.size();
+}
+
+bool ShaderBatch::is_parallel() const
+{
+        return parallel;
+}
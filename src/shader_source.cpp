@@ -0,0 +1,370 @@
+#include "shader_source.hpp"
+
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+#ifdef EMBED_SHADERS
+#include "shader_bundle_data.hpp"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+struct Include
+{
+        std::string text;
+        std::vector<std::string> includes;
+};
+
+// Recursive, an include being preprocessed loads its own includes
+std::recursive_mutex include_mutex;
+std::unordered_map<std::string, std::shared_ptr<const Include>> include_cache;
+
+std::string directory_of(const std::string &path)
+{
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+const char *skip_blanks(const char *ptr, const char *end)
+{
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+                ++ptr;
+
+        return ptr;
+}
+
+// Matches "# directive argument" and returns the argument without the
+// surrounding blanks
+bool match_directive(const char *line, const char *end, const char *directive,
+                     const char **argument, const char **argument_end)
+{
+        const char *ptr = skip_blanks(line, end);
+        if (ptr == end || *ptr != '#')
+                return false;
+
+        ptr = skip_blanks(ptr + 1, end);
+        size_t length = strlen(directive);
+        if ((size_t)(end - ptr) < length || memcmp(ptr, directive, length) != 0)
+                return false;
+
+        ptr += length;
+        if (ptr < end && *ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+                return false;
+
+        *argument = skip_blanks(ptr, end);
+        *argument_end = end;
+        while (*argument_end > *argument &&
+               ((*argument_end)[-1] == ' ' || (*argument_end)[-1] == '\t' || (*argument_end)[-1] == '\r'))
+                --*argument_end;
+
+        return true;
+}
+
+// '"file"' or '<file>' to file
+bool include_name(const char *argument, const char *end, std::string &name)
+{
+        if (end - argument < 2)
+                return false;
+
+        char close = *argument == '"' ? '"' : *argument == '<' ? '>' : 0;
+        if (!close || end[-1] != close)
+                return false;
+
+        name.assign(argument + 1, end - 1);
+
+        return !name.empty();
+}
+
+std::shared_ptr<const Include> load_include(const std::string &path,
+                                            std::vector<std::string> &stack);
+
+bool append_include(const std::string &directory, const char *argument,
+                    const char *end, std::string &out,
+                    std::vector<std::string> &includes,
+                    std::vector<std::string> &stack)
+{
+        std::string name;
+        if (!include_name(argument, end, name))
+        {
+                std::cerr << "ERROR::SHADER::INCLUDE::MALFORMED\n"
+                          << std::string(argument, end) << std::endl;
+                return false;
+        }
+
+        std::string path = canonical_path(directory + name);
+        auto include = load_include(path, stack);
+        if (!include)
+                return false;
+
+        out += include->text;
+
+        for (auto &dependency : include->includes)
+        {
+                if (std::find(includes.begin(), includes.end(), dependency) == includes.end())
+                        includes.push_back(dependency);
+        }
+
+        return true;
+}
+
+std::shared_ptr<const Include> load_include(const std::string &path,
+                                            std::vector<std::string> &stack)
+{
+        std::lock_guard<std::recursive_mutex> lock(include_mutex);
+
+        auto cached = include_cache.find(path);
+        if (cached != include_cache.end())
+                return cached->second;
+
+        if (std::find(stack.begin(), stack.end(), path) != stack.end())
+        {
+                std::cerr << "ERROR::SHADER::INCLUDE::RECURSIVE\n"
+                          << path << std::endl;
+                return nullptr;
+        }
+
+        MappedFile file(path);
+        if (!file.is_open())
+        {
+                std::cerr << "ERROR::SHADER::INCLUDE::NOT_FOUND\n"
+                          << path << std::endl;
+                return nullptr;
+        }
+
+        stack.push_back(path);
+
+        auto include = std::make_shared<Include>();
+        include->includes.push_back(path);
+        include->text.reserve(file.size() + 1);
+
+        std::string directory = directory_of(path);
+        const char *ptr = (const char *)file.data();
+        const char *end = ptr + file.size();
+        bool valid = true;
+        while (valid && ptr < end)
+        {
+                const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+                const char *line_end = eol ? eol : end;
+
+                const char *argument, *argument_end;
+                if (match_directive(ptr, line_end, "include", &argument, &argument_end))
+                        valid = append_include(directory, argument, argument_end, include->text,
+                                               include->includes, stack);
+                else
+                        include->text.append(ptr, line_end);
+
+                include->text += '\n';
+                ptr = eol ? eol + 1 : end;
+        }
+
+        stack.pop_back();
+
+        if (!valid)
+                return nullptr;
+
+        include_cache[path] = include;
+
+        return include;
+}
+}
+
+bool ShaderSource::parse(const std::string &filepath)
+{
+        MappedFile file(filepath);
+        if (!file.is_open())
+                return false;
+
+        for (auto &stage : stages)
+                stage.clear();
+        includes.clear();
+        keywords.clear();
+
+        std::string directory = directory_of(filepath);
+        std::vector<std::string> stack(1, canonical_path(filepath));
+
+        // Single pass over the mapping, each line is copied at most once
+        int stage = -1;
+        const char *ptr = (const char *)file.data();
+        const char *end = ptr + file.size();
+        while (ptr < end)
+        {
+                const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+                const char *line_end = eol ? eol : end;
+
+                const char *argument, *argument_end;
+                if (match_directive(ptr, line_end, "keywords", &argument, &argument_end))
+                {
+                        while (argument < argument_end)
+                        {
+                                const char *word = argument;
+                                while (argument < argument_end && *argument != ' ' && *argument != '\t')
+                                        ++argument;
+
+                                if (keywords.size() == 32)
+                                        std::cerr << "ERROR::SHADER::TOO_MANY_KEYWORDS\n"
+                                                  << std::string(word, argument) << std::endl;
+                                else
+                                        keywords.emplace_back(word, argument);
+
+                                argument = skip_blanks(argument, argument_end);
+                        }
+                }
+                else if (match_directive(ptr, line_end, "shader", &argument, &argument_end))
+                {
+                        stage = -1;
+                        for (int i = 0; i < STAGE_COUNT; ++i)
+                        {
+                                const char *name = stage_name((Stage)i);
+                                if ((size_t)(argument_end - argument) == strlen(name) &&
+                                    memcmp(argument, name, argument_end - argument) == 0)
+                                        stage = i;
+                        }
+
+                        if (stage == -1)
+                                std::cerr << "ERROR::SHADER::UNKNOWN_STAGE\n"
+                                          << std::string(argument, argument_end) << std::endl;
+                }
+                else if (stage != -1)
+                {
+                        if (match_directive(ptr, line_end, "include", &argument, &argument_end))
+                        {
+                                if (!append_include(directory, argument, argument_end,
+                                                    stages[stage], includes, stack))
+                                        return false;
+                        }
+                        else
+                        {
+                                stages[stage].append(ptr, line_end);
+                        }
+
+                        stages[stage] += '\n';
+                }
+
+                ptr = eol ? eol + 1 : end;
+        }
+
+        return true;
+}
+
+bool ShaderSource::load(const std::string &filepath)
+{
+#ifdef EMBED_SHADERS
+        const char *path = filepath.c_str();
+        while (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+                path += 2;
+
+        uint64_t hash = hash_string(path);
+        for (auto &bundled : BUNDLED_SHADERS)
+        {
+                if (bundled.path_hash != hash || strcmp(bundled.path, path) != 0)
+                        continue;
+
+                for (int stage = 0; stage < STAGE_COUNT; ++stage)
+                        stages[stage] = bundled.stages[stage];
+                includes.clear();
+                keywords.clear();
+
+                const char *word = bundled.keywords;
+                while (*word)
+                {
+                        const char *space = strchr(word, ' ');
+                        const char *word_end = space ? space : word + strlen(word);
+                        keywords.emplace_back(word, word_end);
+                        word = space ? space + 1 : word_end;
+                }
+
+                return true;
+        }
+#endif
+
+        return parse(filepath);
+}
+
+bool ShaderSource::empty() const
+{
+        for (auto &stage : stages)
+        {
+                if (!stage.empty())
+                        return false;
+        }
+
+        return true;
+}
+
+ShaderSource ShaderSource::variant(uint32_t mask) const
+{
+        ShaderSource result = *this;
+        if (mask == 0)
+                return result;
+
+        std::string defines;
+        for (size_t i = 0; i < keywords.size(); ++i)
+        {
+                if (mask & (1u << i))
+                        defines += "#define " + keywords[i] + "\n";
+        }
+
+        for (auto &stage : result.stages)
+        {
+                if (stage.empty())
+                        continue;
+
+                // The defines go right after #version, which must come first,
+                // and #line keeps compiler messages on the original lines
+                size_t position = 0;
+                int line = 1;
+                size_t version = stage.find("#version");
+                if (version != std::string::npos &&
+                    stage.find_first_not_of(" \t\r\n") == version)
+                {
+                        size_t eol = stage.find('\n', version);
+                        position = eol == std::string::npos ? stage.size() : eol + 1;
+                        line = 1 + (int)std::count(stage.begin(), stage.begin() + position, '\n');
+                }
+
+                stage.insert(position, defines + "#line " + std::to_string(line) + "\n");
+        }
+
+        return result;
+}
+
+const char *ShaderSource::stage_name(Stage stage)
+{
+        switch (stage)
+        {
+        case VERTEX:
+                return "vertex";
+        case FRAGMENT:
+                return "fragment";
+        case GEOMETRY:
+                return "geometry";
+        case COMPUTE:
+                return "compute";
+        default:
+                return "";
+        }
+}
+
+void ShaderSource::invalidate(const std::string &filepath)
+{
+        std::string path = canonical_path(filepath);
+
+        std::lock_guard<std::recursive_mutex> lock(include_mutex);
+
+        // Also drop every include that pulled the changed file in
+        for (auto it = include_cache.begin(); it != include_cache.end();)
+        {
+                auto &dependencies = it->second->includes;
+                if (std::find(dependencies.begin(), dependencies.end(), path) != dependencies.end())
+                        it = include_cache.erase(it);
+                else
+                        ++it;
+        }
+}
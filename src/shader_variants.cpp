@@ -0,0 +1,68 @@
+#include "shader_variants.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+ShaderVariants::ShaderVariants(const std::string &filepath)
+    : filepath(filepath)
+{
+        if (!source.load(filepath))
+        {
+                std::string message = "Can't open the file " + filepath;
+                perror(message.c_str());
+                exit(-1);
+        }
+}
+
+const std::vector<std::string> &ShaderVariants::keywords() const
+{
+        return source.keywords;
+}
+
+uint32_t ShaderVariants::mask(const std::vector<std::string> &keywords) const
+{
+        uint32_t result = 0;
+        for (auto &keyword : keywords)
+        {
+                bool found = false;
+                for (size_t i = 0; i < source.keywords.size(); ++i)
+                {
+                        if (source.keywords[i] == keyword)
+                        {
+                                result |= 1u << i;
+                                found = true;
+                        }
+                }
+
+                if (!found)
+                        std::cerr << "Unknown keyword " << keyword << " in "
+                                  << filepath << std::endl;
+        }
+
+        return result;
+}
+
+Shader &ShaderVariants::get(uint32_t mask)
+{
+        auto variant = variants.find(mask);
+        if (variant != variants.end())
+                return *variant->second;
+
+        Shader *shader = new Shader(filepath, source, mask, Shader::Deferred());
+        variants[mask] = std::unique_ptr<Shader>(shader);
+
+        return *shader;
+}
+
+void ShaderVariants::prewarm(const std::vector<uint32_t> &masks,
+                             ShaderBatch &batch)
+{
+        for (uint32_t mask : masks)
+                batch.add(get(mask));
+}
+
+unsigned int ShaderVariants::size() const
+{
+        return (unsigned int)variants.size();
+}
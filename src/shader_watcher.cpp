@@ -0,0 +1,202 @@
+#include "shader_watcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher()
+    : inotify_fd(-1), wake_fds{-1, -1}, has_reloads(false)
+{
+#ifdef __linux__
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1)
+        {
+                perror("inotify_init1");
+                return;
+        }
+
+        if (pipe(wake_fds) == -1)
+        {
+                perror("pipe");
+                close(inotify_fd);
+                inotify_fd = -1;
+                return;
+        }
+
+        thread = std::thread(&ShaderWatcher::run, this);
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+        if (thread.joinable())
+        {
+                char wake = 0;
+                if (write(wake_fds[1], &wake, 1) == 1)
+                        thread.join();
+                else
+                        thread.detach();
+        }
+
+        if (inotify_fd != -1)
+                close(inotify_fd);
+        if (wake_fds[0] != -1)
+                close(wake_fds[0]);
+        if (wake_fds[1] != -1)
+                close(wake_fds[1]);
+#endif
+}
+
+void ShaderWatcher::watch(Shader &shader)
+{
+        if (shader.get_filepath().empty())
+                return;
+
+        add_watch(&shader, shader.get_filepath());
+        for (auto &include : shader.get_source().includes)
+                add_watch(&shader, include);
+}
+
+unsigned int ShaderWatcher::apply()
+{
+        if (!has_reloads.load(std::memory_order_acquire))
+                return 0;
+
+        std::vector<Reload> pending;
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.swap(reloads);
+                has_reloads.store(false, std::memory_order_relaxed);
+        }
+
+        unsigned int reloaded = 0;
+        for (auto &reload : pending)
+        {
+                if (reload.shader->reload(reload.source))
+                {
+                        std::cout << "Reloaded " << reload.shader->get_name() << std::endl;
+                        ++reloaded;
+                }
+        }
+
+        return reloaded;
+}
+
+void ShaderWatcher::add_watch(Shader *shader, const std::string &path)
+{
+#ifdef __linux__
+        if (inotify_fd == -1)
+                return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &watch : watches)
+        {
+                if (watch.shader == shader && watch.path == path)
+                        return;
+        }
+
+        // Watch the directory, editors usually replace the file on save
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+        std::string filename = slash == std::string::npos ? path : path.substr(slash + 1);
+
+        int descriptor = inotify_add_watch(inotify_fd, directory.c_str(),
+                                           IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (descriptor == -1)
+        {
+                std::string message = "Can't watch " + directory;
+                perror(message.c_str());
+                return;
+        }
+
+        watches.push_back(Watch{shader, descriptor, path, filename});
+#endif
+}
+
+void ShaderWatcher::run()
+{
+#ifdef __linux__
+        alignas(struct inotify_event) char buffer[4096];
+
+        struct pollfd fds[2] = {
+            {inotify_fd, POLLIN, 0},
+            {wake_fds[0], POLLIN, 0},
+        };
+
+        while (true)
+        {
+                if (poll(fds, 2, -1) == -1)
+                        continue;
+
+                if (fds[1].revents)
+                        return;
+
+                ssize_t length;
+                while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+                {
+                        for (char *ptr = buffer; ptr < buffer + length;)
+                        {
+                                const struct inotify_event *event = (const struct inotify_event *)ptr;
+                                if (event->len)
+                                        changed(event->wd, event->name);
+
+                                ptr += sizeof(struct inotify_event) + event->len;
+                        }
+                }
+        }
+#endif
+}
+
+void ShaderWatcher::changed(int descriptor, const char *filename)
+{
+        std::vector<Shader *> shaders;
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto &watch : watches)
+                {
+                        if (watch.descriptor != descriptor || watch.filename != filename)
+                                continue;
+
+                        ShaderSource::invalidate(watch.path);
+                        if (std::find(shaders.begin(), shaders.end(), watch.shader) == shaders.end())
+                                shaders.push_back(watch.shader);
+                }
+        }
+
+        for (Shader *shader : shaders)
+        {
+                ShaderSource source;
+                if (!source.parse(shader->get_filepath()))
+                        continue;
+
+                Reload reload{shader, source.variant(shader->get_variant())};
+
+                // Follow includes added by the edit
+                for (auto &include : reload.source.includes)
+                        add_watch(shader, include);
+
+                std::lock_guard<std::mutex> lock(mutex);
+
+                // Several saves between two frames only relink once
+                bool queued = false;
+                for (auto &pending : reloads)
+                {
+                        if (pending.shader == reload.shader)
+                        {
+                                pending = reload;
+                                queued = true;
+                        }
+                }
+
+                if (!queued)
+                        reloads.push_back(reload);
+
+                has_reloads.store(true, std::memory_order_release);
+        }
+}
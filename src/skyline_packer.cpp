@@ -0,0 +1,123 @@
+#include "skyline_packer.hpp"
+
+#include <algorithm>
+
+SkylinePacker::SkylinePacker(int width, int height) : width(width), height(height)
+{
+        clear();
+}
+
+void SkylinePacker::clear()
+{
+        skyline.assign(1, Segment{0, 0, width});
+        used_area = 0;
+}
+
+// Height the rectangle would sit at with its left edge on the segment, -1
+// if it sticks out of the bin
+int SkylinePacker::fit(size_t index, int rect_width, int rect_height) const
+{
+        int x = skyline[index].x;
+        if (x + rect_width > width)
+                return -1;
+
+        int y = 0;
+        int left = rect_width;
+        for (size_t i = index; left > 0; ++i)
+        {
+                y = std::max(y, skyline[i].y);
+                if (y + rect_height > height)
+                        return -1;
+
+                left -= skyline[i].width;
+        }
+
+        return y;
+}
+
+void SkylinePacker::place(size_t index, int x, int y, int rect_width, int rect_height)
+{
+        skyline.insert(skyline.begin() + index, Segment{x, y + rect_height, rect_width});
+
+        // Segments now under the rectangle are cut back or dropped
+        for (size_t i = index + 1; i < skyline.size();)
+        {
+                int end = skyline[i - 1].x + skyline[i - 1].width;
+                if (skyline[i].x >= end)
+                        break;
+
+                int shrink = end - skyline[i].x;
+                skyline[i].x += shrink;
+                skyline[i].width -= shrink;
+                if (skyline[i].width > 0)
+                        break;
+
+                skyline.erase(skyline.begin() + i);
+        }
+
+        for (size_t i = 0; i + 1 < skyline.size();)
+        {
+                if (skyline[i].y == skyline[i + 1].y)
+                {
+                        skyline[i].width += skyline[i + 1].width;
+                        skyline.erase(skyline.begin() + i + 1);
+                }
+                else
+                {
+                        ++i;
+                }
+        }
+
+        used_area += (size_t)rect_width * rect_height;
+}
+
+bool SkylinePacker::insert(int rect_width, int rect_height, int &x, int &y)
+{
+        if (rect_width <= 0 || rect_height <= 0)
+                return false;
+
+        size_t best = skyline.size();
+        int best_top = 0;
+        int best_width = 0;
+        int best_y = 0;
+        for (size_t i = 0; i < skyline.size(); ++i)
+        {
+                int fit_y = fit(i, rect_width, rect_height);
+                if (fit_y < 0)
+                        continue;
+
+                int top = fit_y + rect_height;
+                if (best == skyline.size() || top < best_top ||
+                    (top == best_top && skyline[i].width < best_width))
+                {
+                        best = i;
+                        best_top = top;
+                        best_width = skyline[i].width;
+                        best_y = fit_y;
+                }
+        }
+
+        if (best == skyline.size())
+                return false;
+
+        x = skyline[best].x;
+        y = best_y;
+        place(best, x, y, rect_width, rect_height);
+
+        return true;
+}
+
+int SkylinePacker::get_width() const
+{
+        return width;
+}
+
+int SkylinePacker::get_height() const
+{
+        return height;
+}
+
+float SkylinePacker::occupancy() const
+{
+        return (float)used_area / ((float)width * height);
+}
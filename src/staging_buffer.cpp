@@ -0,0 +1,111 @@
+#include "staging_buffer.hpp"
+
+#include "gl_state.hpp"
+
+#include <glad/glad.h>
+
+#include <iterator>
+
+namespace
+{
+// Cache lines, and any GL_UNPACK_ALIGNMENT
+constexpr size_t ALIGNMENT = 64;
+
+size_t round_up(size_t size)
+{
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+}
+
+StagingBuffer::StagingBuffer(size_t size) : buffer_id(0), memory(nullptr), capacity(round_up(size))
+{
+        if (!glBufferStorage)
+                return;
+
+        // Coherent, the workers' writes are seen by the uploads issued
+        // after them without flushing
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer_id);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer_id);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, flags);
+        memory = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (memory)
+                free_ranges[0] = capacity;
+}
+
+StagingBuffer::~StagingBuffer()
+{
+        if (memory)
+        {
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer_id);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        if (buffer_id)
+                GLState::delete_buffer(buffer_id);
+}
+
+bool StagingBuffer::is_mapped() const
+{
+        return memory != nullptr;
+}
+
+unsigned int StagingBuffer::get_buffer() const
+{
+        return buffer_id;
+}
+
+size_t StagingBuffer::allocate(size_t size)
+{
+        size = round_up(size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto range = free_ranges.begin(); range != free_ranges.end(); ++range)
+        {
+                if (range->second < size)
+                        continue;
+
+                size_t offset = range->first;
+                size_t left = range->second - size;
+                free_ranges.erase(range);
+                if (left)
+                        free_ranges[offset + size] = left;
+
+                return offset;
+        }
+
+        return npos;
+}
+
+void StagingBuffer::release(size_t offset, size_t size)
+{
+        size = round_up(size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto next = free_ranges.lower_bound(offset);
+        if (next != free_ranges.end() && offset + size == next->first)
+        {
+                size += next->second;
+                next = free_ranges.erase(next);
+        }
+
+        if (next != free_ranges.begin())
+        {
+                auto previous = std::prev(next);
+                if (previous->first + previous->second == offset)
+                {
+                        previous->second += size;
+                        return;
+                }
+        }
+
+        free_ranges[offset] = size;
+}
+
+unsigned char *StagingBuffer::data(size_t offset) const
+{
+        return memory + offset;
+}
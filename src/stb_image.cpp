@@ -1,2 +1,9 @@
+#include "image_arena.hpp"
+
+// Scratch allocations go to the thread's arena inside an ImageArena::Scope
+#define STBI_MALLOC(size) ImageArena::allocate(size)
+#define STBI_REALLOC(block, size) ImageArena::reallocate(block, size)
+#define STBI_FREE(block) ImageArena::release(block)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
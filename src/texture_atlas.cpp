@@ -0,0 +1,321 @@
+#include "texture_atlas.hpp"
+
+#include "gl_state.hpp"
+#include "skyline_packer.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+namespace
+{
+int round_up(int value, int multiple)
+{
+        return (value + multiple - 1) / multiple * multiple;
+}
+
+int mip_count(int width, int height)
+{
+        int count = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+                ++count;
+
+        return count;
+}
+
+// Formats the texture loader creates, for glTexImage3D's sake
+GLenum base_format(GLenum internal_format)
+{
+        switch (internal_format)
+        {
+        case GL_R8:
+                return GL_RED;
+        case GL_RG8:
+                return GL_RG;
+        default:
+                return GL_RGBA;
+        }
+}
+
+int texel_bytes(GLenum internal_format)
+{
+        switch (internal_format)
+        {
+        case GL_R8:
+                return 1;
+        case GL_RG8:
+                return 2;
+        default:
+                return 4;
+        }
+}
+
+struct Packed
+{
+        size_t source;
+        int width;
+        int height;
+};
+}
+
+bool TextureAtlas::texture_storage = false;
+
+TextureAtlas::TextureAtlas(int padding) : padding(std::max(1, padding))
+{
+        // glTexStorage3D is 4.2, older contexts may have the extension
+        if (!glTexStorage3D && glfwExtensionSupported("GL_ARB_texture_storage"))
+                glad_glTexStorage3D = (PFNGLTEXSTORAGE3DPROC)glfwGetProcAddress("glTexStorage3D");
+        texture_storage = glTexStorage3D != nullptr;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+        clear();
+}
+
+void TextureAtlas::add(unsigned int texture)
+{
+        if (texture && std::find(textures.begin(), textures.end(), texture) == textures.end())
+                textures.push_back(texture);
+}
+
+void TextureAtlas::clear()
+{
+        for (auto &array : arrays)
+                GLState::delete_texture(array.id);
+        arrays.clear();
+        regions.clear();
+}
+
+void TextureAtlas::build()
+{
+        clear();
+
+        // Grouped by format, an array holds a single one
+        std::map<GLenum, std::vector<Source>> groups;
+        for (unsigned int texture : textures)
+        {
+                GLState::bind_texture(GL_TEXTURE_2D, texture);
+
+                GLint compressed = GL_FALSE, internal_format = 0;
+                Source source = {texture, 0, 0, {}};
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &source.width);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &source.height);
+                glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, source.swizzle);
+
+                if (compressed || source.width == 0 || source.height == 0)
+                {
+                        std::cerr << "Texture " << texture << " can't be copied into a texture array" << std::endl;
+                        continue;
+                }
+
+                groups[(GLenum)internal_format].push_back(source);
+        }
+
+        if (groups.empty())
+                return;
+
+        // Blits go through a pair of framebuffers, the scissor would clip them
+        unsigned int framebuffers[2];
+        glGenFramebuffers(2, framebuffers);
+        GLState::bind_framebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        GLState::bind_framebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+        GLState::disable(GL_SCISSOR_TEST);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        for (auto &group : groups)
+                build_array(group.first, group.second);
+
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+        GLState::delete_framebuffer(framebuffers[0]);
+        GLState::delete_framebuffer(framebuffers[1]);
+}
+
+void TextureAtlas::build_array(GLenum internal_format, std::vector<Source> &sources)
+{
+        int width = 0, height = 0;
+        bool same_size = true;
+        for (auto &source : sources)
+        {
+                width = std::max(width, source.width);
+                height = std::max(height, source.height);
+                same_size = same_size && source.width == sources[0].width && source.height == sources[0].height;
+        }
+
+        // Packed textures sit on padding aligned texels so their edges
+        // stay on texel boundaries down the mip chain
+        if (!same_size)
+        {
+                width = round_up(width, padding);
+                height = round_up(height, padding);
+        }
+
+        // Textures filling a layer first, the others tallest first into
+        // as few layers as the packer manages
+        Array array = {0, internal_format, width, height, 0, 0};
+        std::vector<Packed> packed;
+        std::vector<Region> placed(sources.size());
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+                if (sources[i].width == width && sources[i].height == height)
+                        placed[i] = Region{0, array.layers++, {0.f, 0.f}, {1.f, 1.f}};
+                else
+                        packed.push_back(Packed{i, sources[i].width, sources[i].height});
+        }
+
+        std::stable_sort(packed.begin(), packed.end(),
+                         [](const Packed &a, const Packed &b) { return a.height > b.height; });
+
+        // Bins are a padding larger than the layer on each side, the
+        // padding around textures at the layer's edges is never sampled
+        std::vector<SkylinePacker> bins;
+        std::vector<int> positions(sources.size() * 2, 0);
+        for (auto &texture : packed)
+        {
+                int slot_width = round_up(texture.width, padding) + 2 * padding;
+                int slot_height = round_up(texture.height, padding) + 2 * padding;
+
+                size_t bin = 0;
+                int x = 0, y = 0;
+                for (; bin < bins.size(); ++bin)
+                        if (bins[bin].insert(slot_width, slot_height, x, y))
+                                break;
+
+                if (bin == bins.size())
+                {
+                        bins.emplace_back(width + 2 * padding, height + 2 * padding);
+                        bins.back().insert(slot_width, slot_height, x, y);
+                }
+
+                // Bin to layer coordinates is -padding, the texture is
+                // padding into its slot
+                positions[texture.source * 2] = x;
+                positions[texture.source * 2 + 1] = y;
+                placed[texture.source] = Region{0, array.layers + (int)bin,
+                                                {(float)x / width, (float)y / height},
+                                                {(float)texture.width / width, (float)texture.height / height}};
+        }
+        array.layers += (int)bins.size();
+
+        int log2_padding = 0;
+        while ((2 << log2_padding) <= padding)
+                ++log2_padding;
+        array.levels = mip_count(width, height);
+        if (!bins.empty())
+                array.levels = std::min(array.levels, log2_padding + 1);
+
+        glGenTextures(1, &array.id);
+        GLState::bind_texture(GL_TEXTURE_2D_ARRAY, array.id);
+        if (texture_storage)
+        {
+                glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, internal_format, width, height, array.layers);
+        }
+        else
+        {
+                int level_width = width, level_height = height;
+                for (int level = 0; level < array.levels; ++level)
+                {
+                        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, level_width, level_height,
+                                     array.layers, 0, base_format(internal_format), GL_UNSIGNED_BYTE, nullptr);
+                        level_width = std::max(1, level_width / 2);
+                        level_height = std::max(1, level_height / 2);
+                }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+                Region &region = placed[i];
+                region.array = array.id;
+                blit(sources[i].texture, array.id, region.layer, positions[i * 2], positions[i * 2 + 1],
+                     sources[i].width, sources[i].height, width, height);
+                regions[sources[i].texture] = region;
+        }
+
+        GLState::bind_texture(GL_TEXTURE_2D_ARRAY, array.id);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        // Packed textures can't wrap into themselves
+        GLint wrap = bins.empty() ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, sources[0].swizzle);
+
+        arrays.push_back(array);
+}
+
+// The texture, then its edge texels stretched over the padding around it.
+// Parts of the padding past the layer are clipped by the blit.
+void TextureAtlas::blit(unsigned int texture, unsigned int array, int layer, int x, int y,
+                        int width, int height, int layer_width, int layer_height) const
+{
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, layer);
+
+        glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        if (width == layer_width && height == layer_height)
+                return;
+
+        // Source and destination spans along one axis: before, along and
+        // after the texture
+        int p = padding;
+        const int source_x[3][2] = {{0, 1}, {0, width}, {width - 1, width}};
+        const int source_y[3][2] = {{0, 1}, {0, height}, {height - 1, height}};
+        const int dest_x[3][2] = {{x - p, x}, {x, x + width}, {x + width, x + width + p}};
+        const int dest_y[3][2] = {{y - p, y}, {y, y + height}, {y + height, y + height + p}};
+        for (int row = 0; row < 3; ++row)
+        {
+                for (int column = 0; column < 3; ++column)
+                {
+                        if (row == 1 && column == 1)
+                                continue;
+
+                        glBlitFramebuffer(source_x[column][0], source_y[row][0], source_x[column][1],
+                                          source_y[row][1], dest_x[column][0], dest_y[row][0],
+                                          dest_x[column][1], dest_y[row][1], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                }
+        }
+}
+
+bool TextureAtlas::find(unsigned int texture, Region &region) const
+{
+        auto found = regions.find(texture);
+        if (found == regions.end())
+                return false;
+
+        region = found->second;
+        return true;
+}
+
+size_t TextureAtlas::array_count() const
+{
+        return arrays.size();
+}
+
+unsigned int TextureAtlas::get_array(size_t index) const
+{
+        return arrays[index].id;
+}
+
+size_t TextureAtlas::bytes() const
+{
+        size_t total = 0;
+        for (auto &array : arrays)
+        {
+                int width = array.width, height = array.height;
+                for (int level = 0; level < array.levels; ++level)
+                {
+                        total += (size_t)width * height * array.layers * texel_bytes(array.internal_format);
+                        width = std::max(1, width / 2);
+                        height = std::max(1, height / 2);
+                }
+        }
+
+        return total;
+}
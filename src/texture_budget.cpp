@@ -0,0 +1,250 @@
+#include "texture_budget.hpp"
+
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+TextureBudget::TextureBudget()
+    : budget(0), stats{}
+{
+}
+
+void TextureBudget::set_budget(size_t bytes)
+{
+        budget = bytes;
+        stats.budget = bytes;
+}
+
+void TextureBudget::add(unsigned int texture, GLenum internal_format, GLenum format, int channels,
+                        std::vector<unsigned char> data, const std::vector<Level> &levels)
+{
+        if (levels.empty())
+                return;
+
+        Entry &entry = entries[texture];
+        entry.internal_format = internal_format;
+        entry.format = format;
+        entry.channels = channels;
+        entry.data = std::move(data);
+        entry.levels = levels;
+        entry.wanted = 0;
+        entry.importance = 1.f;
+
+        int last = (int)levels.size() - 1;
+        entry.resident = entry.target = last;
+
+        // Complete from the start with its smallest level alone, which it
+        // keeps if the budget or its coverage never let it have more
+        GLState::bind_texture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, last);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last);
+        upload(texture, entry, last);
+
+        // Frees the loader's placeholder
+        if (last > 0)
+                evict(texture, entry, 0);
+}
+
+void TextureBudget::remove(unsigned int texture)
+{
+        entries.erase(texture);
+}
+
+bool TextureBudget::contains(unsigned int texture) const
+{
+        return entries.count(texture) != 0;
+}
+
+void TextureBudget::set_coverage(unsigned int texture, float pixels)
+{
+        auto found = entries.find(texture);
+        if (found == entries.end())
+                return;
+
+        Entry &entry = found->second;
+        int last = (int)entry.levels.size() - 1;
+        entry.importance = std::max(pixels, 0.f);
+        if (pixels <= 0.f)
+        {
+                entry.wanted = last;
+                return;
+        }
+
+        // Each level has a quarter of the texels of the one above
+        double texels = (double)entry.levels[0].width * entry.levels[0].height;
+        int level = (int)std::floor(0.5 * std::log2(texels / pixels));
+        entry.wanted = std::min(std::max(level, 0), last);
+}
+
+void TextureBudget::update()
+{
+        stats.streamed = stats.evicted = 0;
+        stats.streamed_bytes = stats.evicted_bytes = 0;
+
+        size_t wanted = 0;
+        for (auto &item : entries)
+        {
+                item.second.target = item.second.wanted;
+                wanted += chain_bytes(item.second, item.second.wanted);
+        }
+
+        // Drops the top level of the texture that loses least, its
+        // importance counting four times more for every level it already
+        // lost, since each of its texels now covers four times the pixels
+        size_t total = wanted;
+        if (budget && total > budget)
+        {
+                typedef std::pair<float, unsigned int> Candidate;
+                std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+                for (auto &item : entries)
+                        if (item.second.target < (int)item.second.levels.size() - 1)
+                                candidates.push(Candidate(item.second.importance, item.first));
+
+                while (total > budget && !candidates.empty())
+                {
+                        unsigned int texture = candidates.top().second;
+                        candidates.pop();
+
+                        Entry &entry = entries[texture];
+                        total -= entry.levels[entry.target].size;
+                        ++entry.target;
+
+                        if (entry.target < (int)entry.levels.size() - 1)
+                        {
+                                float weight = entry.importance * std::pow(4.f, (float)(entry.target - entry.wanted));
+                                candidates.push(Candidate(weight, texture));
+                        }
+                }
+        }
+
+        // Evicted first so the levels streamed in below fit
+        for (auto &item : entries)
+        {
+                Entry &entry = item.second;
+                if (entry.resident >= entry.target)
+                        continue;
+
+                GLState::bind_texture(GL_TEXTURE_2D, item.first);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.target);
+                for (int level = entry.resident; level < entry.target; ++level)
+                {
+                        evict(item.first, entry, level);
+                        ++stats.evicted;
+                        ++stats.total_evicted;
+                        stats.evicted_bytes += entry.levels[level].size;
+                }
+                entry.resident = entry.target;
+        }
+
+        // Smallest levels first across every texture, so all of them get
+        // sharper before any gets its largest level
+        typedef std::pair<size_t, unsigned int> Candidate;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+        for (auto &item : entries)
+                if (item.second.resident > item.second.target)
+                        candidates.push(Candidate(item.second.levels[item.second.resident - 1].size, item.first));
+
+        while (!candidates.empty() && (stats.streamed == 0 || stats.streamed_bytes < FRAME_BUDGET))
+        {
+                unsigned int texture = candidates.top().second;
+                candidates.pop();
+
+                Entry &entry = entries[texture];
+                int level = entry.resident - 1;
+                upload(texture, entry, level);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+                entry.resident = level;
+
+                ++stats.streamed;
+                ++stats.total_streamed;
+                stats.streamed_bytes += entry.levels[level].size;
+
+                if (entry.resident > entry.target)
+                        candidates.push(Candidate(entry.levels[entry.resident - 1].size, texture));
+        }
+
+        stats.used = 0;
+        stats.wanted = wanted;
+        stats.textures = (unsigned int)entries.size();
+        stats.degraded = 0;
+        for (auto &item : entries)
+        {
+                stats.used += chain_bytes(item.second, item.second.resident);
+                if (item.second.target > item.second.wanted)
+                        ++stats.degraded;
+        }
+}
+
+size_t TextureBudget::bytes(unsigned int texture) const
+{
+        auto found = entries.find(texture);
+        return found == entries.end() ? 0 : chain_bytes(found->second, found->second.resident);
+}
+
+size_t TextureBudget::level_bytes(unsigned int texture, int level) const
+{
+        auto found = entries.find(texture);
+        if (found == entries.end() || level < 0 || level >= (int)found->second.levels.size())
+                return 0;
+
+        return found->second.levels[level].size;
+}
+
+int TextureBudget::resident_level(unsigned int texture) const
+{
+        auto found = entries.find(texture);
+        return found == entries.end() ? -1 : found->second.resident;
+}
+
+const TextureBudget::Stats &TextureBudget::get_stats() const
+{
+        return stats;
+}
+
+size_t TextureBudget::chain_bytes(const Entry &entry, int first)
+{
+        size_t bytes = 0;
+        for (size_t i = first; i < entry.levels.size(); ++i)
+                bytes += entry.levels[i].size;
+
+        return bytes;
+}
+
+// From client memory, the whole chain stays on the heap for levels to
+// come back after an eviction
+void TextureBudget::upload(unsigned int texture, Entry &entry, int level)
+{
+        const Level &source = entry.levels[level];
+        const unsigned char *pixels = entry.data.data() + source.offset;
+
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, texture);
+        if (!entry.format)
+        {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.internal_format, source.width, source.height, 0,
+                                       (int)source.size, pixels);
+                return;
+        }
+
+        int alignment = GLState::unpack_alignment((size_t)source.width * entry.channels);
+        if (alignment != 4)
+                glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+        glTexImage2D(GL_TEXTURE_2D, level, entry.internal_format, source.width, source.height, 0, entry.format,
+                     GL_UNSIGNED_BYTE, pixels);
+
+        if (alignment != 4)
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// An empty level holds no memory. Below the base level it doesn't make
+// the texture incomplete.
+void TextureBudget::evict(unsigned int texture, Entry &entry, int level)
+{
+        GLState::bind_texture(GL_TEXTURE_2D, texture);
+        GLenum internal_format = entry.format ? entry.internal_format : GL_RGBA8;
+        glTexImage2D(GL_TEXTURE_2D, level, internal_format, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+}
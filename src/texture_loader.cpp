@@ -0,0 +1,659 @@
+#include "texture_loader.hpp"
+
+#include "block_compression.hpp"
+#include "gl_state.hpp"
+#include "image_source.hpp"
+#include "ktx_file.hpp"
+#include "mip_generator.hpp"
+#include "stb/stb_image.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+// Far longer than any upload, only there to survive a lost context
+constexpr GLuint64 FENCE_TIMEOUT = 1000000000;
+
+// Sized formats matching the decoded channels, so the driver copies the
+// rows as they are. Grey and grey alpha images are swizzled back to RGBA.
+struct PixelFormat
+{
+        GLenum internal_format;
+        GLenum format;
+        GLint swizzle[4];
+};
+
+PixelFormat pixel_format(int channels)
+{
+        switch (channels)
+        {
+        case 1:
+                return PixelFormat{GL_R8, GL_RED, {GL_RED, GL_RED, GL_RED, GL_ONE}};
+        case 2:
+                return PixelFormat{GL_RG8, GL_RG, {GL_RED, GL_RED, GL_RED, GL_GREEN}};
+        default:
+                return PixelFormat{GL_RGBA8, GL_RGBA, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+        }
+}
+
+int mip_count(int width, int height)
+{
+        int count = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+                ++count;
+
+        return count;
+}
+
+size_t mip_chain_bytes(int width, int height, int channels)
+{
+        size_t bytes = 0;
+        for (;;)
+        {
+                bytes += (size_t)width * height * channels;
+                if (width == 1 && height == 1)
+                        return bytes;
+
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+        }
+}
+
+bool has_extension(const std::string &filepath, const char *extension)
+{
+        size_t length = strlen(extension);
+        return filepath.size() >= length &&
+               filepath.compare(filepath.size() - length, length, extension) == 0;
+}
+}
+
+const unsigned char *TextureLoader::Image::data() const
+{
+        return pixels ? pixels : buffer.data();
+}
+
+size_t TextureLoader::Image::size() const
+{
+        return levels.empty() ? 0 : levels.back().offset + levels.back().size;
+}
+
+TextureLoader::TextureLoader(unsigned int threads)
+    : stopping(false), budget(nullptr), ring{}, next_slot(0), pending(0)
+{
+        s3tc_supported = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+        s3tc_srgb_supported = s3tc_supported && glfwExtensionSupported("GL_EXT_texture_sRGB");
+        etc2_supported = GLAD_GL_VERSION_4_3 || glfwExtensionSupported("GL_ARB_ES3_compatibility");
+
+        // The loader only fetches glTexStorage2D for 4.2 contexts, older
+        // ones may still have it through the extension
+        if (!glTexStorage2D && glfwExtensionSupported("GL_ARB_texture_storage"))
+                glad_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+        texture_storage = glTexStorage2D != nullptr;
+
+        // Same for glBufferStorage before 4.4
+        if (!glBufferStorage && glfwExtensionSupported("GL_ARB_buffer_storage"))
+                glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+        if (glBufferStorage)
+                staging.reset(new StagingBuffer(STAGING_SIZE));
+
+        if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0; i < threads; ++i)
+                workers.emplace_back(&TextureLoader::run, this);
+
+        for (auto &slot : ring)
+                glGenBuffers(1, &slot.buffer);
+}
+
+TextureLoader::~TextureLoader()
+{
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+        }
+        job_ready.notify_all();
+
+        for (auto &worker : workers)
+                worker.join();
+
+        for (auto &image : images)
+                stbi_image_free(image.pixels);
+
+        for (auto &slot : ring)
+        {
+                if (slot.fence)
+                        glDeleteSync(slot.fence);
+                GLState::delete_buffer(slot.buffer);
+        }
+
+        for (auto &upload : staged_uploads)
+                glDeleteSync(upload.fence);
+}
+
+unsigned int TextureLoader::load(const std::string &filepath, bool flip, int max_size)
+{
+        if (pending == 0)
+                start_time = std::chrono::steady_clock::now();
+
+        // Mid grey until the image is uploaded, a single texel is mipmap
+        // complete so it samples fine with the default filters
+        static const unsigned char placeholder[4] = {128, 128, 128, 255};
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLState::bind_texture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+        textures[texture] = Info{Status::PENDING, 1, 1, 4, 4};
+        ++pending;
+
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(Job{texture, filepath, flip, max_size, budget != nullptr});
+        }
+        job_ready.notify_one();
+
+        return texture;
+}
+
+void TextureLoader::set_budget(TextureBudget *budget)
+{
+        this->budget = budget;
+}
+
+unsigned int TextureLoader::update()
+{
+        return upload(false);
+}
+
+void TextureLoader::wait()
+{
+        while (pending)
+        {
+                {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        image_ready.wait(lock, [this]() { return !images.empty(); });
+                }
+
+                upload(true);
+        }
+}
+
+TextureLoader::Status TextureLoader::get_status(unsigned int texture) const
+{
+        return get_info(texture).status;
+}
+
+TextureLoader::Info TextureLoader::get_info(unsigned int texture) const
+{
+        auto info = textures.find(texture);
+        return info == textures.end() ? Info{Status::FAILED, 0, 0, 0, 0} : info->second;
+}
+
+void TextureLoader::forget(unsigned int texture)
+{
+        auto info = textures.find(texture);
+        if (info != textures.end() && info->second.status != Status::PENDING)
+                textures.erase(info);
+}
+
+unsigned int TextureLoader::pending_count() const
+{
+        return pending;
+}
+
+unsigned int TextureLoader::thread_count() const
+{
+        return (unsigned int)workers.size();
+}
+
+void TextureLoader::run()
+{
+        for (;;)
+        {
+                Job job;
+                {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        job_ready.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                        if (stopping)
+                                return;
+
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                }
+
+                Image image;
+                image.texture = job.texture;
+                image.filepath = job.filepath;
+                image.staged = StagingBuffer::npos;
+                image.pixels = nullptr;
+                image.compressed_format = 0;
+                image.width = image.height = image.channels = 0;
+                image.streamed = job.streamed;
+                image.srgb = false;
+                if (!decode(job, image))
+                        image.levels.clear();
+
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        images.push_back(std::move(image));
+                }
+                image_ready.notify_one();
+        }
+}
+
+bool TextureLoader::decode(const Job &job, Image &image) const
+{
+        if (has_extension(job.filepath, ".ktx2"))
+                return decode_ktx(job, image);
+
+        ImageSource source(job.filepath);
+        if (!source.is_open())
+        {
+                std::cerr << "Error while loading texture \"" << job.filepath
+                          << "\": can't open the file\n";
+                return false;
+        }
+
+        // RGB is expanded while decoding, drivers would pad it to RGBA
+        // themselves and convert every texel on upload
+        int file_channels = 0;
+        int channels = 0;
+        if (source.info(&image.width, &image.height, &file_channels))
+                channels = file_channels == 3 ? 4 : file_channels;
+
+        // Halved until the larger side fits, 1/8 at most
+        int scale = 1;
+        if (job.max_size > 0 && source.is_jpeg())
+        {
+                while (scale < 8 && ImageSource::scaled_size(std::max(image.width, image.height), scale) > job.max_size)
+                        scale *= 2;
+
+                image.width = ImageSource::scaled_size(image.width, scale);
+                image.height = ImageSource::scaled_size(image.height, scale);
+        }
+
+        // Into the staging buffer if there's room, flipped as the rows are
+        // written and no copy left for the GL thread. Streamed images keep
+        // their levels on the heap instead.
+        size_t size = (size_t)image.width * image.height * channels;
+        bool stage = channels && !job.streamed && staging && staging->is_mapped();
+        size_t offset = stage ? staging->allocate(size) : StagingBuffer::npos;
+        if (offset != StagingBuffer::npos)
+        {
+                if (!source.load_into(staging->data(offset), image.width * channels, size, &image.width,
+                                      &image.height, &file_channels, channels, job.flip, scale))
+                {
+                        staging->release(offset, size);
+                        std::cerr << "Error while loading texture \"" << job.filepath
+                                  << "\": " << stbi_failure_reason() << "\n";
+                        return false;
+                }
+
+                image.staged = offset;
+                image.channels = channels;
+                image.levels.push_back(Level{0, size, image.width, image.height});
+
+                return true;
+        }
+
+        // Flipped as the rows are written, not in a pass of its own
+        image.pixels = source.load(&image.width, &image.height, &image.channels, channels, job.flip, scale);
+        if (!image.pixels)
+        {
+                std::cerr << "Error while loading texture \"" << job.filepath
+                          << "\": " << stbi_failure_reason() << "\n";
+                return false;
+        }
+
+        if (channels)
+                image.channels = channels;
+
+        size = (size_t)image.width * image.height * image.channels;
+        image.levels.push_back(Level{0, size, image.width, image.height});
+
+        if (job.streamed)
+                build_mips(image);
+
+        return true;
+}
+
+// The compressor already flipped the image and built its mip chain
+bool TextureLoader::decode_ktx(const Job &job, Image &image) const
+{
+        ImageSource source(job.filepath);
+        KtxImage ktx;
+        BlockFormat format;
+        bool srgb = false;
+        bool valid = source.is_open() && ktx.read(source.data(), source.size());
+        bool uncompressed = ktx.vk_format == KTX_FORMAT_RGBA8 || ktx.vk_format == KTX_FORMAT_RGBA8_SRGB;
+        if (!valid || !(uncompressed || block_format_from_vk(ktx.vk_format, format, &srgb)))
+        {
+                std::cerr << "Error while loading texture \"" << job.filepath
+                          << "\": not a supported KTX2 file\n";
+                return false;
+        }
+
+        image.width = ktx.width;
+        image.height = ktx.height;
+
+        image.srgb = srgb || ktx.vk_format == KTX_FORMAT_RGBA8_SRGB;
+
+        // Baked mipmaps, uploaded level by level
+        if (uncompressed)
+        {
+                image.channels = 4;
+                for (auto &level : ktx.levels)
+                        image.levels.push_back(Level{level.offset, level.size, level.width, level.height});
+                image.buffer = std::move(ktx.data);
+
+                return true;
+        }
+
+        image.channels = block_channels(format) == 3 ? 3 : 4;
+
+        bool supported = format == BlockFormat::BC5 ||
+                         (format == BlockFormat::ETC2_RGB ? etc2_supported
+                                                          : srgb ? s3tc_srgb_supported : s3tc_supported);
+        if (supported)
+        {
+                image.compressed_format = block_gl_format(format, srgb);
+                for (auto &level : ktx.levels)
+                        image.levels.push_back(Level{level.offset, level.size, level.width, level.height});
+                image.buffer = std::move(ktx.data);
+
+                return true;
+        }
+
+        // Decoded to RGBA, still better than failing
+        image.channels = 4;
+        for (auto &level : ktx.levels)
+        {
+                size_t size = (size_t)level.width * level.height * 4;
+                image.levels.push_back(Level{image.buffer.size(), size, level.width, level.height});
+                image.buffer.resize(image.buffer.size() + size);
+                decompress_blocks(format, ktx.data.data() + level.offset, level.width, level.height,
+                                  image.buffer.data() + image.levels.back().offset);
+        }
+
+        return true;
+}
+
+// The same Kaiser filtered chain in linear light texture_compressor bakes,
+// every level down to 1x1 after level 0 in image.buffer. Grey and grey
+// alpha or RGB images go through RGBA and are packed back. The loader already
+// runs a worker per core, the generator doesn't split rows further.
+void TextureLoader::build_mips(Image &image)
+{
+        int channels = image.channels;
+        size_t texels = (size_t)image.width * image.height;
+        const unsigned char *rgba = image.pixels;
+        std::vector<unsigned char> expanded;
+        if (channels != 4)
+        {
+                expanded.resize(texels * 4);
+                for (size_t i = 0; i < texels; ++i)
+                {
+                        const unsigned char *texel = image.pixels + i * channels;
+                        for (int c = 0; c < 3; ++c)
+                                expanded[i * 4 + c] = texel[channels < 3 ? 0 : c];
+                        expanded[i * 4 + 3] = channels == 2 ? texel[1] : 255;
+                }
+                rgba = expanded.data();
+        }
+
+        MipOptions options;
+        options.threads = 1;
+        std::vector<MipLevel> mips = generate_mips(rgba, image.width, image.height, options);
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+
+        image.levels.clear();
+        image.buffer.resize(mip_chain_bytes(image.width, image.height, channels));
+        size_t offset = 0;
+        for (auto &mip : mips)
+        {
+                size_t count = (size_t)mip.width * mip.height;
+                unsigned char *out = image.buffer.data() + offset;
+                if (channels == 4)
+                {
+                        memcpy(out, mip.pixels.data(), count * 4);
+                }
+                else
+                {
+                        // Grey is red, its alpha the second channel
+                        for (size_t i = 0; i < count; ++i)
+                                for (int c = 0; c < channels; ++c)
+                                        out[i * channels + c] = mip.pixels[i * 4 + (channels == 2 && c == 1 ? 3 : c)];
+                }
+
+                image.levels.push_back(Level{offset, count * channels, mip.width, mip.height});
+                offset += count * channels;
+        }
+}
+
+// Uploads finish in order, the first pending fence ends the scan
+void TextureLoader::release_staged()
+{
+        while (!staged_uploads.empty())
+        {
+                StagedUpload &upload = staged_uploads.front();
+                if (glClientWaitSync(upload.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                        return;
+
+                glDeleteSync(upload.fence);
+                staging->release(upload.offset, upload.size);
+                staged_uploads.pop_front();
+        }
+}
+
+unsigned int TextureLoader::upload(bool blocking)
+{
+        release_staged();
+
+        unsigned int completed = 0;
+        size_t uploaded = 0;
+        while (blocking || uploaded < FRAME_BUDGET)
+        {
+                Image image;
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (images.empty())
+                                break;
+
+                        image = std::move(images.front());
+                        images.pop_front();
+                }
+
+                bool decoded = !image.levels.empty();
+                size_t size = image.size();
+                if (decoded && image.streamed && budget)
+                {
+                        PixelFormat format = pixel_format(image.channels);
+                        if (image.srgb)
+                                format.internal_format = GL_SRGB8_ALPHA8;
+                        if (image.compressed_format)
+                                budget->add(image.texture, image.compressed_format, 0, 0, std::move(image.buffer),
+                                            image.levels);
+                        else
+                                budget->add(image.texture, format.internal_format, format.format, image.channels,
+                                            std::move(image.buffer), image.levels);
+
+                        GLState::bind_texture(GL_TEXTURE_2D, image.texture);
+                        if (!image.compressed_format)
+                                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+                        // Only the smallest level went up
+                        size = image.levels.back().size;
+                }
+                else if (decoded && !upload(image, blocking))
+                {
+                        // The next slot is still in flight, retry next frame
+                        std::lock_guard<std::mutex> lock(mutex);
+                        images.push_front(std::move(image));
+                        break;
+                }
+
+                if (decoded)
+                {
+                        size_t bytes = 0;
+                        if (image.compressed_format)
+                                bytes = image.size();
+                        else if (image.levels.size() > 1)
+                                for (auto &level : image.levels)
+                                        bytes += (size_t)level.width * level.height * image.channels;
+                        else
+                                bytes = mip_chain_bytes(image.width, image.height, image.channels);
+
+                        textures[image.texture] = Info{Status::READY, image.width, image.height,
+                                                       image.channels, bytes};
+                }
+                else
+                {
+                        textures[image.texture].status = Status::FAILED;
+                }
+
+                uploaded += size;
+                stbi_image_free(image.pixels);
+                --pending;
+                ++completed;
+        }
+
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (completed && pending == 0)
+        {
+                auto elapsed = std::chrono::steady_clock::now() - start_time;
+                std::cout << "Textures loaded on " << workers.size() << " threads: "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                          << " ms\n";
+        }
+
+        return completed;
+}
+
+bool TextureLoader::upload(const Image &image, bool blocking)
+{
+        size_t size = image.size();
+        const void *data = nullptr;
+
+        Slot &slot = ring[next_slot];
+        if (image.staged != StagingBuffer::npos)
+        {
+                // Already in the buffer, the pointers below are offsets in it
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, staging->get_buffer());
+                data = (const void *)image.staged;
+        }
+        else if (slot.fence)
+        {
+                GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                 blocking ? FENCE_TIMEOUT : 0);
+                if (result == GL_TIMEOUT_EXPIRED)
+                        return false;
+
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+        }
+
+        if (image.staged == StagingBuffer::npos)
+        {
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                if (slot.capacity < size)
+                {
+                        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+                        slot.capacity = size;
+                }
+
+                // The fence guarantees the previous upload from the slot is done
+                void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                                 GL_MAP_UNSYNCHRONIZED_BIT);
+                if (ptr)
+                {
+                        memcpy(ptr, image.data(), size);
+                        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                }
+                else
+                {
+                        // Upload straight from the decoded pixels instead
+                        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                        data = image.data();
+                }
+        }
+
+        GLState::bind_texture(GL_TEXTURE_2D, image.texture);
+        PixelFormat format = pixel_format(image.channels);
+        if (image.srgb)
+                format.internal_format = GL_SRGB8_ALPHA8;
+        GLenum internal_format = image.compressed_format ? image.compressed_format : format.internal_format;
+
+        // Files carry their own mip chain, possibly cut short
+        bool generate = image.levels.size() == 1 && !image.compressed_format;
+        int levels = generate ? mip_count(image.width, image.height) : (int)image.levels.size();
+
+        if (texture_storage)
+                glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, image.width, image.height);
+        else
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        int alignment = 4;
+        for (size_t i = 0; i < image.levels.size(); ++i)
+        {
+                const Level &level = image.levels[i];
+                const unsigned char *source = (const unsigned char *)data + level.offset;
+                if (image.compressed_format)
+                {
+                        if (texture_storage)
+                                glCompressedTexSubImage2D(GL_TEXTURE_2D, (int)i, 0, 0, level.width, level.height,
+                                                          internal_format, (int)level.size, source);
+                        else
+                                glCompressedTexImage2D(GL_TEXTURE_2D, (int)i, internal_format, level.width,
+                                                       level.height, 0, (int)level.size, source);
+                        continue;
+                }
+
+                // Rows are tightly packed, odd widths of 1 and 2 channel
+                // levels aren't 4 byte aligned
+                int row_alignment = GLState::unpack_alignment((size_t)level.width * image.channels);
+                if (row_alignment != alignment)
+                {
+                        glPixelStorei(GL_UNPACK_ALIGNMENT, row_alignment);
+                        alignment = row_alignment;
+                }
+
+                if (texture_storage)
+                        glTexSubImage2D(GL_TEXTURE_2D, (int)i, 0, 0, level.width, level.height,
+                                        format.format, GL_UNSIGNED_BYTE, source);
+                else
+                        glTexImage2D(GL_TEXTURE_2D, (int)i, internal_format, level.width, level.height, 0,
+                                     format.format, GL_UNSIGNED_BYTE, source);
+        }
+
+        if (alignment != 4)
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        if (!image.compressed_format)
+                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+        if (generate)
+                glGenerateMipmap(GL_TEXTURE_2D);
+
+        if (image.staged != StagingBuffer::npos)
+        {
+                // The range goes back to the workers once the GPU read it
+                GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                staged_uploads.push_back(StagedUpload{fence, image.staged, size});
+                return true;
+        }
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next_slot = (next_slot + 1) % RING_SIZE;
+
+        return true;
+}
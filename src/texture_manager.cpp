@@ -0,0 +1,236 @@
+#include "texture_manager.hpp"
+
+#include "gl_state.hpp"
+#include "hash.hpp"
+#include "image_source.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+Texture::Texture() : manager(nullptr), id(0)
+{
+}
+
+Texture::Texture(TextureManager *manager, unsigned int id)
+    : manager(manager), id(id)
+{
+        if (manager)
+                manager->retain(id);
+}
+
+Texture::~Texture()
+{
+        if (manager)
+                manager->release(id);
+}
+
+Texture::Texture(const Texture &other) : Texture(other.manager, other.id)
+{
+}
+
+Texture::Texture(Texture &&other) : manager(other.manager), id(other.id)
+{
+        other.manager = nullptr;
+        other.id = 0;
+}
+
+Texture &Texture::operator=(Texture other)
+{
+        std::swap(manager, other.manager);
+        std::swap(id, other.id);
+
+        return *this;
+}
+
+unsigned int Texture::get_id() const
+{
+        return id;
+}
+
+bool Texture::valid() const
+{
+        return manager != nullptr;
+}
+
+size_t Texture::vram_bytes() const
+{
+        return manager ? manager->vram_bytes(id) : 0;
+}
+
+TextureManager::TextureManager(unsigned int threads) : loader(threads), max_size(0)
+{
+}
+
+TextureManager::~TextureManager()
+{
+        // Pending uploads must land before their names can be deleted
+        loader.wait();
+
+        for (auto &entry : entries)
+                GLState::delete_texture(entry.first);
+
+        for (unsigned int texture : released)
+                GLState::delete_texture(texture);
+}
+
+Texture TextureManager::acquire(const std::string &filepath)
+{
+        std::string path = canonical_path(filepath);
+
+        auto known = by_path.find(path);
+        if (known != by_path.end())
+                return Texture(this, known->second);
+
+        // Only the raw file is hashed, which is far cheaper than decoding it
+        ImageSource source(path);
+        if (!source.is_open())
+        {
+                std::cerr << "Error while loading texture \"" << filepath << "\"\n";
+                return Texture();
+        }
+
+        uint64_t content_hash = hash_bytes(source.data(), source.size());
+        auto same = by_content.find(content_hash);
+        if (same != by_content.end())
+        {
+                entries[same->second].paths.push_back(path);
+                by_path[path] = same->second;
+
+                return Texture(this, same->second);
+        }
+
+        unsigned int texture = loader.load(path, true, max_size);
+        entries[texture] = Entry{{path}, content_hash, 0};
+        by_path[path] = texture;
+        by_content[content_hash] = texture;
+
+        return Texture(this, texture);
+}
+
+void TextureManager::set_max_size(int size)
+{
+        max_size = size;
+}
+
+void TextureManager::set_budget(size_t bytes)
+{
+        budget.set_budget(bytes);
+        loader.set_budget(bytes ? &budget : nullptr);
+}
+
+void TextureManager::set_coverage(const Texture &texture, float pixels)
+{
+        budget.set_coverage(texture.get_id(), pixels);
+}
+
+const TextureBudget::Stats &TextureManager::budget_stats() const
+{
+        return budget.get_stats();
+}
+
+void TextureManager::update()
+{
+        loader.update();
+        budget.update();
+
+        for (size_t i = 0; i < released.size();)
+        {
+                if (loader.get_status(released[i]) == TextureLoader::Status::PENDING)
+                {
+                        ++i;
+                        continue;
+                }
+
+                destroy(released[i]);
+                released[i] = released.back();
+                released.pop_back();
+        }
+}
+
+void TextureManager::wait()
+{
+        loader.wait();
+        update();
+}
+
+TextureLoader::Status TextureManager::get_status(const Texture &texture) const
+{
+        return loader.get_status(texture.get_id());
+}
+
+unsigned int TextureManager::pending_count() const
+{
+        return loader.pending_count();
+}
+
+size_t TextureManager::vram_bytes(unsigned int texture) const
+{
+        if (budget.contains(texture))
+                return budget.bytes(texture);
+
+        return loader.get_info(texture).bytes;
+}
+
+size_t TextureManager::total_vram_bytes() const
+{
+        size_t total = 0;
+        for (auto &entry : entries)
+                total += vram_bytes(entry.first);
+
+        return total;
+}
+
+unsigned int TextureManager::size() const
+{
+        return (unsigned int)entries.size();
+}
+
+void TextureManager::report(std::ostream &out) const
+{
+        for (auto &entry : entries)
+        {
+                TextureLoader::Info info = loader.get_info(entry.first);
+                out << entry.second.paths.front() << ": " << info.width << "x" << info.height
+                    << ", " << entry.second.references << " references, "
+                    << vram_bytes(entry.first) / 1024 << " KiB";
+                if (budget.contains(entry.first))
+                        out << " from level " << budget.resident_level(entry.first);
+                out << "\n";
+
+                for (size_t i = 1; i < entry.second.paths.size(); ++i)
+                        out << "    same content as " << entry.second.paths[i] << "\n";
+        }
+
+        out << entries.size() << " textures, " << total_vram_bytes() / 1024 << " KiB\n";
+}
+
+void TextureManager::retain(unsigned int texture)
+{
+        ++entries[texture].references;
+}
+
+void TextureManager::release(unsigned int texture)
+{
+        auto entry = entries.find(texture);
+        if (entry == entries.end() || --entry->second.references > 0)
+                return;
+
+        for (auto &path : entry->second.paths)
+                by_path.erase(path);
+        by_content.erase(entry->second.content_hash);
+        entries.erase(entry);
+
+        if (loader.get_status(texture) == TextureLoader::Status::PENDING)
+                released.push_back(texture);
+        else
+                destroy(texture);
+}
+
+void TextureManager::destroy(unsigned int texture)
+{
+        GLState::delete_texture(texture);
+        budget.remove(texture);
+        loader.forget(texture);
+}
@@ -0,0 +1,101 @@
+#include "uniform_buffer.hpp"
+
+#include "gl_state.hpp"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+std::unordered_map<std::string, unsigned int> block_bindings;
+
+// A frame should never still be in flight two frames later, only give up
+// waiting after a full second to survive a lost context
+constexpr GLuint64 FENCE_TIMEOUT = 1000000000;
+}
+
+UniformBuffer::UniformBuffer(const std::string &block, unsigned int binding,
+                             size_t size)
+    : block(block), binding(binding), size(size), frame(0), fences{}
+{
+        int alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (size + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &buffer_id);
+        GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_id);
+        glBufferData(GL_UNIFORM_BUFFER, stride * FRAMES, nullptr, GL_DYNAMIC_DRAW);
+        GLState::bind_buffer_range(GL_UNIFORM_BUFFER, binding, buffer_id, 0, size);
+
+        block_bindings[block] = binding;
+}
+
+UniformBuffer::~UniformBuffer()
+{
+        for (auto &fence : fences)
+        {
+                if (fence)
+                        glDeleteSync(fence);
+        }
+
+        // Unless another buffer took the name over since
+        auto registered = block_bindings.find(block);
+        if (registered != block_bindings.end() && registered->second == binding)
+                block_bindings.erase(registered);
+
+        GLState::delete_buffer(buffer_id);
+}
+
+void UniformBuffer::update(const void *data)
+{
+        unsigned int slot = frame % FRAMES;
+        if (fences[slot])
+        {
+                glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+                glDeleteSync(fences[slot]);
+                fences[slot] = nullptr;
+        }
+
+        // The fence guarantees the GPU is done with the slot, no need for
+        // the driver to synchronize the mapping
+        GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_id);
+        void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER, slot * stride, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                         GL_MAP_UNSYNCHRONIZED_BIT);
+        if (ptr)
+        {
+                memcpy(ptr, data, size);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+
+        GLState::bind_buffer_range(GL_UNIFORM_BUFFER, binding, buffer_id, slot * stride, size);
+}
+
+void UniformBuffer::end_frame()
+{
+        unsigned int slot = frame % FRAMES;
+        if (!fences[slot])
+                fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        ++frame;
+}
+
+void UniformBuffer::bind_blocks(unsigned int program)
+{
+        int blocks = 0;
+        int max_length = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+
+        std::vector<char> name(max_length + 1);
+        for (int i = 0; i < blocks; ++i)
+        {
+                int length = 0;
+                glGetActiveUniformBlockName(program, i, (int)name.size(), &length, name.data());
+
+                auto binding = block_bindings.find(std::string(name.data(), length));
+                if (binding != block_bindings.end())
+                        glUniformBlockBinding(program, i, binding->second);
+        }
+}
@@ -0,0 +1,115 @@
+#include "uniform_table.hpp"
+
+#include <glad/glad.h>
+
+#include "hash.hpp"
+
+#include <utility>
+
+UniformTable::UniformTable() : count(0)
+{
+}
+
+void UniformTable::reflect(unsigned int program)
+{
+        clear();
+
+        int active = 0;
+        int max_length = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+        std::vector<std::pair<std::string, UniformHandle>> uniforms;
+        std::vector<char> name(max_length + 1);
+        for (int i = 0; i < active; ++i)
+        {
+                int length = 0;
+                int size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(program, i, (int)name.size(), &length,
+                                   &size, &type, name.data());
+
+                std::string uniform(name.data(), length);
+                int location = glGetUniformLocation(program, uniform.c_str());
+
+                // Members of uniform blocks have no location
+                if (location == -1)
+                        continue;
+
+                uniforms.emplace_back(uniform, UniformHandle(location, type));
+
+                // Arrays are reported as "name[0]", also register "name"
+                // and the location of every other element
+                size_t bracket = uniform.rfind("[0]");
+                if (bracket != std::string::npos && bracket + 3 == uniform.size())
+                {
+                        std::string base = uniform.substr(0, bracket);
+                        uniforms.emplace_back(base, UniformHandle(location, type));
+
+                        for (int j = 1; j < size; ++j)
+                        {
+                                std::string element = base + "[" + std::to_string(j) + "]";
+                                int element_location = glGetUniformLocation(program, element.c_str());
+                                uniforms.emplace_back(element, UniformHandle(element_location, type));
+                        }
+                }
+        }
+
+        unsigned int capacity = 8;
+        while (capacity < uniforms.size() * 2)
+                capacity *= 2;
+
+        slots.assign(capacity, Slot{0, "", UniformHandle()});
+        for (auto &uniform : uniforms)
+                insert(uniform.first, uniform.second);
+}
+
+void UniformTable::clear()
+{
+        slots.clear();
+        count = 0;
+}
+
+UniformHandle UniformTable::find(const char *name) const
+{
+        if (slots.empty())
+                return UniformHandle();
+
+        uint64_t hash = hash_string(name);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+                const Slot &slot = slots[i];
+                if (!slot.handle.valid())
+                        return UniformHandle();
+
+                if (slot.hash == hash && slot.name == name)
+                        return slot.handle;
+        }
+}
+
+unsigned int UniformTable::size() const
+{
+        return count;
+}
+
+void UniformTable::insert(const std::string &name, const UniformHandle &handle)
+{
+        if (!handle.valid())
+                return;
+
+        uint64_t hash = hash_string(name.c_str());
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i].handle.valid())
+        {
+                if (slots[i].hash == hash && slots[i].name == name)
+                        return;
+                i = (i + 1) & mask;
+        }
+
+        slots[i].hash = hash;
+        slots[i].name = name;
+        slots[i].handle = handle;
+        ++count;
+}
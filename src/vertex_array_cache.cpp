@@ -0,0 +1,112 @@
+#include "vertex_array_cache.hpp"
+
+#include "gl_state.hpp"
+#include "hash.hpp"
+
+#include <iostream>
+
+namespace
+{
+bool is_integer(GLenum type)
+{
+        switch (type)
+        {
+        case GL_INT:
+        case GL_INT_VEC2:
+        case GL_INT_VEC3:
+        case GL_INT_VEC4:
+        case GL_UNSIGNED_INT:
+        case GL_UNSIGNED_INT_VEC2:
+        case GL_UNSIGNED_INT_VEC3:
+        case GL_UNSIGNED_INT_VEC4:
+                return true;
+        default:
+                return false;
+        }
+}
+}
+
+VertexArrayCache::~VertexArrayCache()
+{
+        clear();
+}
+
+unsigned int VertexArrayCache::bind(const VertexLayout &layout, const Shader &shader,
+                                    unsigned int vertex_buffer, unsigned int element_buffer)
+{
+        const VertexInterface &interface = shader.get_attributes();
+
+        uint64_t key[] = {layout.hash(), interface.hash(), vertex_buffer, element_buffer};
+        uint64_t hash = hash_bytes(key, sizeof(key));
+
+        auto cached = vertex_arrays.find(hash);
+        if (cached != vertex_arrays.end())
+        {
+                GLState::bind_vertex_array(cached->second);
+                return cached->second;
+        }
+
+        unsigned int vertex_array = create(layout, interface, vertex_buffer, element_buffer);
+        vertex_arrays[hash] = vertex_array;
+
+        return vertex_array;
+}
+
+void VertexArrayCache::clear()
+{
+        for (auto &vertex_array : vertex_arrays)
+                GLState::delete_vertex_array(vertex_array.second);
+
+        vertex_arrays.clear();
+}
+
+unsigned int VertexArrayCache::size() const
+{
+        return (unsigned int)vertex_arrays.size();
+}
+
+unsigned int VertexArrayCache::create(const VertexLayout &layout,
+                                      const VertexInterface &interface,
+                                      unsigned int vertex_buffer,
+                                      unsigned int element_buffer) const
+{
+        unsigned int vertex_array;
+        glGenVertexArrays(1, &vertex_array);
+        GLState::bind_vertex_array(vertex_array);
+        GLState::bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+        if (element_buffer)
+                GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+
+        // Layout attributes the program doesn't read are skipped, so a
+        // variant optimizing an input out still gets a valid VAO
+        for (auto &attribute : layout.get_attributes())
+        {
+                const VertexInterface::Attribute *input = interface.find(attribute.name);
+                if (!input)
+                        continue;
+
+                const void *offset = (const void *)(uintptr_t)attribute.offset;
+                glEnableVertexAttribArray(input->location);
+                if (is_integer(input->type) && !attribute.normalized &&
+                    attribute.type != GL_FLOAT && attribute.type != GL_HALF_FLOAT)
+                        glVertexAttribIPointer(input->location, attribute.components, attribute.type,
+                                               layout.get_stride(), offset);
+                else
+                        glVertexAttribPointer(input->location, attribute.components, attribute.type,
+                                              attribute.normalized, layout.get_stride(), offset);
+        }
+
+        // Inputs left out of the layout read the current generic value
+        for (auto &input : interface.get_attributes())
+        {
+                bool found = false;
+                for (auto &attribute : layout.get_attributes())
+                        found = found || attribute.name == input.name;
+
+                if (!found)
+                        std::cerr << "WARNING::VERTEX_LAYOUT::MISSING_ATTRIBUTE\n"
+                                  << input.name << std::endl;
+        }
+
+        return vertex_array;
+}
@@ -0,0 +1,129 @@
+#include "vertex_layout.hpp"
+
+#include "hash.hpp"
+
+#include <algorithm>
+
+namespace
+{
+unsigned int type_size(GLenum type)
+{
+        switch (type)
+        {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+                return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+                return 2;
+        default:
+                return 4;
+        }
+}
+}
+
+VertexLayout::VertexLayout() : stride(0), layout_hash(FNV_OFFSET)
+{
+}
+
+VertexLayout &VertexLayout::add(const std::string &name, int components,
+                                GLenum type, bool normalized)
+{
+        attributes.push_back(Attribute{name, components, type, normalized, stride});
+        stride += components * type_size(type);
+
+        uint32_t format[] = {(uint32_t)components, type, normalized, attributes.back().offset};
+        layout_hash = hash_bytes(name.data(), name.size() + 1, layout_hash);
+        layout_hash = hash_bytes(format, sizeof(format), layout_hash);
+
+        return *this;
+}
+
+const std::vector<VertexLayout::Attribute> &VertexLayout::get_attributes() const
+{
+        return attributes;
+}
+
+unsigned int VertexLayout::get_stride() const
+{
+        return stride;
+}
+
+uint64_t VertexLayout::hash() const
+{
+        // The stride is only known once every attribute is added
+        return hash_bytes(&stride, sizeof(stride), layout_hash);
+}
+
+VertexInterface::VertexInterface() : interface_hash(FNV_OFFSET)
+{
+}
+
+void VertexInterface::reflect(unsigned int program)
+{
+        clear();
+
+        int active = 0;
+        int max_length = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+
+        std::vector<char> name(max_length + 1);
+        for (int i = 0; i < active; ++i)
+        {
+                int length = 0;
+                int size = 0;
+                GLenum type = 0;
+                glGetActiveAttrib(program, i, (int)name.size(), &length, &size,
+                                  &type, name.data());
+
+                std::string attribute(name.data(), length);
+                int location = glGetAttribLocation(program, attribute.c_str());
+
+                // Built-ins like gl_VertexID have no location
+                if (location == -1)
+                        continue;
+
+                attributes.push_back(Attribute{attribute, location, type, size});
+        }
+
+        // The active attribute order is up to the driver
+        std::sort(attributes.begin(), attributes.end(),
+                  [](const Attribute &a, const Attribute &b) { return a.location < b.location; });
+
+        for (auto &attribute : attributes)
+        {
+                int format[] = {attribute.location, (int)attribute.type, attribute.size};
+                interface_hash = hash_bytes(attribute.name.data(), attribute.name.size() + 1,
+                                            interface_hash);
+                interface_hash = hash_bytes(format, sizeof(format), interface_hash);
+        }
+}
+
+void VertexInterface::clear()
+{
+        attributes.clear();
+        interface_hash = FNV_OFFSET;
+}
+
+const VertexInterface::Attribute *VertexInterface::find(const std::string &name) const
+{
+        for (auto &attribute : attributes)
+        {
+                if (attribute.name == name)
+                        return &attribute;
+        }
+
+        return nullptr;
+}
+
+const std::vector<VertexInterface::Attribute> &VertexInterface::get_attributes() const
+{
+        return attributes;
+}
+
+uint64_t VertexInterface::hash() const
+{
+        return interface_hash;
+}
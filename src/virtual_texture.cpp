@@ -0,0 +1,606 @@
+#include "virtual_texture.hpp"
+
+#include "gl_state.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+namespace
+{
+constexpr size_t TILE_BYTES = (size_t)VirtualTexture::SLOT_SIZE * VirtualTexture::SLOT_SIZE * 4;
+
+// Tiles read by the workers and tiles whose upload isn't known to be done
+constexpr size_t STAGING_TILES = 128;
+
+// Page coordinates and levels are bytes in the page table and feedback
+constexpr int MAX_PAGES = 256;
+
+bool is_power_of_two(int value)
+{
+        return value > 0 && (value & (value - 1)) == 0;
+}
+
+int page_level(uint32_t page)
+{
+        return (int)(page >> 16);
+}
+
+int page_x(uint32_t page)
+{
+        return (int)(page & 0xFF);
+}
+
+int page_y(uint32_t page)
+{
+        return (int)(page >> 8 & 0xFF);
+}
+}
+
+VirtualTexture::VirtualTexture(int cache_size, unsigned int threads)
+    : internal_format(GL_RGBA8), page_levels(0), pages_x(0), pages_y(0), page_table(0), cache(0),
+      cache_size(cache_size), entries_dirty(false), frame(0), stats{}, feedback_framebuffer(0),
+      feedback_color(0), feedback_depth(0), feedback_width(0), feedback_height(0), viewport_width(0),
+      viewport_height(0), readbacks{}, next_readback(0), stopping(false)
+{
+        // Slots are addressed by bytes too, and the cache must fit in a texture
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+        this->cache_size = std::max(2, std::min(std::min(cache_size, MAX_PAGES), max_size / SLOT_SIZE));
+        stats.capacity = (unsigned int)(this->cache_size * this->cache_size);
+
+        // Same as the texture loader, glBufferStorage is 4.4
+        if (!glBufferStorage && glfwExtensionSupported("GL_ARB_buffer_storage"))
+                glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+        if (glBufferStorage)
+                staging.reset(new StagingBuffer(STAGING_TILES * TILE_BYTES));
+
+        for (auto &readback : readbacks)
+                glGenBuffers(1, &readback.buffer);
+
+        if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0; i < threads; ++i)
+                workers.emplace_back(&VirtualTexture::run, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+        }
+        job_ready.notify_all();
+
+        for (auto &worker : workers)
+                worker.join();
+
+        for (auto &readback : readbacks)
+        {
+                if (readback.fence)
+                        glDeleteSync(readback.fence);
+                GLState::delete_buffer(readback.buffer);
+        }
+
+        for (auto &upload : staged_uploads)
+                glDeleteSync(upload.fence);
+
+        if (page_table)
+                GLState::delete_texture(page_table);
+        if (cache)
+                GLState::delete_texture(cache);
+
+        if (feedback_framebuffer)
+        {
+                GLState::delete_framebuffer(feedback_framebuffer);
+                glDeleteRenderbuffers(1, &feedback_color);
+                glDeleteRenderbuffers(1, &feedback_depth);
+        }
+}
+
+bool VirtualTexture::open(const std::string &filepath)
+{
+        if (is_open())
+        {
+                std::cerr << "A virtual texture is already open, can't open " << filepath << std::endl;
+                return false;
+        }
+
+        if (!file.open(filepath) || !image.read_index(file.data(), file.size()))
+        {
+                std::cerr << "Can't read the virtual texture " << filepath << std::endl;
+                file.close();
+                return false;
+        }
+
+        // Pages halve with the levels only for power of two sizes
+        int levels = 1;
+        while ((image.width >> (levels - 1)) > TILE_SIZE || (image.height >> (levels - 1)) > TILE_SIZE)
+                ++levels;
+
+        bool valid = (image.vk_format == KTX_FORMAT_RGBA8 || image.vk_format == KTX_FORMAT_RGBA8_SRGB) &&
+                     is_power_of_two(image.width) && is_power_of_two(image.height) &&
+                     image.width / TILE_SIZE <= MAX_PAGES && image.height / TILE_SIZE <= MAX_PAGES &&
+                     (int)image.levels.size() >= levels;
+
+        if (!valid)
+        {
+                std::cerr << "The virtual texture " << filepath << " isn't an RGBA8 power of two image up to "
+                          << MAX_PAGES * TILE_SIZE << " texels with its mip chain" << std::endl;
+                file.close();
+                return false;
+        }
+
+        internal_format = image.vk_format == KTX_FORMAT_RGBA8_SRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        page_levels = levels;
+        pages_x = std::max(1, image.width / TILE_SIZE);
+        pages_y = std::max(1, image.height / TILE_SIZE);
+
+        // Integer texels, fetched without filtering
+        glGenTextures(1, &page_table);
+        GLState::bind_texture(GL_TEXTURE_2D, page_table);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (glTexStorage2D)
+        {
+                glTexStorage2D(GL_TEXTURE_2D, page_levels, GL_RGBA8UI, pages_x, pages_y);
+        }
+        else
+        {
+                for (int level = 0; level < page_levels; ++level)
+                        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8UI, level_pages_x(level), level_pages_y(level), 0,
+                                     GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, page_levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        int cache_texels = cache_size * SLOT_SIZE;
+        glGenTextures(1, &cache);
+        GLState::bind_texture(GL_TEXTURE_2D, cache);
+        if (glTexStorage2D)
+                glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, cache_texels, cache_texels);
+        else
+                glTexImage2D(GL_TEXTURE_2D, 0, internal_format, cache_texels, cache_texels, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        for (int slot = cache_size * cache_size - 1; slot >= 0; --slot)
+                free_slots.push_back(slot);
+
+        entries.resize(page_levels);
+        for (int level = 0; level < page_levels; ++level)
+                entries[level].assign((size_t)level_pages_x(level) * level_pages_y(level) * 4, 0);
+
+        // The coarsest page, every lookup falls back to it
+        Tile root = {page_key(page_levels - 1, 0, 0), StagingBuffer::npos, std::vector<unsigned char>(TILE_BYTES)};
+        read_tile(root.page, root.pixels.data());
+        upload(root);
+        Resident &pinned = resident[root.page];
+        lru.erase(pinned.position);
+        pinned.pinned = true;
+        stats.loaded = 0;
+
+        update_page_table();
+
+        return true;
+}
+
+bool VirtualTexture::is_open() const
+{
+        return page_levels > 0;
+}
+
+uint32_t VirtualTexture::page_key(int level, int x, int y)
+{
+        return (uint32_t)level << 16 | (uint32_t)y << 8 | (uint32_t)x;
+}
+
+int VirtualTexture::level_pages_x(int level) const
+{
+        return std::max(1, pages_x >> level);
+}
+
+int VirtualTexture::level_pages_y(int level) const
+{
+        return std::max(1, pages_y >> level);
+}
+
+void VirtualTexture::run()
+{
+        for (;;)
+        {
+                uint32_t page;
+                {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        job_ready.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                        if (stopping)
+                                return;
+
+                        page = jobs.front();
+                        jobs.pop_front();
+                }
+
+                Tile tile = {page, StagingBuffer::npos, {}};
+                if (staging)
+                        tile.staged = staging->allocate(TILE_BYTES);
+
+                if (tile.staged != StagingBuffer::npos)
+                {
+                        read_tile(page, staging->data(tile.staged));
+                }
+                else
+                {
+                        tile.pixels.resize(TILE_BYTES);
+                        read_tile(page, tile.pixels.data());
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                tiles.push_back(std::move(tile));
+        }
+}
+
+// The page's texels and the border around them, clamped to the level.
+// Pages of levels smaller than a tile only fill its bottom left.
+void VirtualTexture::read_tile(uint32_t page, unsigned char *out) const
+{
+        const KtxImage::Level &level = image.levels[page_level(page)];
+        const unsigned char *texels = file.data() + level.offset;
+        size_t row_bytes = (size_t)level.width * 4;
+
+        int left = page_x(page) * TILE_SIZE - TILE_BORDER;
+        int bottom = page_y(page) * TILE_SIZE - TILE_BORDER;
+
+        // Columns inside the level, copied as they are
+        int first = std::max(0, -left);
+        int last = std::max(first, std::min((int)SLOT_SIZE, level.width - left));
+
+        for (int row = 0; row < SLOT_SIZE; ++row)
+        {
+                int y = std::min(std::max(bottom + row, 0), level.height - 1);
+                const unsigned char *source = texels + y * row_bytes;
+                unsigned char *dest = out + (size_t)row * SLOT_SIZE * 4;
+
+                memcpy(dest + first * 4, source + (size_t)(left + first) * 4, (size_t)(last - first) * 4);
+                for (int column = 0; column < first; ++column)
+                        memcpy(dest + column * 4, source, 4);
+                for (int column = last; column < SLOT_SIZE; ++column)
+                        memcpy(dest + column * 4, source + row_bytes - 4, 4);
+        }
+}
+
+void VirtualTexture::begin_feedback(int width, int height)
+{
+        viewport_width = width;
+        viewport_height = height;
+
+        int scaled_width = std::max(1, width / FEEDBACK_SCALE);
+        int scaled_height = std::max(1, height / FEEDBACK_SCALE);
+        if (!feedback_framebuffer)
+        {
+                glGenFramebuffers(1, &feedback_framebuffer);
+                glGenRenderbuffers(1, &feedback_color);
+                glGenRenderbuffers(1, &feedback_depth);
+        }
+
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, feedback_framebuffer);
+        if (scaled_width != feedback_width || scaled_height != feedback_height)
+        {
+                feedback_width = scaled_width;
+                feedback_height = scaled_height;
+
+                glBindRenderbuffer(GL_RENDERBUFFER, feedback_color);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, feedback_width, feedback_height);
+                glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedback_width, feedback_height);
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedback_color);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth);
+        }
+
+        // Alpha 0 is no page
+        GLState::viewport(0, 0, feedback_width, feedback_height);
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::end_feedback()
+{
+        // A readback not parsed yet keeps its buffer, this frame's feedback
+        // is dropped rather than waited for
+        Readback &readback = readbacks[next_readback];
+        if (!readback.fence)
+        {
+                GLState::bind_buffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+                if (readback.width != feedback_width || readback.height != feedback_height)
+                {
+                        readback.width = feedback_width;
+                        readback.height = feedback_height;
+                        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedback_width * feedback_height * 4, nullptr,
+                                     GL_STREAM_READ);
+                }
+
+                glReadPixels(0, 0, feedback_width, feedback_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                GLState::bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+                next_readback = (next_readback + 1) % READBACKS;
+        }
+
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+        GLState::viewport(0, 0, viewport_width, viewport_height);
+}
+
+void VirtualTexture::update()
+{
+        if (!is_open())
+                return;
+
+        ++frame;
+        release_staged();
+
+        // Oldest first, a readback can only be done if the ones before are
+        for (unsigned int i = 0; i < READBACKS; ++i)
+        {
+                Readback &readback = readbacks[(next_readback + i) % READBACKS];
+                if (!readback.fence)
+                        continue;
+                if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                        break;
+
+                glDeleteSync(readback.fence);
+                readback.fence = nullptr;
+
+                GLState::bind_buffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+                size_t size = (size_t)readback.width * readback.height * 4;
+                void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+                if (pixels)
+                {
+                        parse_feedback((const unsigned char *)pixels, readback.width, readback.height);
+                        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+                GLState::bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        upload_tiles();
+        if (entries_dirty)
+                update_page_table();
+
+        stats.resident = (unsigned int)resident.size();
+        stats.pending = (unsigned int)in_flight.size();
+}
+
+void VirtualTexture::parse_feedback(const unsigned char *pixels, int width, int height)
+{
+        // Each page with its ancestors, the coarser levels are what the
+        // shader falls back to while the page loads
+        std::unordered_set<uint32_t> pages;
+        for (size_t i = 0; i < (size_t)width * height; ++i)
+        {
+                const unsigned char *pixel = pixels + i * 4;
+                int level = pixel[2], x = pixel[0], y = pixel[1];
+                if (pixel[3] == 0 || level >= page_levels || x >= level_pages_x(level) || y >= level_pages_y(level))
+                        continue;
+
+                for (; level < page_levels; ++level, x >>= 1, y >>= 1)
+                        if (!pages.insert(page_key(level, x, y)).second)
+                                break;
+        }
+
+        std::vector<uint32_t> missing;
+        for (uint32_t page : pages)
+        {
+                auto found = resident.find(page);
+                if (found == resident.end())
+                {
+                        missing.push_back(page);
+                        continue;
+                }
+
+                found->second.last_used = frame;
+                if (!found->second.pinned)
+                        lru.splice(lru.begin(), lru, found->second.position);
+        }
+
+        stats.requested = (unsigned int)pages.size();
+        stats.missing = (unsigned int)missing.size();
+
+        // The level is the top of the key, coarsest first
+        std::sort(missing.begin(), missing.end(), std::greater<uint32_t>());
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (uint32_t page : missing)
+                {
+                        if (in_flight.size() >= MAX_PENDING)
+                                break;
+                        if (in_flight.insert(page).second)
+                                jobs.push_back(page);
+                }
+        }
+        job_ready.notify_all();
+}
+
+void VirtualTexture::upload_tiles()
+{
+        StagedUpload staged = {nullptr, {}};
+        for (unsigned int uploaded = 0; uploaded < FRAME_UPLOADS;)
+        {
+                Tile tile;
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (tiles.empty())
+                                break;
+
+                        tile = std::move(tiles.front());
+                        tiles.pop_front();
+                }
+
+                in_flight.erase(tile.page);
+                if (upload(tile))
+                        ++uploaded;
+
+                // Tiles that found no slot are asked for again by a later feedback
+                if (tile.staged != StagingBuffer::npos)
+                        staged.offsets.push_back(tile.staged);
+        }
+
+        if (!staged.offsets.empty())
+        {
+                staged.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                staged_uploads.push_back(std::move(staged));
+        }
+}
+
+// Into a free slot or the least recently requested one, unless that one
+// was requested by the last feedback too
+bool VirtualTexture::upload(Tile &tile)
+{
+        if (resident.count(tile.page))
+                return false;
+
+        int slot;
+        if (!free_slots.empty())
+        {
+                slot = free_slots.back();
+                free_slots.pop_back();
+        }
+        else
+        {
+                if (lru.empty())
+                        return false;
+
+                auto victim = resident.find(lru.back());
+                if (victim->second.last_used == frame)
+                        return false;
+
+                slot = victim->second.slot;
+                lru.pop_back();
+                resident.erase(victim);
+                ++stats.evicted;
+        }
+
+        const void *data;
+        if (tile.staged != StagingBuffer::npos)
+        {
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, staging->get_buffer());
+                data = (const void *)tile.staged;
+        }
+        else
+        {
+                GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                data = tile.pixels.data();
+        }
+
+        GLState::bind_texture(GL_TEXTURE_2D, cache);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, slot % cache_size * SLOT_SIZE, slot / cache_size * SLOT_SIZE, SLOT_SIZE,
+                        SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        lru.push_front(tile.page);
+        resident[tile.page] = Resident{slot, frame, false, lru.begin()};
+        entries_dirty = true;
+        ++stats.loaded;
+
+        return true;
+}
+
+void VirtualTexture::release_staged()
+{
+        while (!staged_uploads.empty())
+        {
+                StagedUpload &upload = staged_uploads.front();
+                if (glClientWaitSync(upload.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                        return;
+
+                glDeleteSync(upload.fence);
+                for (size_t offset : upload.offsets)
+                        staging->release(offset, TILE_BYTES);
+                staged_uploads.pop_front();
+        }
+}
+
+// Coarsest level first, so a missing page copies its parent's entry
+void VirtualTexture::update_page_table()
+{
+        GLState::bind_texture(GL_TEXTURE_2D, page_table);
+        GLState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        for (int level = page_levels - 1; level >= 0; --level)
+        {
+                int columns = level_pages_x(level), rows = level_pages_y(level);
+                unsigned char *entry = entries[level].data();
+                for (int y = 0; y < rows; ++y)
+                {
+                        for (int x = 0; x < columns; ++x, entry += 4)
+                        {
+                                auto found = resident.find(page_key(level, x, y));
+                                if (found != resident.end())
+                                {
+                                        entry[0] = (unsigned char)(found->second.slot % cache_size);
+                                        entry[1] = (unsigned char)(found->second.slot / cache_size);
+                                        entry[2] = (unsigned char)level;
+                                        entry[3] = 255;
+                                }
+                                else
+                                {
+                                        const unsigned char *parent =
+                                                &entries[level + 1][((size_t)(y >> 1) * level_pages_x(level + 1) +
+                                                                     (x >> 1)) * 4];
+                                        memcpy(entry, parent, 4);
+                                }
+                        }
+                }
+
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, columns, rows, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                                entries[level].data());
+        }
+
+        entries_dirty = false;
+}
+
+void VirtualTexture::set_uniforms(const Shader &shader, unsigned int page_table_unit,
+                                  unsigned int cache_unit) const
+{
+        shader.set_int("virtual_page_table", (int)page_table_unit);
+        shader.set_int("virtual_cache", (int)cache_unit);
+        shader.set_vec4("virtual_size", glm::vec4(image.width, image.height, pages_x, pages_y));
+        shader.set_float("virtual_max_level", (float)(page_levels - 1));
+        shader.set_float("virtual_cache_texels", (float)(cache_size * SLOT_SIZE));
+
+        // Only declared by the feedback variant, whose derivatives are
+        // FEEDBACK_SCALE times larger
+        shader.set_float("virtual_lod_bias", -std::log2((float)FEEDBACK_SCALE));
+}
+
+unsigned int VirtualTexture::get_page_table() const
+{
+        return page_table;
+}
+
+unsigned int VirtualTexture::get_cache() const
+{
+        return cache;
+}
+
+int VirtualTexture::get_width() const
+{
+        return image.width;
+}
+
+int VirtualTexture::get_height() const
+{
+        return image.height;
+}
+
+const VirtualTexture::Stats &VirtualTexture::get_stats() const
+{
+        return stats;
+}
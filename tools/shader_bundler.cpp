@@ -0,0 +1,252 @@
+// Bakes shader files into a C++ header so release builds don't touch the
+// disk for them at startup.
+//
+//     shader_bundler OUTPUT ROOT FILE...
+//
+// Every FILE is relative to ROOT and is keyed by that relative path, the
+// one the executable is given from its working directory.
+
+#include "hash.hpp"
+#include "shader_source.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+bool is_identifier(char c)
+{
+        return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+// Operators that would read as a longer one when put together, like "- -"
+bool is_operator(char c)
+{
+        return c && strchr("+-*/%<>=!&|^", c) != nullptr;
+}
+
+bool is_blank(char c)
+{
+        return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string strip_comments(const std::string &text)
+{
+        std::string out;
+        out.reserve(text.size());
+
+        size_t i = 0;
+        while (i < text.size())
+        {
+                if (text.compare(i, 2, "//") == 0)
+                {
+                        i = text.find('\n', i);
+                        if (i == std::string::npos)
+                                break;
+                }
+                else if (text.compare(i, 2, "/*") == 0)
+                {
+                        size_t close = text.find("*/", i + 2);
+                        size_t stop = close == std::string::npos ? text.size() : close + 2;
+
+                        // A block comment separates tokens, and its newlines
+                        // may end a directive
+                        bool newline = text.find('\n', i) < stop;
+                        out += newline ? '\n' : ' ';
+                        i = stop;
+                }
+                else
+                {
+                        out += text[i++];
+                }
+        }
+
+        return out;
+}
+
+// Collapses blank runs, only keeping a space where dropping it would merge
+// two tokens. Directives keep one everywhere: "#define A (x)" would turn
+// into a function-like macro.
+std::string compact_line(const std::string &line, bool directive)
+{
+        std::string out;
+        size_t i = 0;
+        while (i < line.size())
+        {
+                if (!is_blank(line[i]))
+                {
+                        out += line[i++];
+                        continue;
+                }
+
+                while (i < line.size() && is_blank(line[i]))
+                        ++i;
+
+                if (out.empty() || i == line.size())
+                        continue;
+
+                char before = out.back();
+                char after = line[i];
+                if (directive || (is_identifier(before) && is_identifier(after)) ||
+                    (is_operator(before) && is_operator(after)))
+                        out += ' ';
+        }
+
+        return out;
+}
+
+// Code lines are joined, directives keep their own line since the
+// preprocessor needs it
+std::string minify(const std::string &stage)
+{
+        std::istringstream lines(strip_comments(stage));
+        std::string out;
+        std::string code;
+
+        std::string line;
+        while (std::getline(lines, line))
+        {
+                size_t first = line.find_first_not_of(" \t\r");
+                bool directive = first != std::string::npos && line[first] == '#';
+                line = compact_line(line, directive);
+                if (line.empty())
+                        continue;
+
+                if (line[0] != '#')
+                {
+                        code += ' ' + line;
+                        continue;
+                }
+
+                if (!code.empty())
+                        out += compact_line(code, false) + '\n';
+                out += line + '\n';
+                code.clear();
+        }
+
+        if (!code.empty())
+                out += compact_line(code, false) + '\n';
+
+        return out;
+}
+
+// One string literal per line, concatenated by the compiler
+std::string literal(const std::string &text, const char *indent)
+{
+        if (text.empty())
+                return "\"\"";
+
+        std::string out;
+        size_t start = 0;
+        while (start < text.size())
+        {
+                size_t eol = text.find('\n', start);
+                size_t stop = eol == std::string::npos ? text.size() : eol + 1;
+
+                if (!out.empty())
+                        out += std::string("\n") + indent;
+
+                out += '"';
+                for (size_t i = start; i < stop; ++i)
+                {
+                        if (text[i] == '\\' || text[i] == '"')
+                                out += '\\';
+
+                        if (text[i] == '\n')
+                                out += "\\n";
+                        else
+                                out += text[i];
+                }
+                out += '"';
+
+                start = stop;
+        }
+
+        return out;
+}
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc < 3)
+        {
+                std::cerr << "Usage: " << argv[0] << " OUTPUT ROOT FILE..." << std::endl;
+                return 1;
+        }
+
+        std::string root = std::string(argv[2]) + "/";
+
+        std::ostringstream out;
+        out << "// Generated by tools/shader_bundler, do not edit\n\n"
+            << "#ifndef SHADER_BUNDLE_DATA_H\n"
+            << "#define SHADER_BUNDLE_DATA_H\n\n"
+            << "#include \"shader_bundle.hpp\"\n\n"
+            << "constexpr BundledShader BUNDLED_SHADERS[] = {\n";
+
+        size_t original = 0, stripped = 0;
+        unsigned int count = 0;
+        for (int i = 3; i < argc; ++i)
+        {
+                std::string path = argv[i];
+
+                ShaderSource source;
+                if (!source.parse(root + path))
+                {
+                        std::string message = "Can't open the file " + root + path;
+                        perror(message.c_str());
+                        return 1;
+                }
+
+                // Include-only files are already inlined in their programs
+                if (source.empty())
+                        continue;
+
+                std::string keywords;
+                for (auto &keyword : source.keywords)
+                        keywords += (keywords.empty() ? "" : " ") + keyword;
+
+                char hash[32];
+                snprintf(hash, sizeof(hash), "0x%016llxull",
+                         (unsigned long long)hash_string(path.c_str()));
+
+                out << "        {\n"
+                    << "                " << literal(path, "") << ",\n"
+                    << "                " << hash << ",\n"
+                    << "                " << literal(keywords, "") << ",\n"
+                    << "                {\n";
+
+                for (auto &stage : source.stages)
+                {
+                        std::string text = minify(stage);
+                        original += stage.size();
+                        stripped += text.size();
+
+                        out << "                  " << literal(text, "                  ") << ",\n";
+                }
+
+                out << "                },\n"
+                    << "        },\n";
+                ++count;
+        }
+
+        out << "};\n\n"
+            << "#endif /* SHADER_BUNDLE_DATA_H */\n";
+
+        std::ofstream output(argv[1], std::ios::binary);
+        if (!(output << out.str()))
+        {
+                std::string message = "Can't write the file " + std::string(argv[1]);
+                perror(message.c_str());
+                return 1;
+        }
+
+        std::cout << "Bundled " << count << " shaders, " << original << " bytes stripped to "
+                  << stripped << std::endl;
+
+        return 0;
+}
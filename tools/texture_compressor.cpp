@@ -0,0 +1,415 @@
+// Converts images to block compressed KTX2 files with their mip chain,
+// checking the quality of every level by decoding it back on the CPU.
+//
+//     texture_compressor [-f bc1|bc3|bc5|etc2|rgba8] [-o OUTPUT] [--min-psnr DB]
+//                        [--filter box|kaiser] [--linear] INPUT
+//     texture_compressor --self-test
+//
+// The format defaults to bc3 for images with alpha and bc1 otherwise, the
+// output to INPUT with a .ktx2 extension. rgba8 keeps the pixels and only
+// bakes the mipmaps. With --min-psnr, a full size level below the
+// threshold fails the conversion. Mipmaps are filtered in linear light from
+// sRGB colors, --linear is for data such as normal maps (the bc5 default).
+// --self-test round-trips synthetic images through every format and
+// checks them against fixed thresholds, and the mip kernels against each
+// other.
+
+#include "block_compression.hpp"
+#include "ktx_file.hpp"
+#include "mip_generator.hpp"
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Compresses the mip chain, returns the PSNR of level 0. The smallest
+// levels mix so much content per block that their PSNR says little about
+// the encoder. srgb tags the file so the colors are decoded through the
+// sRGB curve, as the mipmaps were filtered.
+double compress(const std::vector<MipLevel> &levels, BlockFormat format, bool srgb, KtxImage &ktx, bool verbose)
+{
+        ktx.vk_format = block_vk_format(format, srgb);
+        ktx.width = levels[0].width;
+        ktx.height = levels[0].height;
+        ktx.levels.clear();
+        ktx.data.clear();
+
+        double full_size = 0.;
+        for (const MipLevel &level : levels)
+        {
+                KtxImage::Level entry;
+                entry.offset = ktx.data.size();
+                entry.size = compressed_size(format, level.width, level.height);
+                entry.width = level.width;
+                entry.height = level.height;
+                ktx.levels.push_back(entry);
+
+                ktx.data.resize(entry.offset + entry.size);
+                compress_blocks(format, level.pixels.data(), level.width, level.height,
+                                ktx.data.data() + entry.offset);
+
+                std::vector<unsigned char> decoded(level.pixels.size());
+                decompress_blocks(format, ktx.data.data() + entry.offset, level.width,
+                                  level.height, decoded.data());
+
+                double quality = psnr(level.pixels.data(), decoded.data(), level.width,
+                                      level.height, block_channels(format));
+                if (ktx.levels.size() == 1)
+                        full_size = quality;
+
+                if (verbose)
+                        std::cout << "  level " << ktx.levels.size() - 1 << "\t" << level.width << "x"
+                                  << level.height << "\t" << std::fixed << std::setprecision(2)
+                                  << quality << " dB\n";
+        }
+
+        return full_size;
+}
+
+void store(const std::vector<MipLevel> &levels, bool srgb, KtxImage &ktx)
+{
+        ktx.vk_format = srgb ? KTX_FORMAT_RGBA8_SRGB : KTX_FORMAT_RGBA8;
+        ktx.width = levels[0].width;
+        ktx.height = levels[0].height;
+        ktx.levels.clear();
+        ktx.data.clear();
+
+        for (const MipLevel &level : levels)
+        {
+                ktx.levels.push_back(KtxImage::Level{ktx.data.size(), level.pixels.size(), level.width,
+                                                     level.height});
+                ktx.data.insert(ktx.data.end(), level.pixels.begin(), level.pixels.end());
+        }
+}
+
+std::vector<MipLevel> box_mips(const MipLevel &image)
+{
+        MipOptions options;
+        options.filter = MipFilter::BOX;
+        options.srgb = false;
+
+        return generate_mips(image.pixels.data(), image.width, image.height, options);
+}
+
+MipLevel synthetic(int width, int height, int pattern)
+{
+        MipLevel image{width, height, std::vector<unsigned char>((size_t)width * height * 4)};
+        uint32_t state = 12345;
+        for (int y = 0; y < height; ++y)
+        {
+                for (int x = 0; x < width; ++x)
+                {
+                        unsigned char *pixel = &image.pixels[((size_t)y * width + x) * 4];
+                        switch (pattern)
+                        {
+                        case 0: // Smooth gradients
+                                pixel[0] = (unsigned char)(x * 255 / std::max(1, width - 1));
+                                pixel[1] = (unsigned char)(y * 255 / std::max(1, height - 1));
+                                pixel[2] = (unsigned char)((x + y) * 255 / std::max(1, width + height - 2));
+                                pixel[3] = (unsigned char)(255 - pixel[0]);
+                                break;
+                        case 1: // Flat 8x8 tiles of colors exact in 565
+                        {
+                                int tile = (x / 8 + y / 8 * 7) % 32;
+                                pixel[0] = (unsigned char)(tile << 3 | tile >> 2);
+                                pixel[1] = (unsigned char)((63 - tile) << 2 | (63 - tile) >> 4);
+                                pixel[2] = (unsigned char)((31 - tile) << 3 | (31 - tile) >> 2);
+                                pixel[3] = 255;
+                                break;
+                        }
+                        default: // Gradients with noise, closer to a photo
+                                state = state * 1664525u + 1013904223u;
+                                for (int c = 0; c < 4; ++c)
+                                        pixel[c] = (unsigned char)std::min(
+                                            255, (x * 3 + y * (c + 1)) % 200 + (int)((state >> (8 * c)) & 15));
+                                break;
+                        }
+                }
+        }
+
+        return image;
+}
+
+bool check(bool passed, const std::string &name)
+{
+        std::cout << (passed ? "PASS " : "FAIL ") << name << "\n";
+        return passed;
+}
+
+// Every kernel and thread count must give the same bytes as the scalar
+// code, and a few levels have exact expected values
+int mip_self_test()
+{
+        int failures = 0;
+        const MipKernel kernels[] = {MipKernel::SSE2, MipKernel::AVX2};
+        for (MipFilter filter : {MipFilter::BOX, MipFilter::KAISER})
+        {
+                for (bool srgb : {false, true})
+                {
+                        // Odd and single pixel sizes take the edge paths
+                        for (int size : {512, 75, 1})
+                        {
+                                MipLevel image = synthetic(size, std::max(1, size / 3), 2);
+                                MipOptions options;
+                                options.filter = filter;
+                                options.srgb = srgb;
+                                options.threads = 1;
+                                options.kernel = MipKernel::SCALAR;
+                                std::vector<MipLevel> expected =
+                                    generate_mips(image.pixels.data(), image.width, image.height, options);
+
+                                std::string name = std::string(mip_filter_name(filter)) +
+                                                   (srgb ? " srgb " : " linear ") + std::to_string(image.width) +
+                                                   "x" + std::to_string(image.height);
+
+                                options.threads = 4;
+                                bool same = true;
+                                for (MipKernel kernel : kernels)
+                                {
+                                        if (!mip_kernel_supported(kernel))
+                                                continue;
+
+                                        options.kernel = kernel;
+                                        std::vector<MipLevel> levels =
+                                            generate_mips(image.pixels.data(), image.width, image.height, options);
+                                        for (size_t i = 0; i < levels.size() && same; ++i)
+                                                same = levels.size() == expected.size() &&
+                                                       levels[i].pixels == expected[i].pixels;
+                                }
+                                failures += !check(same, "mip kernels match, " + name);
+                        }
+                }
+        }
+
+        // Black and white columns average to linear 0.5, sRGB 188
+        MipLevel stripes{4, 4, std::vector<unsigned char>(4 * 4 * 4, 255)};
+        for (size_t i = 0; i < stripes.pixels.size(); i += 8)
+                stripes.pixels[i] = stripes.pixels[i + 1] = stripes.pixels[i + 2] = 0;
+
+        MipOptions options;
+        options.filter = MipFilter::BOX;
+        std::vector<MipLevel> levels = generate_mips(stripes.pixels.data(), 4, 4, options);
+        const unsigned char *pixel = levels[1].pixels.data();
+        failures += !check(levels.size() == 3 && pixel[0] == 188 && pixel[3] == 255, "srgb box average");
+
+        options.srgb = false;
+        levels = generate_mips(stripes.pixels.data(), 4, 4, options);
+        failures += !check(levels[1].pixels[0] == 128, "linear box average");
+
+        // Weights sum to 1, so flat images stay flat
+        MipLevel flat{33, 17, std::vector<unsigned char>(33 * 17 * 4, 77)};
+        options.filter = MipFilter::KAISER;
+        options.srgb = true;
+        levels = generate_mips(flat.pixels.data(), flat.width, flat.height, options);
+        bool unchanged = true;
+        for (auto &level : levels)
+                for (unsigned char value : level.pixels)
+                        unchanged = unchanged && value == 77;
+        failures += !check(unchanged, "kaiser keeps flat images");
+
+        return failures;
+}
+
+int self_test()
+{
+        struct Case
+        {
+                const char *name;
+                int pattern;
+                double minimum[4]; // bc1, bc3, bc5, etc2
+        };
+
+        // A little under what the encoders reach, to catch regressions.
+        // Flat 565 colors aligned on blocks must survive BC exactly.
+        const double exact = std::numeric_limits<double>::infinity();
+        const Case cases[] = {
+            {"gradient", 0, {32., 33., 45., 33.}},
+            {"flat", 1, {exact, exact, exact, 40.}},
+            {"noisy", 2, {31., 32., 40., 24.}},
+        };
+
+        const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5,
+                                       BlockFormat::ETC2_RGB};
+
+        int failures = 0;
+        for (auto &test : cases)
+        {
+                // An odd size covers the partial blocks at the edges
+                for (int size : {64, 37})
+                {
+                        std::vector<MipLevel> levels = box_mips(synthetic(size, size * 3 / 4, test.pattern));
+                        const MipLevel &image = levels[0];
+                        for (int f = 0; f < 4; ++f)
+                        {
+                                KtxImage ktx;
+                                double quality = compress(levels, formats[f], false, ktx, false);
+                                bool passed = quality >= test.minimum[f];
+                                failures += !passed;
+
+                                std::cout << (passed ? "PASS " : "FAIL ") << test.name << " " << image.width
+                                          << "x" << image.height << " " << block_format_name(formats[f])
+                                          << ": " << std::fixed << std::setprecision(2) << quality
+                                          << " dB (min " << test.minimum[f] << ")\n";
+                        }
+                }
+        }
+
+        failures += mip_self_test();
+
+        // The container must give back what was written
+        KtxImage written, read;
+        compress(box_mips(synthetic(40, 24, 0)), BlockFormat::BC3, true, written, false);
+        std::string path = "texture_compressor_self_test.ktx2";
+        std::vector<unsigned char> bytes;
+        if (written.write(path))
+        {
+                FILE *file = fopen(path.c_str(), "rb");
+                int c;
+                while (file && (c = fgetc(file)) != EOF)
+                        bytes.push_back((unsigned char)c);
+                if (file)
+                        fclose(file);
+                remove(path.c_str());
+        }
+
+        bool round_trip = read.read(bytes.data(), bytes.size()) && read.vk_format == written.vk_format &&
+                          read.width == written.width && read.height == written.height &&
+                          read.levels.size() == written.levels.size() && read.data == written.data;
+        failures += !round_trip;
+        std::cout << (round_trip ? "PASS" : "FAIL") << " ktx2 round trip\n";
+
+        std::cout << (failures ? "FAILED" : "OK") << "\n";
+        return failures ? 1 : 0;
+}
+
+void usage(const char *command)
+{
+        std::cerr << "Usage: " << command << " [-f bc1|bc3|bc5|etc2|rgba8] [-o OUTPUT] [--min-psnr DB]\n"
+                  << "       " << std::string(strlen(command), ' ') << " [--filter box|kaiser] [--linear] INPUT\n"
+                  << "       " << command << " --self-test\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+        const char *input = nullptr;
+        std::string output;
+        const char *format_name = nullptr;
+        double min_psnr = 0.;
+        MipOptions options;
+        bool linear = false;
+
+        for (int i = 1; i < argc; ++i)
+        {
+                if (strcmp(argv[i], "--self-test") == 0)
+                        return self_test();
+                else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+                        format_name = argv[++i];
+                else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+                        output = argv[++i];
+                else if (strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc)
+                        min_psnr = atof(argv[++i]);
+                else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+                {
+                        if (!parse_mip_filter(argv[++i], options.filter))
+                        {
+                                std::cerr << "Unknown filter " << argv[i] << "\n";
+                                return 1;
+                        }
+                }
+                else if (strcmp(argv[i], "--linear") == 0)
+                        linear = true;
+                else if (!input && argv[i][0] != '-')
+                        input = argv[i];
+                else
+                {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        if (!input)
+        {
+                usage(argv[0]);
+                return 1;
+        }
+
+        MipLevel image;
+        int channels;
+        stbi_load_options load_options = {};
+        load_options.flip_vertically = true;
+        unsigned char *pixels = stbi_load_ex(input, &image.width, &image.height, &channels, 4, &load_options);
+        if (!pixels)
+        {
+                std::cerr << "Error while loading texture \"" << input << "\": " << stbi_failure_reason()
+                          << "\n";
+                return 1;
+        }
+
+        image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * 4);
+        stbi_image_free(pixels);
+
+        BlockFormat format = channels == 4 || channels == 2 ? BlockFormat::BC3 : BlockFormat::BC1;
+        bool uncompressed = format_name && strcmp(format_name, "rgba8") == 0;
+        if (format_name && !uncompressed && !parse_block_format(format_name, format))
+        {
+                std::cerr << "Unknown format " << format_name << "\n";
+                return 1;
+        }
+
+        // Two channel formats hold normals or other data, not colors
+        options.srgb = !linear && (uncompressed || format != BlockFormat::BC5);
+
+        if (output.empty())
+        {
+                output = input;
+                size_t dot = output.rfind('.');
+                size_t slash = output.find_last_of("/\\");
+                if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+                        output.resize(dot);
+                output += ".ktx2";
+        }
+
+        std::cout << input << " (" << image.width << "x" << image.height << ", " << channels
+                  << " channels) to " << (uncompressed ? "rgba8" : block_format_name(format)) << ", "
+                  << mip_filter_name(options.filter) << " mipmaps\n";
+
+        std::vector<MipLevel> levels = generate_mips(image.pixels.data(), image.width, image.height, options);
+
+        KtxImage ktx;
+        double quality = std::numeric_limits<double>::infinity();
+        if (uncompressed)
+                store(levels, options.srgb, ktx);
+        else
+                quality = compress(levels, format, options.srgb, ktx, true);
+
+        size_t raw_size = (size_t)image.width * image.height * (channels == 3 ? 4 : channels) * 4 / 3;
+        std::cout << "  " << ktx.data.size() / 1024 << " KiB with mipmaps, " << raw_size / 1024
+                  << " KiB uncompressed\n";
+
+        if (quality < min_psnr)
+        {
+                std::cerr << "Quality " << quality << " dB is below " << min_psnr << " dB\n";
+                return 1;
+        }
+
+        if (!ktx.write(output))
+        {
+                std::string message = "Can't write the file " + output;
+                perror(message.c_str());
+                return 1;
+        }
+
+        return 0;
+}